@@ -0,0 +1,36 @@
+#version 450 core
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_color;
+
+//Per instance, xy is the offset and zw the scale applied to the mesh
+layout(location = 2) in vec4 in_transform;
+layout(location = 3) in vec4 in_instanceColor;
+
+layout(location = 0) out vec3 out_color;
+
+//Specialization constants, must match ShaderConstant in main.c
+layout(constant_id = 0) const bool DEQUANTIZE = true;
+
+//Identity for float vertices, maps snorm16 positions back onto the mesh bounds for packed ones
+layout(push_constant) uniform MeshConstants
+{
+	vec4 positionScale;
+	vec4 positionBias;
+} mesh;
+
+//The depth pre-pass and the shading pass must compute bit identical depth for the EQUAL test
+out gl_PerVertex
+{
+	invariant vec4 gl_Position;
+};
+
+void main()
+{
+	out_color = in_color * in_instanceColor.rgb;
+	vec3 position = DEQUANTIZE ? in_position * mesh.positionScale.xyz + mesh.positionBias.xyz : in_position;
+	gl_Position = vec4(position.xy * in_transform.zw + in_transform.xy, position.z, 1.0);
+}
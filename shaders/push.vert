@@ -0,0 +1,42 @@
+#version 450 core
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_color;
+
+layout(location = 0) out vec3 out_color;
+
+//Specialization constants, must match ShaderConstant in main.c
+layout(constant_id = 0) const bool DEQUANTIZE = true;
+
+//MeshConstants as in the other vertex shaders, followed by the per draw data pushed before every draw
+layout(push_constant) uniform DrawConstants
+{
+	vec4 positionScale;
+	vec4 positionBias;
+	mat4 transform;
+	uint materialIndex;
+} constants;
+
+//Must match MATERIAL_COUNT in main.c
+const vec3 materialColors[4] = vec3[](
+	vec3(1.0, 1.0, 1.0),
+	vec3(1.0, 0.6, 0.6),
+	vec3(0.6, 1.0, 0.6),
+	vec3(0.6, 0.6, 1.0)
+);
+
+//The depth pre-pass and the shading pass must compute bit identical depth for the EQUAL test
+out gl_PerVertex
+{
+	invariant vec4 gl_Position;
+};
+
+void main()
+{
+	out_color = in_color * materialColors[constants.materialIndex];
+	vec3 position = DEQUANTIZE ? in_position * constants.positionScale.xyz + constants.positionBias.xyz : in_position;
+	gl_Position = constants.transform * vec4(position, 1.0);
+}
@@ -7,7 +7,46 @@ layout(location = 0) in vec3 in_color;
 
 layout(location = 0) out vec4 out_fragColor;
 
+//Specialization constants, must match ShaderConstant in main.c
+layout(constant_id = 1) const bool VERTEX_COLOR = true;
+layout(constant_id = 2) const int DETAIL_OCTAVES = 0;
+layout(constant_id = 3) const bool RUNTIME_FEATURES = false;
+
+//Only read by the uber-shader variant, the same values the specialized variants have baked in
+layout(push_constant) uniform FeatureConstants
+{
+	layout(offset = 112) uint dequantize;
+	uint vertexColor;
+	uint detailOctaves;
+} features;
+
+const vec3 constantColor = vec3(0.8, 0.8, 0.8);
+
+//Sum of sine octaves over the pixel position, a loop the compiler unrolls when the count is a constant
+float detail(int octaves)
+{
+	vec2 p = gl_FragCoord.xy * 0.05;
+	float value = 0.0;
+	float amplitude = 0.5;
+
+	for (int i = 0; i < octaves; ++i)
+	{
+		value += amplitude * sin(p.x + 1.7 * sin(p.y));
+		p = p * 2.03 + vec2(1.3, 0.7);
+		amplitude *= 0.5;
+	}
+
+	return value;
+}
+
 void main()
 {
-	out_fragColor = vec4(in_color, 1.0);
+	bool vertexColor = RUNTIME_FEATURES ? features.vertexColor != 0 : VERTEX_COLOR;
+	int octaves = RUNTIME_FEATURES ? int(features.detailOctaves) : DETAIL_OCTAVES;
+
+	vec3 color = vertexColor ? in_color : constantColor;
+	if (octaves > 0)
+		color *= 0.75 + 0.25 * detail(octaves);
+
+	out_fragColor = vec4(color, 1.0);
 }
@@ -8,13 +8,30 @@ layout(location = 1) in vec3 in_color;
 
 layout(location = 0) out vec3 out_color;
 
+//Specialization constants, must match ShaderConstant in main.c
+layout(constant_id = 0) const bool DEQUANTIZE = true;
+layout(constant_id = 3) const bool RUNTIME_FEATURES = false;
+
+//Identity for float vertices, maps snorm16 positions back onto the mesh bounds for packed ones. The uber-shader
+//variant reads its features after ObjectData, at FEATURE_CONSTANTS_OFFSET in main.c
+layout(push_constant) uniform MeshConstants
+{
+	vec4 positionScale;
+	vec4 positionBias;
+	layout(offset = 112) uint dequantize;
+} mesh;
+
+//The depth pre-pass and the shading pass must compute bit identical depth for the EQUAL test
 out gl_PerVertex
 {
-	vec4 gl_Position;
+	invariant vec4 gl_Position;
 };
 
 void main()
 {
+	bool dequantize = RUNTIME_FEATURES ? mesh.dequantize != 0 : DEQUANTIZE;
+
 	out_color = in_color;
-	gl_Position = vec4(in_position, 1.0);
+	vec3 position = dequantize ? in_position * mesh.positionScale.xyz + mesh.positionBias.xyz : in_position;
+	gl_Position = vec4(position, 1.0);
 }
@@ -0,0 +1,47 @@
+#version 450 core
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_color;
+
+layout(location = 0) out vec3 out_color;
+
+//Specialization constants, must match ShaderConstant in main.c
+layout(constant_id = 0) const bool DEQUANTIZE = true;
+
+//Identity for float vertices, maps snorm16 positions back onto the mesh bounds for packed ones
+layout(push_constant) uniform MeshConstants
+{
+	vec4 positionScale;
+	vec4 positionBias;
+} mesh;
+
+//One slot per draw in the frame's region of the uniform buffer, picked with a dynamic offset
+layout(set = 0, binding = 0) uniform ObjectUniforms
+{
+	mat4 transform;
+	uint materialIndex;
+} object;
+
+//Must match MATERIAL_COUNT in main.c
+const vec3 materialColors[4] = vec3[](
+	vec3(1.0, 1.0, 1.0),
+	vec3(1.0, 0.6, 0.6),
+	vec3(0.6, 1.0, 0.6),
+	vec3(0.6, 0.6, 1.0)
+);
+
+//The depth pre-pass and the shading pass must compute bit identical depth for the EQUAL test
+out gl_PerVertex
+{
+	invariant vec4 gl_Position;
+};
+
+void main()
+{
+	out_color = in_color * materialColors[object.materialIndex];
+	vec3 position = DEQUANTIZE ? in_position * mesh.positionScale.xyz + mesh.positionBias.xyz : in_position;
+	gl_Position = object.transform * vec4(position, 1.0);
+}
@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "framestats.h"
+
+double getTime(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1000000000.0;
+}
+
+static uint32_t getBucket(double frameTime)
+{
+	uint32_t bucket = (uint32_t) (frameTime / FRAME_STATS_BUCKET_WIDTH);
+	return bucket < FRAME_STATS_BUCKETS ? bucket : FRAME_STATS_BUCKETS - 1;
+}
+
+//Upper edge of the bucket holding the given fraction of the window, exact to one bucket width
+static double getPercentile(FrameStats *stats, double fraction)
+{
+	uint32_t target = (uint32_t) ceil(fraction * stats->sampleCount);
+	if (target == 0)
+		target = 1;
+
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < FRAME_STATS_BUCKETS; ++i)
+	{
+		count += stats->histogram[i];
+		if (count >= target)
+			return (i + 1) * FRAME_STATS_BUCKET_WIDTH;
+	}
+
+	return FRAME_STATS_BUCKETS * FRAME_STATS_BUCKET_WIDTH;
+}
+
+void initFrameStats(FrameStats *stats, double budget, double reportInterval, const char *csvPath)
+{
+	stats->budget = budget;
+	stats->reportInterval = reportInterval;
+	stats->totalOverBudget = 0;
+	stats->totalFrames = 0;
+	stats->startTime = getTime();
+	stats->csv = NULL;
+
+	if (csvPath != NULL)
+	{
+		stats->csv = fopen(csvPath, "w");
+		if (stats->csv == NULL)
+			printf("Unable to open %s for writing, frame statistics go to stdout only.\n", csvPath);
+		else
+			fprintf(stats->csv, "time_s,frames,fps,min_ms,avg_ms,p50_ms,p99_ms,max_ms,stddev_ms,over_budget\n");
+	}
+
+	resetFrameStats(stats);
+}
+
+void resetFrameStats(FrameStats *stats)
+{
+	stats->sampleCount = 0;
+	stats->nextSample = 0;
+	for (uint32_t i = 0; i < FRAME_STATS_BUCKETS; ++i)
+		stats->histogram[i] = 0;
+
+	stats->overBudget = 0;
+	stats->framesSinceReport = 0;
+	stats->lastFrameTime = stats->lastReportTime = getTime();
+}
+
+double frameStatsTick(FrameStats *stats)
+{
+	double time = getTime();
+	double frameTime = time - stats->lastFrameTime;
+	stats->lastFrameTime = time;
+
+	if (stats->sampleCount == FRAME_STATS_WINDOW)
+		stats->histogram[getBucket(stats->samples[stats->nextSample])]--;
+	else
+		stats->sampleCount++;
+
+	stats->samples[stats->nextSample] = frameTime;
+	stats->nextSample = (stats->nextSample + 1) % FRAME_STATS_WINDOW;
+	stats->histogram[getBucket(frameTime)]++;
+
+	if (frameTime > stats->budget)
+	{
+		stats->overBudget++;
+		stats->totalOverBudget++;
+	}
+
+	stats->framesSinceReport++;
+	stats->totalFrames++;
+
+	return frameTime;
+}
+
+void getFrameStatsSummary(FrameStats *stats, FrameStatsSummary *summary)
+{
+	summary->frameCount = stats->sampleCount;
+	summary->min = summary->avg = summary->p50 = summary->p99 = summary->max = summary->stddev = 0.0;
+
+	if (stats->sampleCount == 0)
+		return;
+
+	double sum = 0.0;
+	double sumSq = 0.0;
+	summary->min = stats->samples[0];
+
+	for (uint32_t i = 0; i < stats->sampleCount; ++i)
+	{
+		double sample = stats->samples[i];
+		sum += sample;
+		sumSq += sample * sample;
+		if (sample < summary->min)
+			summary->min = sample;
+		if (sample > summary->max)
+			summary->max = sample;
+	}
+
+	summary->avg = sum / stats->sampleCount;
+	summary->stddev = sqrt(fmax(sumSq / stats->sampleCount - summary->avg * summary->avg, 0.0));
+	//Bucket edges can overshoot the slowest frame actually seen
+	summary->p50 = fmin(getPercentile(stats, 0.50), summary->max);
+	summary->p99 = fmin(getPercentile(stats, 0.99), summary->max);
+}
+
+bool frameStatsReport(FrameStats *stats, FrameStatsSummary *summary)
+{
+	double time = stats->lastFrameTime;
+	double elapsed = time - stats->lastReportTime;
+	if (elapsed < stats->reportInterval || stats->framesSinceReport == 0)
+		return false;
+
+	getFrameStatsSummary(stats, summary);
+	double fps = stats->framesSinceReport / elapsed;
+
+	printf("Frame time (last %u frames): min %.3f, avg %.3f, p50 %.3f, p99 %.3f, max %.3f, stddev %.3f ms, "
+			"%u of %u over the %.3f ms budget\n", summary->frameCount, 1000.0 * summary->min,
+			1000.0 * summary->avg, 1000.0 * summary->p50, 1000.0 * summary->p99, 1000.0 * summary->max,
+			1000.0 * summary->stddev, stats->overBudget, stats->framesSinceReport, 1000.0 * stats->budget);
+
+	if (stats->csv != NULL)
+	{
+		fprintf(stats->csv, "%.3f,%u,%.1f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%u\n", time - stats->startTime,
+				stats->framesSinceReport, fps, 1000.0 * summary->min, 1000.0 * summary->avg,
+				1000.0 * summary->p50, 1000.0 * summary->p99, 1000.0 * summary->max, 1000.0 * summary->stddev,
+				stats->overBudget);
+		fflush(stats->csv);
+	}
+
+	stats->lastReportTime = time;
+	stats->framesSinceReport = 0;
+	stats->overBudget = 0;
+
+	return true;
+}
+
+void destroyFrameStats(FrameStats *stats)
+{
+	if (stats->totalFrames > 0)
+		printf("%llu frames, %llu over budget (%.2f%%)\n", (unsigned long long) stats->totalFrames,
+				(unsigned long long) stats->totalOverBudget, 100.0 * stats->totalOverBudget / stats->totalFrames);
+
+	if (stats->csv != NULL)
+		fclose(stats->csv);
+	stats->csv = NULL;
+}
@@ -0,0 +1,60 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//Number of most recent frames the statistics are computed over
+#define FRAME_STATS_WINDOW 1024
+//Histogram covers 0 to 100 ms in 0.1 ms steps, anything slower lands in the last bucket
+#define FRAME_STATS_BUCKETS 1000
+#define FRAME_STATS_BUCKET_WIDTH 0.0001
+
+typedef struct _FrameStatsSummary {
+	uint32_t frameCount;
+	double min;
+	double avg;
+	double p50;
+	double p99;
+	double max;
+	double stddev;
+} FrameStatsSummary;
+
+typedef struct _FrameStats {
+	//Ring of the last FRAME_STATS_WINDOW frame times in seconds, the histogram always mirrors it
+	double samples[FRAME_STATS_WINDOW];
+	uint32_t sampleCount;
+	uint32_t nextSample;
+	uint32_t histogram[FRAME_STATS_BUCKETS];
+
+	double budget;
+	uint32_t overBudget;
+	uint64_t totalOverBudget;
+	uint64_t totalFrames;
+
+	double startTime;
+	double lastFrameTime;
+	double lastReportTime;
+	double reportInterval;
+	uint32_t framesSinceReport;
+
+	FILE *csv;
+} FrameStats;
+
+//Monotonic wall clock in seconds, unaffected by system time changes and independent of GLFW
+double getTime(void);
+
+void initFrameStats(FrameStats *stats, double budget, double reportInterval, const char *csvPath);
+void resetFrameStats(FrameStats *stats);
+
+//Records the wall time since the previous call, returns that frame time
+double frameStatsTick(FrameStats *stats);
+void getFrameStatsSummary(FrameStats *stats, FrameStatsSummary *summary);
+
+//Prints and logs a summary once every reportInterval seconds, returns true if it did
+bool frameStatsReport(FrameStats *stats, FrameStatsSummary *summary);
+
+void destroyFrameStats(FrameStats *stats);
+
+#endif
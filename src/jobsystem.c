@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "jobsystem.h"
+#include "vktools.h"
+
+typedef struct _WorkerArgs {
+	JobSystem *jobSystem;
+	uint32_t threadIndex;
+} WorkerArgs;
+
+//Takes jobs from the current batch until it runs dry, expects the mutex to be held and returns with it held
+static void doJobs(JobSystem *jobSystem, uint32_t threadIndex)
+{
+	while (jobSystem->nextJob < jobSystem->jobCount)
+	{
+		uint32_t job = jobSystem->nextJob++;
+
+		pthread_mutex_unlock(&jobSystem->mutex);
+		jobSystem->function(jobSystem->data, job, threadIndex);
+		pthread_mutex_lock(&jobSystem->mutex);
+
+		if (++jobSystem->finishedJobs == jobSystem->jobCount)
+			pthread_cond_signal(&jobSystem->workDone);
+	}
+}
+
+static void * workerMain(void *arg)
+{
+	WorkerArgs *args = arg;
+	JobSystem *jobSystem = args->jobSystem;
+	uint32_t threadIndex = args->threadIndex;
+	free(args);
+
+	uint64_t seenGeneration = 0;
+
+	pthread_mutex_lock(&jobSystem->mutex);
+	for (;;)
+	{
+		while (!jobSystem->quit && jobSystem->generation == seenGeneration)
+			pthread_cond_wait(&jobSystem->workAvailable, &jobSystem->mutex);
+
+		if (jobSystem->quit)
+			break;
+
+		seenGeneration = jobSystem->generation;
+		doJobs(jobSystem, threadIndex);
+	}
+	pthread_mutex_unlock(&jobSystem->mutex);
+
+	return NULL;
+}
+
+void initJobSystem(JobSystem *jobSystem, uint32_t threadCount)
+{
+	if (threadCount == 0 || threadCount > JOB_SYSTEM_MAX_THREADS)
+		ERR_EXIT("Invalid number of job system threads.\nExiting...\n");
+
+	jobSystem->threadCount = threadCount;
+	jobSystem->function = NULL;
+	jobSystem->data = NULL;
+	jobSystem->jobCount = jobSystem->nextJob = jobSystem->finishedJobs = 0;
+	jobSystem->generation = 0;
+	jobSystem->quit = false;
+
+	pthread_mutex_init(&jobSystem->mutex, NULL);
+	pthread_cond_init(&jobSystem->workAvailable, NULL);
+	pthread_cond_init(&jobSystem->workDone, NULL);
+
+	//Thread 0 is the caller of runJobs, only the others get a thread of their own
+	for (uint32_t i = 1; i < threadCount; ++i)
+	{
+		WorkerArgs *args = malloc(sizeof(WorkerArgs));
+		args->jobSystem = jobSystem;
+		args->threadIndex = i;
+
+		if (pthread_create(&jobSystem->threads[i], NULL, workerMain, args) != 0)
+			ERR_EXIT("Unable to create job system thread.\nExiting...\n");
+	}
+}
+
+void runJobs(JobSystem *jobSystem, JobFunction function, void *data, uint32_t jobCount)
+{
+	if (jobCount == 0)
+		return;
+
+	pthread_mutex_lock(&jobSystem->mutex);
+
+	jobSystem->function = function;
+	jobSystem->data = data;
+	jobSystem->jobCount = jobCount;
+	jobSystem->nextJob = 0;
+	jobSystem->finishedJobs = 0;
+	jobSystem->generation++;
+	pthread_cond_broadcast(&jobSystem->workAvailable);
+
+	doJobs(jobSystem, 0);
+
+	while (jobSystem->finishedJobs < jobSystem->jobCount)
+		pthread_cond_wait(&jobSystem->workDone, &jobSystem->mutex);
+
+	pthread_mutex_unlock(&jobSystem->mutex);
+}
+
+void destroyJobSystem(JobSystem *jobSystem)
+{
+	pthread_mutex_lock(&jobSystem->mutex);
+	jobSystem->quit = true;
+	pthread_cond_broadcast(&jobSystem->workAvailable);
+	pthread_mutex_unlock(&jobSystem->mutex);
+
+	for (uint32_t i = 1; i < jobSystem->threadCount; ++i)
+		pthread_join(jobSystem->threads[i], NULL);
+
+	pthread_mutex_destroy(&jobSystem->mutex);
+	pthread_cond_destroy(&jobSystem->workAvailable);
+	pthread_cond_destroy(&jobSystem->workDone);
+}
+
+uint32_t getCoreCount(void)
+{
+	long coreCount = sysconf(_SC_NPROCESSORS_ONLN);
+	if (coreCount < 1)
+		return 1;
+	if (coreCount > JOB_SYSTEM_MAX_THREADS)
+		return JOB_SYSTEM_MAX_THREADS;
+	return (uint32_t) coreCount;
+}
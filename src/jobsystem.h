@@ -0,0 +1,39 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define JOB_SYSTEM_MAX_THREADS 64
+
+//Called once per job index, threadIndex identifies the worker so it can use per-thread resources
+typedef void (*JobFunction)(void *data, uint32_t jobIndex, uint32_t threadIndex);
+
+typedef struct _JobSystem {
+	pthread_t threads[JOB_SYSTEM_MAX_THREADS];
+	uint32_t threadCount;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t workAvailable;
+	pthread_cond_t workDone;
+
+	//The batch currently being worked on, guarded by mutex
+	JobFunction function;
+	void *data;
+	uint32_t jobCount;
+	uint32_t nextJob;
+	uint32_t finishedJobs;
+	uint64_t generation;
+	bool quit;
+} JobSystem;
+
+//threadCount workers including the calling thread, which takes part in every runJobs
+void initJobSystem(JobSystem *jobSystem, uint32_t threadCount);
+//Runs function for every index in [0, jobCount) and returns once all of them have finished
+void runJobs(JobSystem *jobSystem, JobFunction function, void *data, uint32_t jobCount);
+void destroyJobSystem(JobSystem *jobSystem);
+//Online CPU cores clamped to [1, JOB_SYSTEM_MAX_THREADS], a thread count that keeps every core busy
+uint32_t getCoreCount(void);
+
+#endif
@@ -1,17 +1,72 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
-#include <time.h>
+#include <math.h>
+#include <unistd.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 //#define GLFW_INCLUDE_VULKAN
 #include <vulkan/vulkan.h>
 #include <GLFW/glfw3.h>
+#include <linmath.h>
 
 #include "vktools.h"
 #include "vkswapchain.h"
+#include "vkallocator.h"
+#include "vkstaging.h"
+#include "vkpipelinecache.h"
+#include "vkpipelineregistry.h"
+#include "framestats.h"
+#include "vkprofiler.h"
+#include "jobsystem.h"
+#include "scene.h"
+#include "mesh.h"
+#include "shaderwatch.h"
+
+//Generated by glslangValidator --vn when configured with EMBED_SHADERS
+#ifdef EMBED_SHADERS
+#include "embedded/vert.h"
+#include "embedded/frag.h"
+#include "embedded/instanced.h"
+#include "embedded/uniform.h"
+#include "embedded/push.h"
+#include "embedded/cull.h"
+#endif
 
 #define VERTEX_BUFFER_BIND_ID 0
+#define INSTANCE_BUFFER_BIND_ID 1
+
+#define INSTANCE_SWEEP_MAX 1000000
+#define INSTANCE_SWEEP_SECONDS 1.0
+#define VERTEX_BENCH_SECONDS 3.0
+#define DEPTH_BENCH_LAYERS 32
+#define DEPTH_BENCH_SECONDS 3.0
+#define DRAW_BENCH_MAX 1000000
+#define DRAW_BENCH_SECONDS 2.0
+#define VARIANT_BENCH_LAYERS 16
+#define VARIANT_BENCH_SECONDS 2.0
+#define WARMUP_BENCH_VARIANTS 500
+
+//Must match the palette in push.vert and uniform.vert
+#define MATERIAL_COUNT 4
+
+//Must match local_size_x in cull.comp
+#define CULL_GROUP_SIZE 64
+
+//First word of every SPIR-V module
+#define SPIRV_MAGIC 0x07230203
+//Relative to the directory of the executable, CMake compiles the shaders into the build directory
+#define SHADER_DIRECTORY "shaders"
+
+#define MAX_FRAMES_IN_FLIGHT 3
+#define FRAME_SWEEP_SECONDS 3.0
+#define HEADLESS_DEFAULT_FRAMES 10000
 
 /*#define GET_INSTANCE_PROC_ADDR(vkData, entrypoint) \
 { \
@@ -33,6 +88,114 @@
 	VkImageView *imageViews;
 } SwapchainBuffers;*/
 
+typedef struct _FrameData {
+	VkFence fence;
+	VkSemaphore presentComplete;
+	VkSemaphore renderComplete;
+	//Reset as a whole once the fence says the slot's last frame is done, then re-recorded
+	VkCommandPool cmdPool;
+	VkCommandBuffer cmdBuffer;
+} FrameData;
+
+//Per instance attributes of the instanced path, 20 bytes so a million instances stay at 20 MB per frame slot
+typedef struct _InstanceData {
+	float transform[4];
+	uint8_t color[4];
+} InstanceData;
+
+//Vertex stage push constants of every graphics pipeline, dequantize packed positions
+typedef struct _MeshConstants {
+	float positionScale[4];
+	float positionBias[4];
+} MeshConstants;
+
+//Per draw data, pushed as it is on the push constant path and stored in an aligned slot of the uniform buffer on
+//the uniform path
+typedef struct _ObjectData {
+	mat4x4 transform;
+	uint32_t materialIndex;
+	uint32_t padding[3];
+} ObjectData;
+
+//How the per draw path tells the draws apart
+typedef enum _DrawDataPath {
+	//A viewport per draw, no per draw data reaches the shaders
+	DRAW_DATA_VIEWPORT,
+	//A transform per draw in the uniform buffer, selected by rebinding the one set with a new dynamic offset
+	DRAW_DATA_UNIFORM,
+	//A transform per draw written straight into the command buffer with vkCmdPushConstants, right after
+	//MeshConstants
+	DRAW_DATA_PUSH
+} DrawDataPath;
+
+//Specialization constant ids shared by all shaders, must match their constant_id layouts
+typedef enum _ShaderConstant {
+	//Apply MeshConstants to the positions, skipped when they are the identity as for float meshes
+	SHADER_CONSTANT_DEQUANTIZE,
+	//Interpolated vertex color, or one constant color
+	SHADER_CONSTANT_VERTEX_COLOR,
+	//Octaves of procedural detail shaded on top of the color, 0 for none
+	SHADER_CONSTANT_DETAIL_OCTAVES,
+	//Uber-shader: simple.vert and simple.frag ignore the constants above and branch on the same values pushed at
+	//FEATURE_CONSTANTS_OFFSET instead
+	SHADER_CONSTANT_RUNTIME_FEATURES
+} ShaderConstant;
+
+//Values of the first three ShaderConstants, pushed for the uber-shader right after ObjectData. Must match the
+//offset in simple.vert and simple.frag
+#define FEATURE_CONSTANTS_OFFSET (sizeof(MeshConstants) + sizeof(ObjectData))
+#define FEATURE_CONSTANTS_SIZE (SHADER_CONSTANT_RUNTIME_FEATURES * sizeof(uint32_t))
+
+//The program part of a PipelineKey, which shaders and vertex layout a pipeline uses
+typedef enum _PipelineProgram {
+	PIPELINE_PROGRAM_VIEWPORT,
+	PIPELINE_PROGRAM_UNIFORM,
+	PIPELINE_PROGRAM_PUSH,
+	PIPELINE_PROGRAM_INSTANCED,
+	PIPELINE_PROGRAM_CULL
+} PipelineProgram;
+
+//Push constants of the culling pass, exactly the 128 bytes every implementation guarantees
+typedef struct _CullConstants {
+	float planes[6][4];
+	float boundingSphere[4];
+	uint32_t firstInstance;
+	uint32_t instanceCount;
+	uint32_t commandIndex;
+	uint32_t padding;
+} CullConstants;
+
+//Each recording thread owns a pool, command pools must never be used from two threads at once
+typedef struct _RecordThread {
+	//One pool and secondary per frame slot, so a slot can be reset while the others are still in flight
+	VkCommandPool cmdPools[MAX_FRAMES_IN_FLIGHT];
+	VkCommandBuffer cmdBuffers[MAX_FRAMES_IN_FLIGHT];
+	//The thread's slice of the depth pre-pass, executed before any thread's color slice
+	VkCommandBuffer depthCmdBuffers[MAX_FRAMES_IN_FLIGHT];
+} RecordThread;
+
+//Which part of the depth work a graphics pipeline does
+typedef enum _DepthPass {
+	//Depth tested and written while shading, the only pass without a pre-pass
+	DEPTH_PASS_SINGLE,
+	//Depth only, no fragment shader and no color writes
+	DEPTH_PASS_PREPASS,
+	//Shades only the fragments whose depth equals what the pre-pass left behind, without writing depth
+	DEPTH_PASS_SHADE
+} DepthPass;
+
+//Every pipeline preparePipeline builds, so a shader reload can build a complete replacement away from the render loop.
+//The registry owns them along with any other variant built later, pipelines the current configuration does not use
+//are VK_NULL_HANDLE
+typedef struct _PipelineSet {
+	PipelineRegistry registry;
+	VkPipeline pipeline;
+	VkPipeline depthPipeline;
+	VkPipeline instancedPipeline;
+	VkPipeline instancedDepthPipeline;
+	VkPipeline cullPipeline;
+} PipelineSet;
+
 typedef struct _VulkanData {
 	VkInstance instance;
 	VkDevice device;
@@ -43,6 +206,17 @@ typedef struct _VulkanData {
 	VkQueueFamilyProperties *queueProps;
 	uint32_t queueCount;
 	uint32_t graphicsQueueNodeIndex;
+	//Same as the graphics queue when the device has no separate transfer capable family
+	VkQueue transferQueue;
+	uint32_t transferQueueNodeIndex;
+
+	Allocator allocator;
+	StagingRing staging;
+
+	//Graphics queue timings with one slot per frame in flight, uploads with one per staging batch
+	GpuProfiler profiler;
+	uint32_t renderPassRegion;
+	GpuProfiler uploadProfiler;
 
 	uint32_t enabledExtensionCount;
 	const char* enabledExtensions[64];
@@ -65,31 +239,150 @@ typedef struct _VulkanData {
 
 	VkRenderPass renderPass;
 	VkPipeline pipeline;
-	//VkPipelineLayout pipelineLayout;
+	//Owns pipeline and every other graphics and compute pipeline, keyed by program, pass and specialization
+	PipelineRegistry pipelineRegistry;
+	//Specialization constants of the scene pipelines, indexed by ShaderConstant. DEQUANTIZE follows the mesh
+	uint32_t shaderConstants[PIPELINE_KEY_CONSTANTS];
+	//Lives as long as the device, shader reloads and variant lookups build out of it and it is saved on exit
+	PipelineCache pipelineCache;
+	//Shader reloads build on the watch thread, so it is only touched through the __atomic builtins
+	uint32_t pipelineBuildCount;
+	//Shared by all graphics pipelines, MeshConstants and ObjectData push constants and the object uniforms at set 0
+	VkPipelineLayout pipelineLayout;
+	DrawDataPath drawData;
 	
+	JobSystem jobSystem;
+	uint32_t threadCount;
+	RecordThread recordThreads[JOB_SYSTEM_MAX_THREADS];
+	//Draw list, split evenly between the recording threads
+	Scene scene;
+	//CPU time spent recording the last frame
+	double recordTime;
+
 	Swapchain swapchain;
-	VkCommandBuffer *drawCmdBuffers;
-	
+	//Set when the surface changed size or the presentation engine reported the swapchain as out of date
+	bool swapchainDirty;
+
+	FrameData frames[MAX_FRAMES_IN_FLIGHT];
+	uint32_t frameCount;
+	uint32_t currentFrame;
+	//Fence of the frame slot that last rendered to each swapchain image
+	VkFence *imageFences;
+
+	//One depth image shared by all swapchain images, sized with the swapchain
 	struct {
-		VkSemaphore presentComplete;
-		VkSemaphore renderComplete;
-	} semaphores;
+		VkFormat format;
+		VkImage image;
+		Allocation memory;
+		VkImageView view;
+		//Render the scene depth only first, so the color pass shades every pixel once
+		bool prepass;
+		//Depth only variant of pipeline
+		VkPipeline pipeline;
+	} depth;
 
 	struct {
 		VkBuffer buffer;
-		VkDeviceMemory memory;
+		Allocation memory;
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo;
 		VkVertexInputBindingDescription vertexInputBindings[1];
-		VkVertexInputAttributeDescription vertexInputAttributes[2];
+		VkVertexInputAttributeDescription vertexInputAttributes[MESH_MAX_ATTRIBUTES];
+		//Model space bounding sphere of the mesh, xyz center and w radius
+		float boundingSphere[4];
+		MeshConstants constants;
+		//Quantize float meshes at load, meshes stored packed are used as they are either way
+		bool pack;
+		bool packed;
+		VkDeviceSize size;
 	} vertices;
 
 	struct {
 		uint32_t count;
+		//UINT16 whenever the mesh has few enough vertices, halving index memory and fetch bandwidth
+		VkIndexType type;
 		VkBuffer buffer;
-		VkDeviceMemory memory;
+		Allocation memory;
 	} indices;
 
+	//Draws the whole scene with one instanced call instead of one draw per scene entry
+	struct {
+		bool enabled;
+		uint32_t capacity;
+		//One region of capacity instances per frame slot, so animated scenes never overwrite data in flight
+		VkDeviceSize slotSize;
+		InstanceData *data;
+		VkBuffer buffer;
+		Allocation memory;
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo;
+		VkVertexInputBindingDescription vertexInputBindings[2];
+		VkVertexInputAttributeDescription vertexInputAttributes[MESH_MAX_ATTRIBUTES + 2];
+		VkPipeline pipeline;
+		VkPipeline depthPipeline;
+	} instances;
+
+	//GPU driven variant of the instanced path, a compute pass culls the instances and writes the draw command
+	struct {
+		bool enabled;
+		//Visible instances compacted to the front of each frame slot's region, laid out like instances.buffer
+		VkBuffer visibleBuffer;
+		Allocation visibleMemory;
+		//One VkDrawIndexedIndirectCommand per frame slot
+		VkBuffer commandBuffer;
+		Allocation commandMemory;
+		VkDescriptorSetLayout descriptorSetLayout;
+		VkDescriptorPool descriptorPool;
+		VkDescriptorSet descriptorSet;
+		VkPipelineLayout pipelineLayout;
+		VkPipeline pipeline;
+		uint32_t profilerRegion;
+	} culling;
+
+	//Persistently mapped, one region of capacity aligned ObjectData slots per frame slot. Only the set layout
+	//exists unless enabled, which the uniform path and the draw data benchmark need
+	struct {
+		bool enabled;
+		uint32_t capacity;
+		//sizeof(ObjectData) rounded up to minUniformBufferOffsetAlignment
+		VkDeviceSize stride;
+		VkDeviceSize slotSize;
+		VkBuffer buffer;
+		Allocation memory;
+		VkDescriptorSetLayout descriptorSetLayout;
+		VkDescriptorPool descriptorPool;
+		VkDescriptorSet descriptorSet;
+	} uniforms;
+
+	//Shader hot reload. The watch thread builds a complete PipelineSet and the render loop swaps it in between frames
+	struct {
+		bool enabled;
+		ShaderWatch watch;
+		pthread_mutex_t mutex;
+		//Built but not picked up yet, guarded by mutex
+		PipelineSet pending;
+		bool ready;
+		//Swapped out pipelines wait until every frame that may still use them has finished
+		PipelineSet retired;
+		bool retiring;
+		uint32_t retireFrames;
+	} reload;
+
+	//Scratch geometry re-uploaded every frame to measure the cost of streaming
+	struct {
+		VkDeviceSize size;
+		void *data;
+		VkBuffer buffer;
+		Allocation memory;
+	} stream;
+
 	GLFWwindow *window;
+	//Resolved from the location of the executable, so the program runs from any working directory
+	char shaderDirectory[PATH_MAX];
+	//Use the SPIR-V compiled into the executable where there is any, hot reload switches back to the files
+	bool embeddedShaders;
+	//NULL when the pipeline cache should neither be loaded nor saved
+	const char *pipelineCachePath;
+	//Mesh file to draw instead of the built in triangle, NULL for the triangle
+	const char *meshPath;
 
 	/*PFN_vkGetPhysicalDeviceSurfaceSupportKHR fpGetPhysicalDeviceSurfaceSupportKHR;
 	PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR fpGetPhysicalDeviceSurfaceCapabilitiesKHR;
@@ -102,34 +395,174 @@ typedef struct _VulkanData {
 	PFN_vkQueuePresentKHR fpQueuePresentKHR;*/
 } VulkanData;
 
-/*typedef struct _Window {
+typedef struct _Window {
 	GLFWwindow* glfwWindow;
 	VulkanData vkData;
-} Window;*/
+} Window;
+
+typedef struct _Options {
+	uint32_t frameCount;
+	bool sweepFrames;
+	bool headless;
+	uint32_t frameLimit;
+	uint32_t width;
+	uint32_t height;
+	uint32_t streamMegabytes;
+	bool pipelineCache;
+	PresentProfile presentProfile;
+	double frameBudget;
+	const char *statsCsvPath;
+	uint32_t threadCount;
+	uint32_t drawCount;
+	bool animate;
+	bool recordSweep;
+	bool instanced;
+	bool instanceSweep;
+	bool gpuCull;
+	const char *meshPath;
+	bool packVertices;
+	bool vertexBench;
+	bool depthPrepass;
+	bool depthBench;
+	DrawDataPath drawData;
+	bool drawBench;
+	bool hotReload;
+	bool variantBench;
+	bool warmupBench;
+} Options;
+
+typedef struct _EmbeddedShader {
+	const char *name;
+	const uint32_t *code;
+	size_t size;
+} EmbeddedShader;
+
+static const EmbeddedShader embeddedShaders[] = {
+#ifdef EMBED_SHADERS
+	{ "vert.spv", spirv_vert, sizeof(spirv_vert) },
+	{ "frag.spv", spirv_frag, sizeof(spirv_frag) },
+	{ "instanced.spv", spirv_instanced, sizeof(spirv_instanced) },
+	{ "uniform.spv", spirv_uniform, sizeof(spirv_uniform) },
+	{ "push.spv", spirv_push, sizeof(spirv_push) },
+	{ "cull.spv", spirv_cull, sizeof(spirv_cull) },
+#endif
+	{ NULL, NULL, 0 }
+};
+
+static const uint32_t * findEmbeddedShader(const char *name, size_t *size)
+{
+	for (const EmbeddedShader *shader = embeddedShaders; shader->name != NULL; ++shader)
+	{
+		if (!strcmp(shader->name, name))
+		{
+			*size = shader->size;
+			return shader->code;
+		}
+	}
+
+	return NULL;
+}
+
+static void resolveShaderDirectory(VulkanData *vkData)
+{
+	char executable[PATH_MAX];
+	ssize_t length = readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+	char *slash = NULL;
+	if (length > 0)
+	{
+		executable[length] = '\0';
+		slash = strrchr(executable, '/');
+	}
+
+	if (slash == NULL)
+	{
+		printf("Unable to locate the executable, looking for shaders relative to the working directory.\n");
+		snprintf(vkData->shaderDirectory, sizeof(vkData->shaderDirectory), "%s", SHADER_DIRECTORY);
+		return;
+	}
+
+	*slash = '\0';
+	if (snprintf(vkData->shaderDirectory, sizeof(vkData->shaderDirectory), "%s/%s", executable, SHADER_DIRECTORY) >=
+			(int) sizeof(vkData->shaderDirectory))
+		ERR_EXIT("Shader directory path is too long.\nExiting...\n");
+}
+
+//Maps the file read only, the mapping is page aligned and so is handed to vkCreateShaderModule without a copy.
+//Returns NULL after printing why if the file cannot be opened or is not SPIR-V
+static const uint32_t * mapShader(VulkanData *vkData, const char *name, size_t *size)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%s", vkData->shaderDirectory, name);
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		printf("Unable to open shader %s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t) sizeof(uint32_t) ||
+			fileStat.st_size % sizeof(uint32_t) != 0)
+	{
+		printf("%s is not a valid SPIR-V module.\n", path);
+		close(fd);
+		return NULL;
+	}
 
-static VkShaderModule loadShader(VulkanData *vkData, char *path)
+	void *mapping = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (mapping == MAP_FAILED)
+	{
+		printf("Unable to map shader %s: %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	if (*(const uint32_t *) mapping != SPIRV_MAGIC)
+	{
+		printf("%s is not a valid SPIR-V module.\n", path);
+		munmap(mapping, fileStat.st_size);
+		return NULL;
+	}
+
+	*size = fileStat.st_size;
+	return mapping;
+}
+
+//Returns VK_NULL_HANDLE after printing why, pipeline builds fail softly so a broken shader reload cannot end the run
+static VkShaderModule loadShader(VulkanData *vkData, const char *name)
 {
-	FILE *shaderFile = fopen(path, "rb");
-	fseek(shaderFile, 0, SEEK_END);
-	size_t size = ftell(shaderFile);
-	rewind(shaderFile);
-	void *shaderSrc = malloc(size);
-	size_t result = fread(shaderSrc, 1, size, shaderFile);
-	if (result != size) ERR_EXIT("Error loading shader into memory.\nExiting...\n");
+	size_t size = 0;
+	const uint32_t *code = vkData->embeddedShaders ? findEmbeddedShader(name, &size) : NULL;
+	bool mapped = code == NULL;
+
+	if (mapped)
+	{
+		code = mapShader(vkData, name, &size);
+		if (code == NULL)
+			return VK_NULL_HANDLE;
+	}
 
 	VkShaderModuleCreateInfo moduleCreateInfo = {
 		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
 		.pNext = NULL,
 		.flags = 0,
 		.codeSize = size,
-		.pCode = shaderSrc
+		.pCode = code
 	};
 
 	VkShaderModule module;
-	VK_CHECK(vkCreateShaderModule(vkData->device, &moduleCreateInfo, NULL, &module));
+	VkResult err = vkCreateShaderModule(vkData->device, &moduleCreateInfo, NULL, &module);
+	if (err != VK_SUCCESS)
+	{
+		printf("Unable to create a shader module from %s: %d\n", name, err);
+		module = VK_NULL_HANDLE;
+	}
 
-	fclose(shaderFile);
-	free(shaderSrc);
+	//The driver has its own copy of the code once the module exists
+	if (mapped)
+		munmap((void *) code, size);
 
 	return module;
 }
@@ -189,464 +622,847 @@ void flushSetupCommandBuffer(VulkanData *vkData)
 	vkData->setupCmdBuffer = VK_NULL_HANDLE;
 }
 
-void setupSwapchain(VulkanData *vkData)
+void prepareFrames(VulkanData *vkData)
 {
-	VkSwapchainKHR oldSwapchain = vkData->swapchain;
-
-	VkSurfaceCapabilitiesKHR surfaceCapabilities;
-	VK_CHECK(vkData->fpGetPhysicalDeviceSurfaceCapabilitiesKHR(vkData->physicalDevice, vkData->surface,
-				&surfaceCapabilities));
-
-	VkExtent2D swapchainExtent;
-	if(surfaceCapabilities.currentExtent.width == (uint32_t)-1)
-	{
-		swapchainExtent.width = vkData->width;
-		swapchainExtent.height = vkData->height;
-	}
-	else
-	{
-		swapchainExtent = surfaceCapabilities.currentExtent;
-		vkData->width = surfaceCapabilities.currentExtent.width;
-		vkData->height = surfaceCapabilities.currentExtent.height;
-	}
-
-	printf("Creating surface, width: %u height: %u\n", vkData->width, vkData->height);
-
-	/*uint32_t presentModeCount;
-	VK_CHECK(vkData->fpGetPhysicalDeviceSurfacePresentModesKHR(vkData->physicalDevice, vkData->surface,
-	&presentModeCount, NULL));
-
-	VkPresentModeKHR *presentModes = malloc(presentModeCount * sizeof(VkPresentModeKHR));
-	VK_CHECK(vkData->fpGetPhysicalDeviceSurfacePresentModesKHR(vkData->physicalDevice, vkData->surface,
-	&presentModeCount, presentModes));*/
-
-	VkPresentModeKHR swapchainPresentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
-	//VkPresentModeKHR swapchainPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
-	//VkPresentModeKHR swapchainPresentMode = VK_PRESENT_MODE_FIFO_KHR;
-	//VkPresentModeKHR swapchainPresentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+	VkSemaphoreCreateInfo semaphoreInfo = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0
+	};
 
-	uint32_t desiredNumberOfSwapchainImages = surfaceCapabilities.minImageCount + 1;
-	if (surfaceCapabilities.maxImageCount > 0 &&
-			desiredNumberOfSwapchainImages > surfaceCapabilities.maxImageCount)
-		desiredNumberOfSwapchainImages = surfaceCapabilities.maxImageCount;
+	//Created signaled so the first wait on each frame slot returns immediately
+	VkFenceCreateInfo fenceInfo = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = VK_FENCE_CREATE_SIGNALED_BIT
+	};
 
-	VkSurfaceTransformFlagsKHR preTransform;
-	if (surfaceCapabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)
-		preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
-	else 
-		preTransform = surfaceCapabilities.currentTransform;
+	//Only ever reset as a whole, so no per-buffer reset flag, transient since it is re-recorded every frame
+	VkCommandPoolCreateInfo cmdPoolInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.pNext = NULL,
+		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		.queueFamilyIndex = vkData->graphicsQueueNodeIndex
+	};
 
-	VkSwapchainCreateInfoKHR swapchain = {
-		.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+	VkCommandBufferAllocateInfo cmdBufferInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
 		.pNext = NULL,
-		.flags = 0,
-		.surface = vkData->surface,
-		.minImageCount = desiredNumberOfSwapchainImages,
-		.imageFormat = vkData->format,
-		.imageColorSpace = vkData->colorSpace,
-		.imageExtent = swapchainExtent,
-		.imageArrayLayers = 1,
-		.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-		.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
-		.queueFamilyIndexCount = 0,
-		.pQueueFamilyIndices = NULL,
-		.preTransform = preTransform,
-		.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-		.presentMode = swapchainPresentMode,
-		.clipped = VK_TRUE,
-		.oldSwapchain = oldSwapchain
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1
 	};
 
-	VK_CHECK(vkData->fpCreateSwapchainKHR(vkData->device, &swapchain, NULL, &vkData->swapchain));
+	if (vkData->frameCount == 0 || vkData->frameCount > MAX_FRAMES_IN_FLIGHT)
+		ERR_EXIT("Invalid number of frames in flight.\nExiting...\n");
 
-	if (oldSwapchain != VK_NULL_HANDLE)
+	for (uint32_t i = 0; i < vkData->frameCount; ++i)
 	{
-		vkData->fpDestroySwapchainKHR(vkData->device, oldSwapchain, NULL);
-	}
-
-	VK_CHECK(vkData->fpGetSwapchainImagesKHR(vkData->device, vkData->swapchain, &vkData->swapchainImageCount,
-				NULL));
+		VK_CHECK(vkCreateSemaphore(vkData->device, &semaphoreInfo, NULL, &vkData->frames[i].presentComplete));
+		VK_CHECK(vkCreateSemaphore(vkData->device, &semaphoreInfo, NULL, &vkData->frames[i].renderComplete));
+		VK_CHECK(vkCreateFence(vkData->device, &fenceInfo, NULL, &vkData->frames[i].fence));
 
-	VkImage *swapchainImages = malloc(vkData->swapchainImageCount * sizeof(VkImage));
-	VK_CHECK(vkData->fpGetSwapchainImagesKHR(vkData->device, vkData->swapchain, &vkData->swapchainImageCount,
-				swapchainImages));
+		VK_CHECK(vkCreateCommandPool(vkData->device, &cmdPoolInfo, NULL, &vkData->frames[i].cmdPool));
+		cmdBufferInfo.commandPool = vkData->frames[i].cmdPool;
+		VK_CHECK(vkAllocateCommandBuffers(vkData->device, &cmdBufferInfo, &vkData->frames[i].cmdBuffer));
+	}
 
-	vkData->buffers.images = malloc(vkData->swapchainImageCount * sizeof(VkImage));
-	vkData->buffers.cmdBuffers = malloc(vkData->swapchainImageCount * sizeof(VkCommandBuffer));
-	vkData->buffers.imageViews = malloc(vkData->swapchainImageCount * sizeof(VkImageView));
+	vkData->currentFrame = 0;
+}
 
-	for (uint32_t i = 0; i < vkData->swapchainImageCount; ++i)
+void destroyFrames(VulkanData *vkData)
+{
+	for (uint32_t i = 0; i < vkData->frameCount; ++i)
 	{
-		vkData->buffers.images[i] = swapchainImages[i];
-		//setImageLayout(vkData->setupCmdBuffer, vkData->buffers.images[i], VK_IMAGE_ASPECT_COLOR_BIT,
-		//VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+		vkDestroySemaphore(vkData->device, vkData->frames[i].presentComplete, NULL);
+		vkDestroySemaphore(vkData->device, vkData->frames[i].renderComplete, NULL);
+		vkDestroyFence(vkData->device, vkData->frames[i].fence, NULL);
+		vkDestroyCommandPool(vkData->device, vkData->frames[i].cmdPool, NULL);
+	}
+}
 
-		VkImageViewCreateInfo colorAttachmentView = {
-			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-			.pNext = NULL,
-			.flags = 0,
-			.image = vkData->buffers.images[i],
-			.viewType = VK_IMAGE_VIEW_TYPE_2D,
-			.format = vkData->format,
-			.components = {
-				.r = VK_COMPONENT_SWIZZLE_IDENTITY,
-				.g = VK_COMPONENT_SWIZZLE_IDENTITY,
-				.b = VK_COMPONENT_SWIZZLE_IDENTITY,
-				.a = VK_COMPONENT_SWIZZLE_IDENTITY },
-			.subresourceRange = {
-				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-				.baseMipLevel = 0,
-				.levelCount = 1,
-				.baseArrayLayer = 0,
-				.layerCount = 1 }
-		};
+//Geometry used when no mesh file is given
+static const float defaultVertices[18] = {
+	0.0f, -1.0f, 1.0f, 	1.0f, 0.0f, 0.0f,
+	1.0f, 1.0f, 1.0f, 	0.0f, 1.0f, 0.0f,
+	-1.0f, 1.0f, 1.0f, 	0.0f, 0.0f, 1.0f
+};
 
-		VK_CHECK(vkCreateImageView(vkData->device, &colorAttachmentView, NULL, &vkData->buffers.imageViews[i]));
+static const uint16_t defaultIndices[3] = {
+	0, 1, 2
+};
+
+static VkFormat getMeshAttributeFormat(uint32_t format)
+{
+	switch (format)
+	{
+		case MESH_FORMAT_FLOAT3:
+			return VK_FORMAT_R32G32B32_SFLOAT;
+		case MESH_FORMAT_SNORM16x4:
+			return VK_FORMAT_R16G16B16A16_SNORM;
+		case MESH_FORMAT_UNORM8x4:
+			return VK_FORMAT_R8G8B8A8_UNORM;
 	}
 
-	vkData->currentBuffer = 0;
-	free(swapchainImages);
+	return VK_FORMAT_UNDEFINED;
 }
 
-void createCommandBuffers(VulkanData *vkData)
+void destroyVertices(VulkanData *vkData)
 {
-	VkCommandBufferAllocateInfo cmdBuffersInfo = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.pNext = NULL,
-		.commandPool = vkData->cmdPool,
-		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandBufferCount = vkData->swapchainImageCount
-	};
+	vkDestroyBuffer(vkData->device, vkData->vertices.buffer, NULL);
+	freeMemory(&vkData->allocator, &vkData->vertices.memory);
 
-	VK_CHECK(vkAllocateCommandBuffers(vkData->device, &cmdBuffersInfo, vkData->buffers.cmdBuffers));
+	vkDestroyBuffer(vkData->device, vkData->indices.buffer, NULL);
+	freeMemory(&vkData->allocator, &vkData->indices.memory);
 }
 
-void prepareSemaphores(VulkanData *vkData)
+//Wraps the built in triangle in a header, so it takes the same path as a mapped file
+static void initDefaultMesh(Mesh *mesh, MeshHeader *header)
 {
-	VkSemaphoreCreateInfo semaphoreInfo = {
-		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0
-	};
-
-	VK_CHECK(vkCreateSemaphore(vkData->device, &semaphoreInfo, NULL, &vkData->semaphores.presentComplete));
-	VK_CHECK(vkCreateSemaphore(vkData->device, &semaphoreInfo, NULL, &vkData->semaphores.renderComplete));
+	initMeshHeader(header, 3, 6 * sizeof(float), 3);
+
+	header->attributeCount = 2;
+	header->attributes[0].location = 0;
+	header->attributes[0].format = MESH_FORMAT_FLOAT3;
+	header->attributes[0].offset = 0;
+	header->attributes[1].location = 1;
+	header->attributes[1].format = MESH_FORMAT_FLOAT3;
+	header->attributes[1].offset = 3 * sizeof(float);
+
+	computeBoundingSphere(defaultVertices, header->vertexStride, header->vertexCount, header->boundingSphere);
+
+	memset(mesh, 0, sizeof(Mesh));
+	mesh->header = header;
+	mesh->vertices = defaultVertices;
+	mesh->indices = defaultIndices;
 }
 
 void prepareVertices(VulkanData *vkData)
 {
-	const float vertices[18] = {
-		0.0f, -1.0f, 1.0f, 	1.0f, 0.0f, 0.0f,
-		1.0f, 1.0f, 1.0f, 	0.0f, 1.0f, 0.0f,
-		-1.0f, 1.0f, 1.0f, 	0.0f, 0.0f, 1.0f
-	};
+	double start = getTime();
 
-	const uint32_t indices[3] = {
-		0, 1, 2
-	};
+	Mesh mesh;
+	MeshHeader defaultHeader;
 
-	vkData->indices.count = 3;
+	if (vkData->meshPath != NULL)
+	{
+		if (!mapMesh(&mesh, vkData->meshPath))
+			ERR_EXIT("Unable to load mesh.\nExiting...\n");
+	}
+	else
+	{
+		initDefaultMesh(&mesh, &defaultHeader);
+	}
 
-	void *data;
-	VkMemoryRequirements memReqs;
-	VkMemoryAllocateInfo memAllocInfo = {
-		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.pNext = NULL
-	};
+	const MeshHeader *header = mesh.header;
+	const void *vertexData = mesh.vertices;
 
-	struct StagingBuffer {
-		VkDeviceMemory memory;
-		VkBuffer buffer;
-	};
+	//The one case that needs a copy, the packed vertices are built in memory and uploaded from there
+	MeshHeader packedHeader;
+	void *packedVertices = NULL;
+	if (vkData->vertices.pack && isMeshFloatLayout(header))
+	{
+		packedVertices = packMeshVertices(header, mesh.vertices, &packedHeader);
+		header = &packedHeader;
+		vertexData = packedVertices;
+	}
 
-	struct {
-		struct StagingBuffer vertices;
-		struct StagingBuffer indices;
-	} stagingBuffers;
+	vkData->indices.count = header->indexCount;
+	vkData->indices.type = header->indexStride == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+	vkData->vertices.size = header->vertexSize;
+	vkData->vertices.packed = !isMeshFloatLayout(header);
+	memcpy(vkData->vertices.constants.positionScale, header->positionScale, sizeof(header->positionScale));
+	memcpy(vkData->vertices.constants.positionBias, header->positionBias, sizeof(header->positionBias));
 
 	VkBufferCreateInfo vertexBufferInfo = {
 		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 		.pNext = NULL,
 		.flags = 0,
+		.size = header->vertexSize,
+		.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 		.queueFamilyIndexCount = 0,
 		.pQueueFamilyIndices = NULL
 	};
 
-	vertexBufferInfo.size = sizeof(vertices);
-	vertexBufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	VK_CHECK(vkCreateBuffer(vkData->device, &vertexBufferInfo, NULL, &stagingBuffers.vertices.buffer));
-
-	vkGetBufferMemoryRequirements(vkData->device, stagingBuffers.vertices.buffer, &memReqs);
-	memAllocInfo.allocationSize = memReqs.size;
-	if (!getMemoryTypeIndex(vkData->memoryProps, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-				&memAllocInfo.memoryTypeIndex))
-		ERR_EXIT("Unable to find suitable memory type for vertex staging buffer.\nExiting...\n");
-
-	VK_CHECK(vkAllocateMemory(vkData->device, &memAllocInfo, NULL, &stagingBuffers.vertices.memory));
-	VK_CHECK(vkMapMemory(vkData->device, stagingBuffers.vertices.memory, 0, memAllocInfo.allocationSize, 0,
-				&data));
-	memcpy(data, vertices, sizeof(vertices));
-	vkUnmapMemory(vkData->device, stagingBuffers.vertices.memory);
-	VK_CHECK(vkBindBufferMemory(vkData->device, stagingBuffers.vertices.buffer, stagingBuffers.vertices.memory,
-				0));
-
-	vertexBufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 	VK_CHECK(vkCreateBuffer(vkData->device, &vertexBufferInfo, NULL, &vkData->vertices.buffer));
-
-	vkGetBufferMemoryRequirements(vkData->device, vkData->vertices.buffer, &memReqs);
-	memAllocInfo.allocationSize = memReqs.size;
-	if (!getMemoryTypeIndex(vkData->memoryProps, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				&memAllocInfo.memoryTypeIndex))
-		ERR_EXIT("Unable to find suitable memory type for vertex buffer.\nExiting...\n");
-
-	VK_CHECK(vkAllocateMemory(vkData->device, &memAllocInfo, NULL, &vkData->vertices.memory));
-	VK_CHECK(vkBindBufferMemory(vkData->device, vkData->vertices.buffer, vkData->vertices.memory, 0));
+	allocateBufferMemory(&vkData->allocator, vkData->vertices.buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&vkData->vertices.memory);
 
 	VkBufferCreateInfo indexBufferInfo = {
 		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 		.pNext = NULL,
 		.flags = 0,
+		.size = header->indexSize,
+		.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 		.queueFamilyIndexCount = 0,
 		.pQueueFamilyIndices = NULL
 	};
 
-	indexBufferInfo.size = sizeof(indices);
-	indexBufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-
-	VK_CHECK(vkCreateBuffer(vkData->device, &indexBufferInfo, NULL, &stagingBuffers.indices.buffer));
-
-	vkGetBufferMemoryRequirements(vkData->device, stagingBuffers.indices.buffer, &memReqs);
-	memAllocInfo.allocationSize = memReqs.size;
-	if (!getMemoryTypeIndex(vkData->memoryProps, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-				&memAllocInfo.memoryTypeIndex))
-		ERR_EXIT("Unable to find suitable memory type for index staging buffer.\nExiting...\n");
-
-	VK_CHECK(vkAllocateMemory(vkData->device, &memAllocInfo, NULL, &stagingBuffers.indices.memory));
-	VK_CHECK(vkMapMemory(vkData->device, stagingBuffers.indices.memory, 0, memAllocInfo.allocationSize, 0,
-				&data));
-	memcpy(data, indices, sizeof(indices));
-	vkUnmapMemory(vkData->device, stagingBuffers.indices.memory);
-	VK_CHECK(vkBindBufferMemory(vkData->device, stagingBuffers.indices.buffer, stagingBuffers.indices.memory, 0));
-
-	indexBufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 	VK_CHECK(vkCreateBuffer(vkData->device, &indexBufferInfo, NULL, &vkData->indices.buffer));
+	allocateBufferMemory(&vkData->allocator, vkData->indices.buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&vkData->indices.memory);
 
-	vkGetBufferMemoryRequirements(vkData->device, vkData->indices.buffer, &memReqs);
-	memAllocInfo.allocationSize = memReqs.size;
-	if (!getMemoryTypeIndex(vkData->memoryProps, memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				&memAllocInfo.memoryTypeIndex))
-		ERR_EXIT("Unable to find suitable memory type for index buffer.\nExiting...\n");
+	//Straight from the mapping into the ring, large meshes go through in pieces so reading the file and the GPU
+	//copies overlap. Nothing waits for the copies on the CPU
+	stagingUpload(&vkData->staging, vkData->vertices.buffer, 0, vertexData, header->vertexSize);
+	stagingUpload(&vkData->staging, vkData->indices.buffer, 0, mesh.indices, header->indexSize);
+	stagingFlush(&vkData->staging);
 
-	VK_CHECK(vkAllocateMemory(vkData->device, &memAllocInfo, NULL, &vkData->indices.memory));
-	VK_CHECK(vkBindBufferMemory(vkData->device, vkData->indices.buffer, vkData->indices.memory, 0));
+	vkData->vertices.vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vkData->vertices.vertexInputInfo.pNext = NULL;
+	vkData->vertices.vertexInputInfo.flags = 0;
+	vkData->vertices.vertexInputInfo.vertexBindingDescriptionCount = 1;
+	vkData->vertices.vertexInputInfo.pVertexBindingDescriptions = vkData->vertices.vertexInputBindings;
+	vkData->vertices.vertexInputInfo.vertexAttributeDescriptionCount = header->attributeCount;
+	vkData->vertices.vertexInputInfo.pVertexAttributeDescriptions = vkData->vertices.vertexInputAttributes;
+	
+	vkData->vertices.vertexInputBindings[0].binding = VERTEX_BUFFER_BIND_ID;
+	vkData->vertices.vertexInputBindings[0].stride = header->vertexStride;
+	vkData->vertices.vertexInputBindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-	VkCommandBuffer copyCmd = getCommandBuffer(vkData->device, vkData->cmdPool, true);
+	for (uint32_t i = 0; i < header->attributeCount; ++i)
+	{
+		vkData->vertices.vertexInputAttributes[i].location = header->attributes[i].location;
+		vkData->vertices.vertexInputAttributes[i].binding = VERTEX_BUFFER_BIND_ID;
+		vkData->vertices.vertexInputAttributes[i].format = getMeshAttributeFormat(header->attributes[i].format);
+		vkData->vertices.vertexInputAttributes[i].offset = header->attributes[i].offset;
+	}
 
-	VkBufferCopy copyRegion = {
-		.srcOffset = 0,
-		.dstOffset = 0
-	};
+	memcpy(vkData->vertices.boundingSphere, header->boundingSphere, sizeof(vkData->vertices.boundingSphere));
 
-	copyRegion.size = sizeof(vertices);
-	vkCmdCopyBuffer(copyCmd, stagingBuffers.vertices.buffer, vkData->vertices.buffer, 1, &copyRegion);
+	if (vkData->meshPath != NULL)
+	{
+		double elapsed = getTime() - start;
+		double megabytes = (header->vertexSize + header->indexSize) / (1024.0 * 1024.0);
+		printf("Loaded %s: %u vertices, %u %u bit indices, %.1f MiB in %.3f ms (%.1f MiB/s)\n", vkData->meshPath,
+				header->vertexCount, header->indexCount, 8 * header->indexStride, megabytes, 1000.0 * elapsed,
+				megabytes / elapsed);
+	}
 
-	copyRegion.size = sizeof(indices);
-	vkCmdCopyBuffer(copyCmd, stagingBuffers.indices.buffer, vkData->indices.buffer, 1, &copyRegion);
+	//Everything was copied into the staging ring by stagingUpload, the mapping is not needed anymore
+	unmapMesh(&mesh);
+	free(packedVertices);
+}
 
-	flushCommandBuffer(vkData->device, vkData->queue, vkData->cmdPool, copyCmd);
+//Same per vertex layout as the plain pipeline, plus the per instance binding. Redone whenever the vertices change
+void prepareInstanceLayout(VulkanData *vkData)
+{
+	vkData->instances.vertexInputInfo = vkData->vertices.vertexInputInfo;
+	vkData->instances.vertexInputInfo.vertexBindingDescriptionCount = 2;
+	vkData->instances.vertexInputInfo.pVertexBindingDescriptions = vkData->instances.vertexInputBindings;
+	vkData->instances.vertexInputInfo.vertexAttributeDescriptionCount =
+			vkData->vertices.vertexInputInfo.vertexAttributeDescriptionCount + 2;
+	vkData->instances.vertexInputInfo.pVertexAttributeDescriptions = vkData->instances.vertexInputAttributes;
+
+	vkData->instances.vertexInputBindings[0] = vkData->vertices.vertexInputBindings[0];
+	vkData->instances.vertexInputBindings[1].binding = INSTANCE_BUFFER_BIND_ID;
+	vkData->instances.vertexInputBindings[1].stride = sizeof(InstanceData);
+	vkData->instances.vertexInputBindings[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	uint32_t vertexAttributeCount = vkData->vertices.vertexInputInfo.vertexAttributeDescriptionCount;
+	VkVertexInputAttributeDescription *instanceAttributes =
+			&vkData->instances.vertexInputAttributes[vertexAttributeCount];
+	memcpy(vkData->instances.vertexInputAttributes, vkData->vertices.vertexInputAttributes,
+			vertexAttributeCount * sizeof(VkVertexInputAttributeDescription));
+
+	instanceAttributes[0].location = 2;
+	instanceAttributes[0].binding = INSTANCE_BUFFER_BIND_ID;
+	instanceAttributes[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	instanceAttributes[0].offset = offsetof(InstanceData, transform);
+
+	instanceAttributes[1].location = 3;
+	instanceAttributes[1].binding = INSTANCE_BUFFER_BIND_ID;
+	instanceAttributes[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+	instanceAttributes[1].offset = offsetof(InstanceData, color);
+}
 
-	vkDestroyBuffer(vkData->device, stagingBuffers.vertices.buffer, NULL);
-	vkFreeMemory(vkData->device, stagingBuffers.vertices.memory, NULL);
-	vkDestroyBuffer(vkData->device, stagingBuffers.indices.buffer, NULL);
-	vkFreeMemory(vkData->device, stagingBuffers.indices.memory, NULL);
+void prepareInstances(VulkanData *vkData)
+{
+	vkData->instances.slotSize = vkData->instances.capacity * sizeof(InstanceData);
+	vkData->instances.data = malloc(vkData->instances.slotSize);
 
-	/*VkBufferCreateInfo vertexBufferInfo = {
+	VkBufferCreateInfo instanceBufferInfo = {
 		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 		.pNext = NULL,
 		.flags = 0,
-		.size = sizeof(vertices),
-		.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		.size = vkData->instances.slotSize * MAX_FRAMES_IN_FLIGHT,
+		.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+				(vkData->culling.enabled ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0),
 		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 		.queueFamilyIndexCount = 0,
 		.pQueueFamilyIndices = NULL
 	};
 
-	VK_CHECK(vkCreateBuffer(vkData->device, &vertexBufferInfo, NULL, &vkData->vertices.buffer));
-
-	VkMemoryRequirements memReqs;
-	vkGetBufferMemoryRequirements(vkData->device, vkData->vertices.buffer, &memReqs);
+	VK_CHECK(vkCreateBuffer(vkData->device, &instanceBufferInfo, NULL, &vkData->instances.buffer));
+	allocateBufferMemory(&vkData->allocator, vkData->instances.buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&vkData->instances.memory);
 
-	uint32_t memoryType;
-	if (!memoryTypeFromProperties(vkData,
-	memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &memoryType))
-		ERR_EXIT("Unable to find suitable memory type for vertex buffer.\nExiting...\n");
-
-	VkMemoryAllocateInfo memAllocInfo = {
-		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.pNext = NULL,
-		.allocationSize = memReqs.size,
-		.memoryTypeIndex = memoryType
-	};
+	prepareInstanceLayout(vkData);
+}
 
-	VK_CHECK(vkAllocateMemory(vkData->device, &memAllocInfo, NULL, &vkData->vertices.memory));
+//Converts the scene's viewport rects into transforms of the [-1, 1] mesh and uploads them to a frame slot
+void uploadInstances(VulkanData *vkData, uint32_t frameSlot)
+{
+	Scene *scene = &vkData->scene;
 
-	void *data;
-	VK_CHECK(vkMapMemory(vkData->device, vkData->vertices.memory, 0, memAllocInfo.allocationSize, 0, &data));
+	for (uint32_t i = 0; i < scene->drawCount; ++i)
+	{
+		SceneDraw *draw = &scene->draws[i];
+		InstanceData *instance = &vkData->instances.data[i];
+
+		instance->transform[0] = 2.0f * draw->x + draw->width - 1.0f;
+		instance->transform[1] = 2.0f * draw->y + draw->height - 1.0f;
+		instance->transform[2] = draw->width;
+		instance->transform[3] = draw->height;
+
+		instance->color[0] = 128 + (i * 37) % 128;
+		instance->color[1] = 128 + (i * 61) % 128;
+		instance->color[2] = 128 + (i * 89) % 128;
+		instance->color[3] = 255;
+	}
 
-	memcpy(data, vertices, sizeof(vertices));
+	stagingUpload(&vkData->staging, vkData->instances.buffer, frameSlot * vkData->instances.slotSize,
+			vkData->instances.data, scene->drawCount * sizeof(InstanceData));
+	stagingFlush(&vkData->staging);
+}
 
-	printf("test 1\n");
-	vkUnmapMemory(vkData->device, vkData->vertices.memory);
-	
-	VK_CHECK(vkBindBufferMemory(vkData->device, vkData->vertices.buffer, vkData->vertices.memory, 0));
+//Buffers and descriptors of the culling pass, the set covers whole buffers and the slot is a push constant
+void prepareCulling(VulkanData *vkData)
+{
+	if (!(vkData->queueProps[vkData->graphicsQueueNodeIndex].queueFlags & VK_QUEUE_COMPUTE_BIT))
+		ERR_EXIT("The graphics queue does not support compute, GPU culling is not available.\nExiting...\n");
 
-	VkBufferCreateInfo indexBufferInfo = {
+	VkBufferCreateInfo visibleBufferInfo = {
 		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
 		.pNext = NULL,
 		.flags = 0,
-		.size = sizeof(indices),
-		.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		.size = vkData->instances.slotSize * MAX_FRAMES_IN_FLIGHT,
+		.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 		.queueFamilyIndexCount = 0,
 		.pQueueFamilyIndices = NULL
 	};
 
-	VK_CHECK(vkCreateBuffer(vkData->device, &indexBufferInfo, NULL, &vkData->indices.buffer));
-
-	vkGetBufferMemoryRequirements(vkData->device, vkData->indices.buffer, &memReqs);
-
-	if(!memoryTypeFromProperties(vkData,
-	memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, &memoryType))
-		ERR_EXIT("Unable t0 find suitable memory type for index buffer.\nExiting...\n");
+	VK_CHECK(vkCreateBuffer(vkData->device, &visibleBufferInfo, NULL, &vkData->culling.visibleBuffer));
+	allocateBufferMemory(&vkData->allocator, vkData->culling.visibleBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&vkData->culling.visibleMemory);
 
-	memAllocInfo.allocationSize = memReqs.size;
-	memAllocInfo.memoryTypeIndex = memoryType;
+	VkBufferCreateInfo commandBufferInfo = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.size = MAX_FRAMES_IN_FLIGHT * sizeof(VkDrawIndexedIndirectCommand),
+		.usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+				VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = 0,
+		.pQueueFamilyIndices = NULL
+	};
 
-	VK_CHECK(vkAllocateMemory(vkData->device, &memAllocInfo, NULL, &vkData->indices.memory));
-	VK_CHECK(vkMapMemory(vkData->device, vkData->indices.memory, 0, memAllocInfo.allocationSize, 0, &data));
+	VK_CHECK(vkCreateBuffer(vkData->device, &commandBufferInfo, NULL, &vkData->culling.commandBuffer));
+	allocateBufferMemory(&vkData->allocator, vkData->culling.commandBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&vkData->culling.commandMemory);
 
-	memcpy(data, indices, sizeof(indices));
+	VkDescriptorSetLayoutBinding layoutBindings[3];
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		layoutBindings[i].binding = i;
+		layoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layoutBindings[i].descriptorCount = 1;
+		layoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		layoutBindings[i].pImmutableSamplers = NULL;
+	}
 
-	vkUnmapMemory(vkData->device, vkData->indices.memory);
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.bindingCount = 3,
+		.pBindings = layoutBindings
+	};
 
-	VK_CHECK(vkBindBufferMemory(vkData->device, vkData->indices.buffer, vkData->indices.memory, 0));*/
+	VK_CHECK(vkCreateDescriptorSetLayout(vkData->device, &descriptorSetLayoutInfo, NULL,
+			&vkData->culling.descriptorSetLayout));
 
-	vkData->vertices.vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vkData->vertices.vertexInputInfo.pNext = NULL;
-	vkData->vertices.vertexInputInfo.flags = 0;
-	vkData->vertices.vertexInputInfo.vertexBindingDescriptionCount = 1;
-	vkData->vertices.vertexInputInfo.pVertexBindingDescriptions = vkData->vertices.vertexInputBindings;
-	vkData->vertices.vertexInputInfo.vertexAttributeDescriptionCount = 2;
-	vkData->vertices.vertexInputInfo.pVertexAttributeDescriptions = vkData->vertices.vertexInputAttributes;
-	
-	vkData->vertices.vertexInputBindings[0].binding = VERTEX_BUFFER_BIND_ID;
-	vkData->vertices.vertexInputBindings[0].stride = sizeof(vertices[0]) * 6;
-	vkData->vertices.vertexInputBindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	VkPushConstantRange pushConstantRange = {
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+		.offset = 0,
+		.size = sizeof(CullConstants)
+	};
 
-	vkData->vertices.vertexInputAttributes[0].location = 0;
-	vkData->vertices.vertexInputAttributes[0].binding = VERTEX_BUFFER_BIND_ID;
-	vkData->vertices.vertexInputAttributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-	vkData->vertices.vertexInputAttributes[0].offset = 0;
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.setLayoutCount = 1,
+		.pSetLayouts = &vkData->culling.descriptorSetLayout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &pushConstantRange
+	};
 
-	vkData->vertices.vertexInputAttributes[1].location = 1;
-	vkData->vertices.vertexInputAttributes[1].binding = VERTEX_BUFFER_BIND_ID;
-	vkData->vertices.vertexInputAttributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-	vkData->vertices.vertexInputAttributes[1].offset = sizeof(vertices[0]) * 3;
-}
+	VK_CHECK(vkCreatePipelineLayout(vkData->device, &pipelineLayoutInfo, NULL, &vkData->culling.pipelineLayout));
 
-void prepareRenderPass(VulkanData *vkData)
-{
-	VkAttachmentDescription attachments[1] = {
-		[0] = {
-			.flags = 0,
-			.format = vkData->format,
-			.samples = VK_SAMPLE_COUNT_1_BIT,
-			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-			.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
-			//.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			//.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-		}
+	VkDescriptorPoolSize poolSize = {
+		.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 3
 	};
 
-	VkAttachmentReference colorReference = {
-		.attachment = 0,
-		.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+	VkDescriptorPoolCreateInfo descriptorPoolInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.maxSets = 1,
+		.poolSizeCount = 1,
+		.pPoolSizes = &poolSize
 	};
 
-	VkSubpassDescription subpasses[1] = {
-		[0] = {
-			.flags = 0,
-			.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-			.inputAttachmentCount = 0,
-			.pInputAttachments = NULL,
-			.colorAttachmentCount = 1,
-			.pColorAttachments = &colorReference,
-			.pResolveAttachments = NULL,
-			.pDepthStencilAttachment = NULL,
-			.preserveAttachmentCount = 0,
-			.pPreserveAttachments = NULL
-		}
-	};
+	VK_CHECK(vkCreateDescriptorPool(vkData->device, &descriptorPoolInfo, NULL, &vkData->culling.descriptorPool));
 
-	VkSubpassDependency dependencies[1] = {
-		[0] = {
-			.srcSubpass = VK_SUBPASS_EXTERNAL,
-			.dstSubpass = 0,
-			.srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-			.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-			.srcAccessMask = 0,
-			.dstAccessMask = 0,
-			.dependencyFlags = 0
-		}
+	VkDescriptorSetAllocateInfo descriptorSetInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.pNext = NULL,
+		.descriptorPool = vkData->culling.descriptorPool,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &vkData->culling.descriptorSetLayout
 	};
 
+	VK_CHECK(vkAllocateDescriptorSets(vkData->device, &descriptorSetInfo, &vkData->culling.descriptorSet));
 
-	VkRenderPassCreateInfo renderPassInfo = {
-		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.attachmentCount = 1,
-		.pAttachments = attachments,
-		.subpassCount = 1,
-		.pSubpasses = subpasses,
-		.dependencyCount = 1,
-		.pDependencies = dependencies
+	VkDescriptorBufferInfo bufferInfos[3] = {
+		[0] = {
+			.buffer = vkData->instances.buffer,
+			.offset = 0,
+			.range = VK_WHOLE_SIZE },
+		[1] = {
+			.buffer = vkData->culling.visibleBuffer,
+			.offset = 0,
+			.range = VK_WHOLE_SIZE },
+		[2] = {
+			.buffer = vkData->culling.commandBuffer,
+			.offset = 0,
+			.range = VK_WHOLE_SIZE }
 	};
 
-	VK_CHECK(vkCreateRenderPass(vkData->device, &renderPassInfo, NULL, &vkData->renderPass));
+	VkWriteDescriptorSet descriptorWrites[3];
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].pNext = NULL;
+		descriptorWrites[i].dstSet = vkData->culling.descriptorSet;
+		descriptorWrites[i].dstBinding = i;
+		descriptorWrites[i].dstArrayElement = 0;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[i].pImageInfo = NULL;
+		descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+		descriptorWrites[i].pTexelBufferView = NULL;
+	}
+
+	vkUpdateDescriptorSets(vkData->device, 3, descriptorWrites, 0, NULL);
 }
 
-void preparePipeline(VulkanData *vkData)
+void destroyCulling(VulkanData *vkData)
 {
-	VkShaderModule vertexShader = loadShader(vkData, "../shaders/vert.spv");
-	VkShaderModule fragmentShader = loadShader(vkData, "../shaders/frag.spv");
+	vkDestroyPipelineLayout(vkData->device, vkData->culling.pipelineLayout, NULL);
+	vkDestroyDescriptorPool(vkData->device, vkData->culling.descriptorPool, NULL);
+	vkDestroyDescriptorSetLayout(vkData->device, vkData->culling.descriptorSetLayout, NULL);
+
+	vkDestroyBuffer(vkData->device, vkData->culling.commandBuffer, NULL);
+	freeMemory(&vkData->allocator, &vkData->culling.commandMemory);
+	vkDestroyBuffer(vkData->device, vkData->culling.visibleBuffer, NULL);
+	freeMemory(&vkData->allocator, &vkData->culling.visibleMemory);
+}
 
-	VkPipelineShaderStageCreateInfo shaderStages[2] = {
+void destroyInstances(VulkanData *vkData)
+{
+	vkDestroyBuffer(vkData->device, vkData->instances.buffer, NULL);
+	freeMemory(&vkData->allocator, &vkData->instances.memory);
+	free(vkData->instances.data);
+	vkData->instances.data = NULL;
+}
+
+void prepareUniforms(VulkanData *vkData)
+{
+	VkDeviceSize alignment = vkData->physicalDeviceProps.limits.minUniformBufferOffsetAlignment;
+	vkData->uniforms.stride = (sizeof(ObjectData) + alignment - 1) / alignment * alignment;
+	vkData->uniforms.slotSize = vkData->uniforms.capacity * vkData->uniforms.stride;
+
+	//Dynamic offsets are 32 bit
+	if (vkData->uniforms.slotSize * MAX_FRAMES_IN_FLIGHT > UINT32_MAX)
+		ERR_EXIT("Too many draws for the uniform buffer, dynamic offsets are limited to 4 GiB.\nExiting...\n");
+
+	VkBufferCreateInfo uniformBufferInfo = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.size = vkData->uniforms.slotSize * MAX_FRAMES_IN_FLIGHT,
+		.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = 0,
+		.pQueueFamilyIndices = NULL
+	};
+
+	VK_CHECK(vkCreateBuffer(vkData->device, &uniformBufferInfo, NULL, &vkData->uniforms.buffer));
+
+	//Written by the recording threads straight into the mapping, coherent so nothing has to be flushed
+	allocateBufferMemory(&vkData->allocator, vkData->uniforms.buffer,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &vkData->uniforms.memory);
+}
+
+void destroyUniforms(VulkanData *vkData)
+{
+	vkDestroyDescriptorPool(vkData->device, vkData->uniforms.descriptorPool, NULL);
+	vkDestroyBuffer(vkData->device, vkData->uniforms.buffer, NULL);
+	freeMemory(&vkData->allocator, &vkData->uniforms.memory);
+}
+
+void prepareDescriptorLayout(VulkanData *vkData)
+{
+	VkDescriptorSetLayoutBinding layoutBinding = {
+		.binding = 0,
+		.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+		.descriptorCount = 1,
+		.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+		.pImmutableSamplers = NULL
+	};
+
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.bindingCount = 1,
+		.pBindings = &layoutBinding
+	};
+
+	VK_CHECK(vkCreateDescriptorSetLayout(vkData->device, &descriptorSetLayoutInfo, NULL,
+			&vkData->uniforms.descriptorSetLayout));
+}
+
+void prepareDescriptorPool(VulkanData *vkData)
+{
+	VkDescriptorPoolSize poolSize = {
+		.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+		.descriptorCount = 1
+	};
+
+	VkDescriptorPoolCreateInfo descriptorPoolInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.maxSets = 1,
+		.poolSizeCount = 1,
+		.pPoolSizes = &poolSize
+	};
+
+	VK_CHECK(vkCreateDescriptorPool(vkData->device, &descriptorPoolInfo, NULL, &vkData->uniforms.descriptorPool));
+}
+
+//The one set covers a single slot at offset 0, the dynamic offset moves it to the draw's slot
+void prepareDescriptorSet(VulkanData *vkData)
+{
+	VkDescriptorSetAllocateInfo descriptorSetInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.pNext = NULL,
+		.descriptorPool = vkData->uniforms.descriptorPool,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &vkData->uniforms.descriptorSetLayout
+	};
+
+	VK_CHECK(vkAllocateDescriptorSets(vkData->device, &descriptorSetInfo, &vkData->uniforms.descriptorSet));
+
+	VkDescriptorBufferInfo bufferInfo = {
+		.buffer = vkData->uniforms.buffer,
+		.offset = 0,
+		.range = sizeof(ObjectData)
+	};
+
+	VkWriteDescriptorSet descriptorWrite = {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.pNext = NULL,
+		.dstSet = vkData->uniforms.descriptorSet,
+		.dstBinding = 0,
+		.dstArrayElement = 0,
+		.descriptorCount = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+		.pImageInfo = NULL,
+		.pBufferInfo = &bufferInfo,
+		.pTexelBufferView = NULL
+	};
+
+	vkUpdateDescriptorSets(vkData->device, 1, &descriptorWrite, 0, NULL);
+}
+
+//Prefers 32 bit float depth, the stencil of D24S8 is never used
+void selectDepthFormat(VulkanData *vkData)
+{
+	static const struct {
+		VkFormat format;
+		const char *name;
+	} candidates[3] = {
+		{ VK_FORMAT_D32_SFLOAT, "D32_SFLOAT" },
+		{ VK_FORMAT_D24_UNORM_S8_UINT, "D24_UNORM_S8_UINT" },
+		{ VK_FORMAT_D16_UNORM, "D16_UNORM" }
+	};
+
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		VkFormatProperties props;
+		vkGetPhysicalDeviceFormatProperties(vkData->physicalDevice, candidates[i].format, &props);
+		if (props.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+		{
+			vkData->depth.format = candidates[i].format;
+			printf("Depth format: %s\n", candidates[i].name);
+			return;
+		}
+	}
+
+	ERR_EXIT("No supported depth attachment format.\nExiting...\n");
+}
+
+void prepareDepth(VulkanData *vkData)
+{
+	VkImageCreateInfo imageInfo = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = vkData->depth.format,
+		.extent = {
+			.width = vkData->swapchain.width,
+			.height = vkData->swapchain.height,
+			.depth = 1 },
+		.mipLevels = 1,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = 0,
+		.pQueueFamilyIndices = NULL,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+	};
+
+	VK_CHECK(vkCreateImage(vkData->device, &imageInfo, NULL, &vkData->depth.image));
+	allocateImageMemory(&vkData->allocator, vkData->depth.image, VK_IMAGE_TILING_OPTIMAL,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkData->depth.memory);
+
+	//Views of combined formats used as attachments must cover both aspects
+	VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+	if (vkData->depth.format == VK_FORMAT_D24_UNORM_S8_UINT)
+		aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+
+	VkImageViewCreateInfo viewInfo = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.image = vkData->depth.image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = vkData->depth.format,
+		.components = {
+			.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+			.a = VK_COMPONENT_SWIZZLE_IDENTITY },
+		.subresourceRange = {
+			.aspectMask = aspectMask,
+			.baseMipLevel = 0,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 1 }
+	};
+
+	VK_CHECK(vkCreateImageView(vkData->device, &viewInfo, NULL, &vkData->depth.view));
+}
+
+void destroyDepth(VulkanData *vkData)
+{
+	vkDestroyImageView(vkData->device, vkData->depth.view, NULL);
+	vkDestroyImage(vkData->device, vkData->depth.image, NULL);
+	freeMemory(&vkData->allocator, &vkData->depth.memory);
+}
+
+void prepareRenderPass(VulkanData *vkData)
+{
+	VkAttachmentDescription attachments[2] = {
 		[0] = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-			.pNext = NULL,
 			.flags = 0,
-			.stage = VK_SHADER_STAGE_VERTEX_BIT,
-			.module = vertexShader,
-			.pName = "main",
-			.pSpecializationInfo = NULL },
+			.format = vkData->swapchain.format,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.finalLayout = vkData->swapchain.presentLayout
+			//.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			//.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+		},
+		//Cleared every frame and never read afterwards, so it is not stored either
 		[1] = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-			.pNext = NULL,
 			.flags = 0,
-			.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-			.module = fragmentShader,
-			.pName = "main",
-			.pSpecializationInfo = NULL }
+			.format = vkData->depth.format,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+		}
+	};
+
+	VkAttachmentReference colorReference = {
+		.attachment = 0,
+		.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+	};
+
+	VkAttachmentReference depthReference = {
+		.attachment = 1,
+		.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+	};
+
+	VkSubpassDescription subpasses[1] = {
+		[0] = {
+			.flags = 0,
+			.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+			.inputAttachmentCount = 0,
+			.pInputAttachments = NULL,
+			.colorAttachmentCount = 1,
+			.pColorAttachments = &colorReference,
+			.pResolveAttachments = NULL,
+			.pDepthStencilAttachment = &depthReference,
+			.preserveAttachmentCount = 0,
+			.pPreserveAttachments = NULL
+		}
+	};
+
+	VkSubpassDependency dependencies[2] = {
+		[0] = {
+			.srcSubpass = VK_SUBPASS_EXTERNAL,
+			.dstSubpass = 0,
+			.srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			.srcAccessMask = 0,
+			.dstAccessMask = 0,
+			.dependencyFlags = 0
+		},
+		//The depth image is shared by the frames in flight, the last frame's depth tests must be done before
+		//this one clears it. Either test stage may write depth and the clear happens in either
+		[1] = {
+			.srcSubpass = VK_SUBPASS_EXTERNAL,
+			.dstSubpass = 0,
+			.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+					VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			.dependencyFlags = 0
+		}
+	};
+
+
+	VkRenderPassCreateInfo renderPassInfo = {
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.attachmentCount = 2,
+		.pAttachments = attachments,
+		.subpassCount = 1,
+		.pSubpasses = subpasses,
+		.dependencyCount = 2,
+		.pDependencies = dependencies
+	};
+
+	VK_CHECK(vkCreateRenderPass(vkData->device, &renderPassInfo, NULL, &vkData->renderPass));
+}
+
+void preparePipelineLayout(VulkanData *vkData)
+{
+	VkPushConstantRange pushConstantRanges[2] = {
+		[0] = {
+			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+			.offset = 0,
+			.size = sizeof(MeshConstants) + sizeof(ObjectData) },
+		[1] = {
+			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+			.offset = FEATURE_CONSTANTS_OFFSET,
+			.size = FEATURE_CONSTANTS_SIZE }
+	};
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.setLayoutCount = 1,
+		.pSetLayouts = &vkData->uniforms.descriptorSetLayout,
+		.pushConstantRangeCount = 2,
+		.pPushConstantRanges = pushConstantRanges
+	};
+
+	VK_CHECK(vkCreatePipelineLayout(vkData->device, &pipelineLayoutInfo, NULL, &vkData->pipelineLayout));
+}
+
+//Everything a VkGraphicsPipelineCreateInfo points to, so create infos can be kept in arrays and created in one call
+typedef struct _GraphicsPipelineState {
+	VkSpecializationMapEntry constantEntries[PIPELINE_KEY_CONSTANTS];
+	VkSpecializationInfo specialization;
+	VkPipelineShaderStageCreateInfo shaderStages[2];
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly;
+	VkPipelineViewportStateCreateInfo viewport;
+	VkPipelineRasterizationStateCreateInfo rasterState;
+	VkPipelineMultisampleStateCreateInfo multisampleState;
+	VkPipelineDepthStencilStateCreateInfo depthStencilState;
+	VkPipelineColorBlendAttachmentState colorBlendAttachments[1];
+	VkPipelineColorBlendStateCreateInfo colorBlend;
+	VkDynamicState dynamicStateEnables[2];
+	VkPipelineDynamicStateCreateInfo dynamicState;
+	VkGraphicsPipelineCreateInfo info;
+} GraphicsPipelineState;
+
+//Fills state->info for key, which must stay in place until the pipeline is created since the specialization data
+//points into it
+static void initGraphicsPipelineState(VulkanData *vkData, GraphicsPipelineState *state, VkShaderModule vertexShader,
+		VkShaderModule fragmentShader, VkPipelineVertexInputStateCreateInfo *vertexInputInfo, const PipelineKey *key)
+{
+	DepthPass depthPass = key->pass;
+
+	//Both stages get every constant, entries for ids a shader does not declare are ignored
+	for (uint32_t i = 0; i < PIPELINE_KEY_CONSTANTS; ++i)
+	{
+		state->constantEntries[i].constantID = i;
+		state->constantEntries[i].offset = i * sizeof(uint32_t);
+		state->constantEntries[i].size = sizeof(uint32_t);
+	}
+
+	state->specialization = (VkSpecializationInfo) {
+		.mapEntryCount = PIPELINE_KEY_CONSTANTS,
+		.pMapEntries = state->constantEntries,
+		.dataSize = sizeof(key->constants),
+		.pData = key->constants
+	};
+
+	state->shaderStages[0] = (VkPipelineShaderStageCreateInfo) {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.stage = VK_SHADER_STAGE_VERTEX_BIT,
+		.module = vertexShader,
+		.pName = "main",
+		.pSpecializationInfo = &state->specialization
+	};
+
+	state->shaderStages[1] = (VkPipelineShaderStageCreateInfo) {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+		.module = fragmentShader,
+		.pName = "main",
+		.pSpecializationInfo = &state->specialization
 	};
 
-	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
+	state->inputAssembly = (VkPipelineInputAssemblyStateCreateInfo) {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
 		.pNext = NULL,
 		.flags = 0,
@@ -654,7 +1470,7 @@ void preparePipeline(VulkanData *vkData)
 		.primitiveRestartEnable = VK_FALSE
 	};
 
-	VkPipelineViewportStateCreateInfo viewport = {
+	state->viewport = (VkPipelineViewportStateCreateInfo) {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
 		.pNext = NULL,
 		.flags = 0,
@@ -664,7 +1480,7 @@ void preparePipeline(VulkanData *vkData)
 		.pScissors = NULL
 	};
 
-	VkPipelineRasterizationStateCreateInfo rasterState = {
+	state->rasterState = (VkPipelineRasterizationStateCreateInfo) {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
 		.pNext = NULL,
 		.flags = 0,
@@ -680,7 +1496,7 @@ void preparePipeline(VulkanData *vkData)
 		.lineWidth = 0
 	};
 
-	VkPipelineMultisampleStateCreateInfo multisampleState = {
+	state->multisampleState = (VkPipelineMultisampleStateCreateInfo) {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
 		.pNext = NULL,
 		.flags = 0,
@@ -692,513 +1508,2196 @@ void preparePipeline(VulkanData *vkData)
 		.alphaToOneEnable = VK_FALSE
 	};
 
-	VkPipelineColorBlendAttachmentState colorBlendAttachments[1] = {
-		[0] = {
-			.blendEnable = VK_FALSE,
-			.srcColorBlendFactor = VK_BLEND_FACTOR_ZERO,
-			.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
-			.colorBlendOp = VK_BLEND_OP_ADD,
-			.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
-			.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
-			.alphaBlendOp = VK_BLEND_OP_ADD,
-			.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT }
+	//Less or equal keeps the old draw order behaviour for coplanar geometry, the later draw wins. After a pre-pass
+	//only the fragments that ended up in front pass, and since no fragment shader discards they are rejected
+	//before shading
+	state->depthStencilState = (VkPipelineDepthStencilStateCreateInfo) {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.depthTestEnable = VK_TRUE,
+		.depthWriteEnable = depthPass != DEPTH_PASS_SHADE,
+		.depthCompareOp = depthPass == DEPTH_PASS_SHADE ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS_OR_EQUAL,
+		.depthBoundsTestEnable = VK_FALSE,
+		.stencilTestEnable = VK_FALSE,
+		.front = {
+			.failOp = VK_STENCIL_OP_KEEP,
+			.passOp = VK_STENCIL_OP_KEEP,
+			.depthFailOp = VK_STENCIL_OP_KEEP,
+			.compareOp = VK_COMPARE_OP_ALWAYS,
+			.compareMask = 0,
+			.writeMask = 0,
+			.reference = 0 },
+		.back = {
+			.failOp = VK_STENCIL_OP_KEEP,
+			.passOp = VK_STENCIL_OP_KEEP,
+			.depthFailOp = VK_STENCIL_OP_KEEP,
+			.compareOp = VK_COMPARE_OP_ALWAYS,
+			.compareMask = 0,
+			.writeMask = 0,
+			.reference = 0 },
+		.minDepthBounds = 0.0f,
+		.maxDepthBounds = 1.0f
+	};
+
+	state->colorBlendAttachments[0] = (VkPipelineColorBlendAttachmentState) {
+		.blendEnable = VK_FALSE,
+		.srcColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+		.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO,
+		.colorBlendOp = VK_BLEND_OP_ADD,
+		.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+		.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+		.alphaBlendOp = VK_BLEND_OP_ADD,
+		.colorWriteMask = depthPass == DEPTH_PASS_PREPASS ? 0 :
+				VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT
 	};
 
-	VkPipelineColorBlendStateCreateInfo colorBlend = {
+	state->colorBlend = (VkPipelineColorBlendStateCreateInfo) {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
 		.pNext = NULL,
 		.flags = 0,
 		.logicOpEnable = VK_FALSE,
 		.logicOp = VK_LOGIC_OP_CLEAR,
 		.attachmentCount = 1,
-		.pAttachments = colorBlendAttachments,
+		.pAttachments = state->colorBlendAttachments,
 		.blendConstants = {0, 0, 0, 0}
 	};
 
-	VkDynamicState dynamicStateEnables[2] = {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR
-	};
+	state->dynamicStateEnables[0] = VK_DYNAMIC_STATE_VIEWPORT;
+	state->dynamicStateEnables[1] = VK_DYNAMIC_STATE_SCISSOR;
 
-	VkPipelineDynamicStateCreateInfo dynamicState = {
+	state->dynamicState = (VkPipelineDynamicStateCreateInfo) {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
 		.pNext = NULL,
 		.flags = 0,
 		.dynamicStateCount = 2,
-		.pDynamicStates = dynamicStateEnables
+		.pDynamicStates = state->dynamicStateEnables
 	};
 
-	VkGraphicsPipelineCreateInfo pipeline = {
+	state->info = (VkGraphicsPipelineCreateInfo) {
 		.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
 		.pNext = NULL,
 		.flags = 0,
-		.stageCount = 2,
-		.pStages = shaderStages,
-		.pVertexInputState = &vkData->vertices.vertexInputInfo,
-		.pInputAssemblyState = &inputAssembly,
+		//The pre-pass has no fragment shader, the depth comes straight from the rasterizer
+		.stageCount = depthPass == DEPTH_PASS_PREPASS ? 1 : 2,
+		.pStages = state->shaderStages,
+		.pVertexInputState = vertexInputInfo,
+		.pInputAssemblyState = &state->inputAssembly,
 		.pTessellationState = NULL,
-		.pViewportState = &viewport,
-		.pRasterizationState = &rasterState,
-		.pMultisampleState = &multisampleState,
-		.pDepthStencilState = NULL,
-		.pColorBlendState = &colorBlend,
-		.pDynamicState = &dynamicState,
-		.layout = NULL, //vkData->pipelineLayout,
+		.pViewportState = &state->viewport,
+		.pRasterizationState = &state->rasterState,
+		.pMultisampleState = &state->multisampleState,
+		.pDepthStencilState = &state->depthStencilState,
+		.pColorBlendState = &state->colorBlend,
+		.pDynamicState = &state->dynamicState,
+		.layout = vkData->pipelineLayout,
 		.renderPass = vkData->renderPass,
 		.subpass = 0,
-		.basePipelineHandle = 0,
-		.basePipelineIndex = 0
+		.basePipelineHandle = VK_NULL_HANDLE,
+		.basePipelineIndex = -1
 	};
+}
 
-	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {
-		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+static VkPipeline createComputePipeline(VulkanData *vkData, const char *shaderName, VkPipelineLayout layout)
+{
+	VkShaderModule shader = loadShader(vkData, shaderName);
+	if (shader == VK_NULL_HANDLE)
+		return VK_NULL_HANDLE;
+
+	VkComputePipelineCreateInfo pipeline = {
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
 		.pNext = NULL,
 		.flags = 0,
-		.initialDataSize = 0,
-		.pInitialData = NULL
+		.stage = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.pNext = NULL,
+			.flags = 0,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = shader,
+			.pName = "main",
+			.pSpecializationInfo = NULL },
+		.layout = layout,
+		.basePipelineHandle = VK_NULL_HANDLE,
+		.basePipelineIndex = -1
 	};
 
-	VkPipelineCache pipelineCache;
-	VK_CHECK(vkCreatePipelineCache(vkData->device, &pipelineCacheCreateInfo, NULL, &pipelineCache));
-
-	VK_CHECK(vkCreateGraphicsPipelines(vkData->device, pipelineCache, 1, &pipeline, NULL, &vkData->pipeline));
+	VkPipeline handle;
+	double start = getTime();
+	VkResult err = vkCreateComputePipelines(vkData->device, vkData->pipelineCache.cache, 1, &pipeline, NULL,
+			&handle);
+	if (err == VK_SUCCESS)
+	{
+		printf("Pipeline creation for %s: %.3f ms\n", shaderName, 1000.0 * (getTime() - start));
+		__atomic_fetch_add(&vkData->pipelineBuildCount, 1, __ATOMIC_RELAXED);
+	}
+	else
+	{
+		printf("Pipeline creation for %s failed: %d\n", shaderName, err);
+		handle = VK_NULL_HANDLE;
+	}
 
-	vkDestroyPipelineCache(vkData->device, pipelineCache, NULL);
+	vkDestroyShaderModule(vkData->device, shader, NULL);
 
-	vkDestroyShaderModule(vkData->device, vertexShader, NULL);
-	vkDestroyShaderModule(vkData->device, fragmentShader, NULL);
+	return handle;
 }
 
-void prepareFramebuffers(VulkanData *vkData)
+static const char *programShaders[] = {
+	[PIPELINE_PROGRAM_VIEWPORT] = "vert.spv",
+	[PIPELINE_PROGRAM_UNIFORM] = "uniform.spv",
+	[PIPELINE_PROGRAM_PUSH] = "push.spv",
+	[PIPELINE_PROGRAM_INSTANCED] = "instanced.spv",
+	[PIPELINE_PROGRAM_CULL] = "cull.spv"
+};
+
+static PipelineProgram getDrawProgram(VulkanData *vkData)
 {
-	VkImageView attachments[1];
+	if (vkData->drawData == DRAW_DATA_UNIFORM)
+		return PIPELINE_PROGRAM_UNIFORM;
+	if (vkData->drawData == DRAW_DATA_PUSH)
+		return PIPELINE_PROGRAM_PUSH;
+	return PIPELINE_PROGRAM_VIEWPORT;
+}
 
-	VkFramebufferCreateInfo framebufferInfo = {
-		.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.renderPass = vkData->renderPass,
-		.attachmentCount = 1,
-		.pAttachments = attachments,
-		.width = vkData->width,
-		.height = vkData->height,
-		.layers = 1
-	};
+//Only the per draw viewport program has the uber-shader code path
+static bool usesRuntimeFeatures(VulkanData *vkData)
+{
+	return vkData->shaderConstants[SHADER_CONSTANT_RUNTIME_FEATURES] &&
+			getDrawProgram(vkData) == PIPELINE_PROGRAM_VIEWPORT;
+}
 
-	vkData->framebuffers = malloc(vkData->swapchainImageCount * sizeof(VkFramebuffer));
+static void getShaderConstants(VulkanData *vkData, uint32_t constants[PIPELINE_KEY_CONSTANTS])
+{
+	MeshConstants *mesh = &vkData->vertices.constants;
+	bool identity = true;
+	for (uint32_t c = 0; c < 3; ++c)
+		identity = identity && mesh->positionScale[c] == 1.0f && mesh->positionBias[c] == 0.0f;
 
-	for (uint32_t i = 0; i < vkData->swapchainImageCount; ++i)
-	{
-		attachments[0] = vkData->buffers.imageViews[i];
-		VK_CHECK(vkCreateFramebuffer(vkData->device, &framebufferInfo, NULL, &vkData->framebuffers[i]));
-	}
+	memcpy(constants, vkData->shaderConstants, PIPELINE_KEY_CONSTANTS * sizeof(uint32_t));
+	constants[SHADER_CONSTANT_DEQUANTIZE] = !identity;
 }
 
-void buildCommandBuffers(VulkanData *vkData)
+//How createPipelineVariants hands the create infos to the driver
+typedef enum _PipelineBatchMode {
+	//One vkCreateGraphicsPipelines per pipeline
+	PIPELINE_BATCH_SERIAL,
+	//All create infos in one call
+	PIPELINE_BATCH_SINGLE_CALL,
+	//One call per compile pool thread, all of them sharing the pipeline cache
+	PIPELINE_BATCH_PARALLEL
+} PipelineBatchMode;
+
+typedef struct _PipelineSliceArgs {
+	VkDevice device;
+	VkPipelineCache cache;
+	const VkGraphicsPipelineCreateInfo *infos;
+	VkPipeline *pipelines;
+	uint32_t first;
+	uint32_t count;
+	uint32_t sliceCount;
+	//One per slice
+	VkResult *results;
+} PipelineSliceArgs;
+
+//Creates one contiguous slice of the create infos, jobIndex picks the slice
+static void createPipelineSlice(void *data, uint32_t jobIndex, uint32_t threadIndex)
 {
-	VkCommandBufferBeginInfo cmdBufferInfo = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.pInheritanceInfo = NULL
-	};
+	//The slices share nothing per thread, the pipeline cache synchronizes itself
+	(void) threadIndex;
 
-	VkClearValue clearValues[1] = {
-		[0] = {
-			.color = {
-				.float32[0] = 0.0f,
-				.float32[1] = 0.0f,
-				.float32[2] = 0.0f,
-				.float32[3] = 0.0f }}
-	};
+	PipelineSliceArgs *args = data;
+	uint32_t first = args->first + (uint64_t) args->count * jobIndex / args->sliceCount;
+	uint32_t last = args->first + (uint64_t) args->count * (jobIndex + 1) / args->sliceCount;
 
-	VkRenderPassBeginInfo renderPassBeginInfo = {
-		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-		.pNext = NULL,
-		.renderPass = vkData->renderPass,
-		.renderArea = {
-			.offset = {
-				.x = 0,
-				.y = 0 },
-			.extent = {
-				.width = vkData->width,
-				.height = vkData->height }},
-		.clearValueCount = 1,
-		.pClearValues = clearValues
-	};
+	args->results[jobIndex] = VK_SUCCESS;
+	if (last > first)
+		args->results[jobIndex] = vkCreateGraphicsPipelines(args->device, args->cache, last - first,
+				&args->infos[first], NULL, &args->pipelines[first]);
+}
 
-	for (uint32_t i = 0; i < vkData->swapchainImageCount; ++i)
+//Hands the create infos to the driver as mode says, the roots are the first rootCount infos
+static VkResult createPipelineBatch(VulkanData *vkData, JobSystem *pool, VkPipelineCache cache,
+		VkGraphicsPipelineCreateInfo *infos, const int32_t *parents, uint32_t rootCount, uint32_t count,
+		PipelineBatchMode mode, VkPipeline *pipelines)
+{
+	VkResult err = VK_SUCCESS;
+
+	switch (mode)
 	{
-		renderPassBeginInfo.framebuffer = vkData->framebuffers[i];
+		case PIPELINE_BATCH_SERIAL:
+			for (uint32_t i = 0; i < count && err == VK_SUCCESS; ++i)
+			{
+				if (parents != NULL && parents[i] >= 0)
+					infos[i].basePipelineHandle = pipelines[parents[i]];
+				err = vkCreateGraphicsPipelines(vkData->device, cache, 1, &infos[i], NULL, &pipelines[i]);
+			}
+			break;
+		case PIPELINE_BATCH_SINGLE_CALL:
+			err = vkCreateGraphicsPipelines(vkData->device, cache, count, infos, NULL, pipelines);
+			break;
+		case PIPELINE_BATCH_PARALLEL:
+		{
+			//The roots are few, they go first on this thread so every slice can name its parents by handle
+			if (rootCount > 0)
+				err = vkCreateGraphicsPipelines(vkData->device, cache, rootCount, infos, NULL, pipelines);
+			if (err != VK_SUCCESS)
+				break;
 
-		VK_CHECK(vkBeginCommandBuffer(vkData->buffers.cmdBuffers[i], &cmdBufferInfo));
+			for (uint32_t i = rootCount; i < count; ++i)
+			{
+				if (parents != NULL && parents[i] >= 0)
+					infos[i].basePipelineHandle = pipelines[parents[i]];
+			}
 
-		vkCmdBeginRenderPass(vkData->buffers.cmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			VkResult results[JOB_SYSTEM_MAX_THREADS];
+			PipelineSliceArgs args = {
+				.device = vkData->device,
+				.cache = cache,
+				.infos = infos,
+				.pipelines = pipelines,
+				.first = rootCount,
+				.count = count - rootCount,
+				.sliceCount = pool->threadCount,
+				.results = results
+			};
+
+			runJobs(pool, createPipelineSlice, &args, pool->threadCount);
+			for (uint32_t i = 0; i < pool->threadCount; ++i)
+			{
+				if (results[i] != VK_SUCCESS)
+					err = results[i];
+			}
+			break;
+		}
+	}
 
+	return err;
+}
+
+//Pipeline factory for many graphics variants at once, the registry builds through it and so does the warm-up
+//benchmark. parents[i] is the index of the variant that variant i derives from, or -1 for a root. The roots have to
+//come before every derived variant. Without parents nothing is marked as a derivative, which most desktop drivers
+//gain nothing from anyway. pool is only used by PIPELINE_BATCH_PARALLEL. Returns false after printing why, with
+//every pipeline destroyed again, if a shader is missing or the driver rejects any of the pipelines
+static bool createPipelineVariants(VulkanData *vkData, JobSystem *pool, VkPipelineCache cache,
+		const PipelineKey *keys, const int32_t *parents, uint32_t count, PipelineBatchMode mode, VkPipeline *pipelines)
+{
+	for (uint32_t i = 0; i < count; ++i)
+		pipelines[i] = VK_NULL_HANDLE;
+
+	//Loaded once and shared by every create info. Culling is the only compute program and comes last
+	VkShaderModule vertexShaders[PIPELINE_PROGRAM_CULL];
+	memset(vertexShaders, 0, sizeof(vertexShaders));
+	VkShaderModule fragmentShader = loadShader(vkData, "frag.spv");
+	bool loaded = fragmentShader != VK_NULL_HANDLE;
+
+	GraphicsPipelineState *states = malloc(count * sizeof(GraphicsPipelineState));
+	VkGraphicsPipelineCreateInfo *infos = malloc(count * sizeof(VkGraphicsPipelineCreateInfo));
+	uint32_t rootCount = 0;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		PipelineProgram program = keys[i].program;
+		if (vertexShaders[program] == VK_NULL_HANDLE)
+			vertexShaders[program] = loadShader(vkData, programShaders[program]);
+		if (vertexShaders[program] == VK_NULL_HANDLE)
+		{
+			loaded = false;
+			break;
+		}
+
+		VkPipelineVertexInputStateCreateInfo *vertexInputInfo = program == PIPELINE_PROGRAM_INSTANCED ?
+				&vkData->instances.vertexInputInfo : &vkData->vertices.vertexInputInfo;
+		initGraphicsPipelineState(vkData, &states[i], vertexShaders[program], fragmentShader, vertexInputInfo,
+				&keys[i]);
+		infos[i] = states[i].info;
+
+		if (parents == NULL)
+			continue;
+
+		if (parents[i] < 0)
+		{
+			infos[i].flags |= VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT;
+			rootCount = i + 1;
+		}
+		else
+		{
+			infos[i].flags |= VK_PIPELINE_CREATE_DERIVATIVE_BIT;
+			//Within one call the parent is named by its index, across calls by its handle once it exists
+			if (mode == PIPELINE_BATCH_SINGLE_CALL)
+				infos[i].basePipelineIndex = parents[i];
+		}
+	}
+
+	bool built = loaded;
+	if (loaded)
+	{
+		VkResult err = createPipelineBatch(vkData, pool, cache, infos, parents, rootCount, count, mode, pipelines);
+		if (err != VK_SUCCESS)
+		{
+			printf("Pipeline creation failed: %d\n", err);
+			built = false;
+		}
+	}
+
+	//A failed call may still have created some of its pipelines
+	if (!built)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			vkDestroyPipeline(vkData->device, pipelines[i], NULL);
+			pipelines[i] = VK_NULL_HANDLE;
+		}
+	}
+
+	free(infos);
+	free(states);
+
+	for (uint32_t i = 0; i < PIPELINE_PROGRAM_CULL; ++i)
+		vkDestroyShaderModule(vkData->device, vertexShaders[i], NULL);
+	vkDestroyShaderModule(vkData->device, fragmentShader, NULL);
+
+	return built;
+}
+
+//PipelineBuildFunction of every registry, the keys alone decide what is built. The graphics variants go to the driver
+//in one call, compute pipelines cannot share it and are built on their own
+static bool buildPipelineVariants(void *userData, const PipelineKey *keys, uint32_t count, VkPipeline *pipelines)
+{
+	VulkanData *vkData = userData;
+
+	PipelineKey *graphicsKeys = malloc(count * sizeof(PipelineKey));
+	VkPipeline *graphicsPipelines = malloc(count * sizeof(VkPipeline));
+	uint32_t graphicsCount = 0;
+	bool built = true;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		pipelines[i] = VK_NULL_HANDLE;
+		if (keys[i].program != PIPELINE_PROGRAM_CULL)
+			graphicsKeys[graphicsCount++] = keys[i];
+		else if (built)
+		{
+			pipelines[i] = createComputePipeline(vkData, programShaders[keys[i].program],
+					vkData->culling.pipelineLayout);
+			built = pipelines[i] != VK_NULL_HANDLE;
+		}
+	}
+
+	if (built && graphicsCount > 0)
+	{
+		//Cold means the driver had nothing to reuse, neither from disk nor from an earlier build in this run
+		const char *cacheState = "cold";
+		if (__atomic_load_n(&vkData->pipelineBuildCount, __ATOMIC_RELAXED) > 0)
+			cacheState = "warm, in memory";
+		else if (vkData->pipelineCache.loadedSize > 0)
+			cacheState = "warm, from disk";
+
+		double start = getTime();
+		built = createPipelineVariants(vkData, NULL, vkData->pipelineCache.cache, graphicsKeys, NULL, graphicsCount,
+				PIPELINE_BATCH_SINGLE_CALL, graphicsPipelines);
+		if (built)
+		{
+			printf("Pipeline creation for %u graphics variants in one call: %.3f ms (%s cache)\n", graphicsCount,
+					1000.0 * (getTime() - start), cacheState);
+			__atomic_fetch_add(&vkData->pipelineBuildCount, graphicsCount, __ATOMIC_RELAXED);
+		}
+	}
+
+	//Back into key order, or the compute pipelines destroyed again if anything failed
+	for (uint32_t i = 0, g = 0; i < count; ++i)
+	{
+		if (keys[i].program != PIPELINE_PROGRAM_CULL)
+			pipelines[i] = built ? graphicsPipelines[g++] : VK_NULL_HANDLE;
+		else if (!built)
+		{
+			vkDestroyPipeline(vkData->device, pipelines[i], NULL);
+			pipelines[i] = VK_NULL_HANDLE;
+		}
+	}
+
+	free(graphicsPipelines);
+	free(graphicsKeys);
+
+	return built;
+}
+
+static PipelineKey getPipelineKey(VulkanData *vkData, PipelineProgram program, DepthPass pass)
+{
+	PipelineKey key;
+	memset(&key, 0, sizeof(key));
+	key.program = program;
+	key.pass = pass;
+
+	if (program != PIPELINE_PROGRAM_CULL)
+		getShaderConstants(vkData, key.constants);
+	if (program != PIPELINE_PROGRAM_VIEWPORT)
+		key.constants[SHADER_CONSTANT_RUNTIME_FEATURES] = 0;
+
+	return key;
+}
+
+static VkPipeline getPipelineVariant(VulkanData *vkData, PipelineRegistry *registry, PipelineProgram program,
+		DepthPass pass)
+{
+	PipelineKey key = getPipelineKey(vkData, program, pass);
+	return getPipeline(registry, &key);
+}
+
+//Reads the mesh constants, depth, draw data, instancing and culling configuration and the shader constants, and
+//builds through the pipeline cache, which Vulkan synchronizes internally. Shader reloads call it from the watch
+//thread while the render loop keeps drawing with the current set. That is only safe because runWindow changes none
+//of that state and builds no pipelines of its own while the watch runs, the benchmarks that do are all over before
+//it starts. Returns false with nothing left in set if any pipeline cannot be built
+static bool buildPipelines(VulkanData *vkData, PipelineSet *set)
+{
+	DepthPass colorPass = vkData->depth.prepass ? DEPTH_PASS_SHADE : DEPTH_PASS_SINGLE;
+	PipelineProgram program = getDrawProgram(vkData);
+	memset(set, 0, sizeof(PipelineSet));
+	initPipelineRegistry(&set->registry, vkData->device, buildPipelineVariants, vkData);
+
+	PipelineKey keys[5];
+	VkPipeline *targets[5];
+	uint32_t count = 0;
+
+	keys[count] = getPipelineKey(vkData, program, colorPass);
+	targets[count++] = &set->pipeline;
+	if (vkData->depth.prepass)
+	{
+		keys[count] = getPipelineKey(vkData, program, DEPTH_PASS_PREPASS);
+		targets[count++] = &set->depthPipeline;
+	}
+
+	if (vkData->instances.enabled)
+	{
+		keys[count] = getPipelineKey(vkData, PIPELINE_PROGRAM_INSTANCED, colorPass);
+		targets[count++] = &set->instancedPipeline;
+	}
+	if (vkData->instances.enabled && vkData->depth.prepass)
+	{
+		keys[count] = getPipelineKey(vkData, PIPELINE_PROGRAM_INSTANCED, DEPTH_PASS_PREPASS);
+		targets[count++] = &set->instancedDepthPipeline;
+	}
+
+	if (vkData->culling.enabled)
+	{
+		keys[count] = getPipelineKey(vkData, PIPELINE_PROGRAM_CULL, DEPTH_PASS_SINGLE);
+		targets[count++] = &set->cullPipeline;
+	}
+
+	//The whole set in one batch, startup and every rebuild pay for one driver call instead of one per pipeline
+	if (!prefetchPipelines(&set->registry, keys, count))
+	{
+		destroyPipelineRegistry(&set->registry);
+		return false;
+	}
+
+	for (uint32_t i = 0; i < count; ++i)
+		*targets[i] = getPipeline(&set->registry, &keys[i]);
+
+	return true;
+}
+
+//Exchanges the pipelines in use with set, which then holds the previous ones
+static void swapPipelines(VulkanData *vkData, PipelineSet *set)
+{
+	PipelineSet current = {
+		.registry = vkData->pipelineRegistry,
+		.pipeline = vkData->pipeline,
+		.depthPipeline = vkData->depth.pipeline,
+		.instancedPipeline = vkData->instances.pipeline,
+		.instancedDepthPipeline = vkData->instances.depthPipeline,
+		.cullPipeline = vkData->culling.pipeline
+	};
+
+	vkData->pipelineRegistry = set->registry;
+	vkData->pipeline = set->pipeline;
+	vkData->depth.pipeline = set->depthPipeline;
+	vkData->instances.pipeline = set->instancedPipeline;
+	vkData->instances.depthPipeline = set->instancedDepthPipeline;
+	vkData->culling.pipeline = set->cullPipeline;
+
+	*set = current;
+}
+
+static void destroyPipelineSet(PipelineSet *set)
+{
+	destroyPipelineRegistry(&set->registry);
+}
+
+void preparePipeline(VulkanData *vkData)
+{
+	PipelineSet set;
+	if (!buildPipelines(vkData, &set))
+		ERR_EXIT("Unable to build the pipelines, were the shaders compiled?\nExiting...\n");
+	swapPipelines(vkData, &set);
+}
+
+void destroyPipelines(VulkanData *vkData)
+{
+	destroyPipelineRegistry(&vkData->pipelineRegistry);
+}
+
+void prepareFramebuffers(VulkanData *vkData)
+{
+	VkImageView attachments[2];
+	attachments[1] = vkData->depth.view;
+
+	VkFramebufferCreateInfo framebufferInfo = {
+		.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.renderPass = vkData->renderPass,
+		.attachmentCount = 2,
+		.pAttachments = attachments,
+		.width = vkData->swapchain.width,
+		.height = vkData->swapchain.height,
+		.layers = 1
+	};
+
+	vkData->swapchain.framebuffers = malloc(vkData->swapchain.imageCount * sizeof(VkFramebuffer));
+
+	for (uint32_t i = 0; i < vkData->swapchain.imageCount; ++i)
+	{
+		attachments[0] = vkData->swapchain.buffers[i].view;
+		VK_CHECK(vkCreateFramebuffer(vkData->device, &framebufferInfo, NULL, &vkData->swapchain.framebuffers[i]));
+	}
+}
+
+typedef struct _RecordArgs {
+	VulkanData *vkData;
+	uint32_t frameSlot;
+	uint32_t imageIndex;
+} RecordArgs;
+
+//Same placement as the draw's viewport would give, as a transform applied in a full screen viewport
+static void getDrawTransform(const SceneDraw *draw, mat4x4 transform)
+{
+	mat4x4 translation;
+	mat4x4_translate(translation, 2.0f * draw->x + draw->width - 1.0f, 2.0f * draw->y + draw->height - 1.0f,
+			draw->minDepth);
+	mat4x4_scale_aniso(transform, translation, draw->width, draw->height, draw->maxDepth - draw->minDepth);
+}
+
+//Fills the slots of draws firstDraw to lastDraw in the frame slot's region, which must not be in flight anymore
+static void writeObjectData(VulkanData *vkData, uint32_t frameSlot, uint32_t firstDraw, uint32_t lastDraw)
+{
+	char *region = (char *) vkData->uniforms.memory.mapped + frameSlot * vkData->uniforms.slotSize;
+
+	for (uint32_t i = firstDraw; i < lastDraw; ++i)
+	{
+		ObjectData *uniforms = (ObjectData *) (region + i * vkData->uniforms.stride);
+		getDrawTransform(&vkData->scene.draws[i], uniforms->transform);
+		uniforms->materialIndex = i % MATERIAL_COUNT;
+	}
+}
+
+//Records draws firstDraw to lastDraw of the scene with the given pipeline into a secondary command buffer
+static void recordSceneSlice(VulkanData *vkData, VkCommandBuffer cmdBuffer, VkPipeline pipeline,
+		uint32_t frameSlot, uint32_t imageIndex, uint32_t firstDraw, uint32_t lastDraw)
+{
+	Scene *scene = &vkData->scene;
+	float width = (float) vkData->swapchain.width;
+	float height = (float) vkData->swapchain.height;
+
+	VkCommandBufferInheritanceInfo inheritanceInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+		.pNext = NULL,
+		.renderPass = vkData->renderPass,
+		.subpass = 0,
+		.framebuffer = vkData->swapchain.framebuffers[imageIndex],
+		.occlusionQueryEnable = VK_FALSE,
+		.queryFlags = 0,
+		.pipelineStatistics = 0
+	};
+
+	VkCommandBufferBeginInfo cmdBufferInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.pNext = NULL,
+		.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		.pInheritanceInfo = &inheritanceInfo
+	};
+
+	VK_CHECK(vkBeginCommandBuffer(cmdBuffer, &cmdBufferInfo));
+
+	//Dynamic state is not inherited from the primary, every secondary sets its own
+	VkRect2D scissor = {
+		.offset = {
+			.x = 0,
+			.y = 0 },
+		.extent = {
+			.width = vkData->swapchain.width,
+			.height = vkData->swapchain.height }
+	};
+
+	vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+
+	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	vkCmdPushConstants(cmdBuffer, vkData->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshConstants),
+			&vkData->vertices.constants);
+
+	//The uber-shader gets at draw time what the specialized variants had baked in
+	if (usesRuntimeFeatures(vkData))
+	{
+		uint32_t constants[PIPELINE_KEY_CONSTANTS];
+		getShaderConstants(vkData, constants);
+		vkCmdPushConstants(cmdBuffer, vkData->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT |
+				VK_SHADER_STAGE_FRAGMENT_BIT, FEATURE_CONSTANTS_OFFSET, FEATURE_CONSTANTS_SIZE, constants);
+	}
+
+	VkDeviceSize offsets[1] = { 0 };
+	vkCmdBindVertexBuffers(cmdBuffer, VERTEX_BUFFER_BIND_ID, 1, &vkData->vertices.buffer, offsets);
+	vkCmdBindIndexBuffer(cmdBuffer, vkData->indices.buffer, 0, vkData->indices.type);
+
+	//Only the viewport path moves the viewport, the others place the draws with their transform
+	if (vkData->drawData != DRAW_DATA_VIEWPORT)
+	{
 		VkViewport viewport = {
 			.x = 0.0f,
 			.y = 0.0f,
-			.height = vkData->height,
-			.width = vkData->width,
+			.height = height,
+			.width = width,
 			.minDepth = 0.0f,
 			.maxDepth = 1.0f
 		};
 
-		vkCmdSetViewport(vkData->buffers.cmdBuffers[i], 0, 1, &viewport);
-
-		VkRect2D scissor = {
-			.offset = {
-				.x = 0,
-				.y = 0 },
-			.extent = {
-				.width = vkData->width,
-				.height = vkData->height }
-		};
+		vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+	}
 
-		vkCmdSetScissor(vkData->buffers.cmdBuffers[i], 0, 1, &scissor);
+	for (uint32_t i = firstDraw; i < lastDraw; ++i)
+	{
+		SceneDraw *draw = &scene->draws[i];
 
-		vkCmdBindPipeline(vkData->buffers.cmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, vkData->pipeline);
+		if (vkData->drawData == DRAW_DATA_VIEWPORT)
+		{
+			VkViewport viewport = {
+				.x = draw->x * width,
+				.y = draw->y * height,
+				.height = draw->height * height,
+				.width = draw->width * width,
+				.minDepth = draw->minDepth,
+				.maxDepth = draw->maxDepth
+			};
+
+			vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+		}
+		else if (vkData->drawData == DRAW_DATA_UNIFORM)
+		{
+			//Rebinding the same set only changes the offset, the set itself is never touched
+			uint32_t offset = frameSlot * vkData->uniforms.slotSize + i * vkData->uniforms.stride;
+			vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vkData->pipelineLayout, 0, 1,
+					&vkData->uniforms.descriptorSet, 1, &offset);
+		}
+		else
+		{
+			//80 bytes recorded into the command buffer, no memory to write or bind
+			ObjectData constants;
+			getDrawTransform(draw, constants.transform);
+			constants.materialIndex = i % MATERIAL_COUNT;
+			vkCmdPushConstants(cmdBuffer, vkData->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, sizeof(MeshConstants),
+					sizeof(ObjectData), &constants);
+		}
 
-		VkDeviceSize offsets[1] = { 0 };
-		vkCmdBindVertexBuffers(vkData->buffers.cmdBuffers[i], VERTEX_BUFFER_BIND_ID, 1, &vkData->vertices.buffer,
-				offsets);
-		vkCmdBindIndexBuffer(vkData->buffers.cmdBuffers[i], vkData->indices.buffer, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdDrawIndexed(vkData->buffers.cmdBuffers[i], vkData->indices.count, 1, 0, 0, 1);
-		vkCmdEndRenderPass(vkData->buffers.cmdBuffers[i]);
-		
-		VK_CHECK(vkEndCommandBuffer(vkData->buffers.cmdBuffers[i]));
+		vkCmdDrawIndexed(cmdBuffer, vkData->indices.count, 1, 0, 0, 1);
 	}
+
+	VK_CHECK(vkEndCommandBuffer(cmdBuffer));
 }
 
+//Records one slice of the scene, jobIndex picks the slice and the pools that own it
+static void recordSecondaryCommandBuffer(void *data, uint32_t jobIndex, uint32_t threadIndex)
+{
+	//Slices are keyed by jobIndex and each job owns its pools, whichever thread runs it
+	(void) threadIndex;
 
-void prepareVK(VulkanData *vkData)
+	RecordArgs *args = data;
+	VulkanData *vkData = args->vkData;
+	Scene *scene = &vkData->scene;
+	RecordThread *recordThread = &vkData->recordThreads[jobIndex];
+
+	uint32_t firstDraw = (uint64_t) scene->drawCount * jobIndex / vkData->threadCount;
+	uint32_t lastDraw = (uint64_t) scene->drawCount * (jobIndex + 1) / vkData->threadCount;
+
+	VK_CHECK(vkResetCommandPool(vkData->device, recordThread->cmdPools[args->frameSlot], 0));
+
+	if (vkData->drawData == DRAW_DATA_UNIFORM)
+		writeObjectData(vkData, args->frameSlot, firstDraw, lastDraw);
+
+	if (vkData->depth.prepass)
+		recordSceneSlice(vkData, recordThread->depthCmdBuffers[args->frameSlot], vkData->depth.pipeline,
+				args->frameSlot, args->imageIndex, firstDraw, lastDraw);
+
+	recordSceneSlice(vkData, recordThread->cmdBuffers[args->frameSlot], vkData->pipeline, args->frameSlot,
+			args->imageIndex, firstDraw, lastDraw);
+}
+
+//Draws every scene entry with one call, the per draw viewports become per instance transforms
+static void recordInstancedDraw(VulkanData *vkData, VkCommandBuffer cmdBuffer, VkPipeline pipeline,
+		uint32_t frameSlot)
 {
-	setupCommandPool(vkData);
-	initSetupCommandBuffer(vkData);
-	
-	setupSwapchain(vkData);
-	createCommandBuffers(vkData);
-	prepareRenderPass(vkData);
-	//createPipelineCache(vkData);
-	prepareFramebuffers(vkData);
-	//prepareDepth(vkData);
-	flushSetupCommandBuffer(vkData);
-	
-	prepareSemaphores(vkData);
-	prepareVertices(vkData);
-	//prepareDescriptorLayout(vkData);
-	preparePipeline(vkData);
-	//prepareDescriptorPool(vkData);
-	//prepareDescriptorSet(vkData);
-	buildCommandBuffers(vkData);
+	VkViewport viewport = {
+		.x = 0.0f,
+		.y = 0.0f,
+		.height = (float) vkData->swapchain.height,
+		.width = (float) vkData->swapchain.width,
+		.minDepth = 0.0f,
+		.maxDepth = 1.0f
+	};
+
+	VkRect2D scissor = {
+		.offset = {
+			.x = 0,
+			.y = 0 },
+		.extent = {
+			.width = vkData->swapchain.width,
+			.height = vkData->swapchain.height }
+	};
+
+	vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
+
+	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	vkCmdPushConstants(cmdBuffer, vkData->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshConstants),
+			&vkData->vertices.constants);
+
+	VkDeviceSize vertexOffsets[1] = { 0 };
+	VkDeviceSize instanceOffsets[1] = { frameSlot * vkData->instances.slotSize };
+	VkBuffer instanceBuffer = vkData->culling.enabled ? vkData->culling.visibleBuffer : vkData->instances.buffer;
+	vkCmdBindVertexBuffers(cmdBuffer, VERTEX_BUFFER_BIND_ID, 1, &vkData->vertices.buffer, vertexOffsets);
+	vkCmdBindVertexBuffers(cmdBuffer, INSTANCE_BUFFER_BIND_ID, 1, &instanceBuffer, instanceOffsets);
+	vkCmdBindIndexBuffer(cmdBuffer, vkData->indices.buffer, 0, vkData->indices.type);
+
+	//The instance count was written by the culling pass, the CPU never learns how many survived
+	if (vkData->culling.enabled)
+		vkCmdDrawIndexedIndirect(cmdBuffer, vkData->culling.commandBuffer,
+				frameSlot * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+	else
+		vkCmdDrawIndexed(cmdBuffer, vkData->indices.count, vkData->scene.drawCount, 0, 0, 0);
 }
 
-void initVK(VulkanData *vkData)
+//Resets the slot's draw command and culls every instance against the clip volume into the visible buffer,
+//the CPU cost is the same few commands no matter how many instances there are
+static void recordCulling(VulkanData *vkData, VkCommandBuffer cmdBuffer, uint32_t frameSlot)
 {
-	//Query for required Vulkan extensions
-	uint32_t requiredExtensionCount;
-	const char** requiredExtensions;
-	vkData->enabledExtensionCount = 0;
-	
-	requiredExtensions = glfwGetRequiredInstanceExtensions(&requiredExtensionCount);
+	VkDeviceSize commandOffset = frameSlot * sizeof(VkDrawIndexedIndirectCommand);
+
+	VkDrawIndexedIndirectCommand command = {
+		.indexCount = vkData->indices.count,
+		.instanceCount = 0,
+		.firstIndex = 0,
+		.vertexOffset = 0,
+		.firstInstance = 0
+	};
 
-	vkData->enabledExtensionCount = requiredExtensionCount;
-	memcpy(vkData->enabledExtensions, requiredExtensions, sizeof(requiredExtensions[0]) * requiredExtensionCount);
+	vkCmdUpdateBuffer(cmdBuffer, vkData->culling.commandBuffer, commandOffset, sizeof(command),
+			(const uint32_t *) &command);
 
-	//Create Vulkan Instance
-	VkApplicationInfo appInfo = {
-		.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+	VkBufferMemoryBarrier resetBarrier = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
 		.pNext = NULL,
-		.pApplicationName = "Vulkan Test",
-		.applicationVersion = 0,
-		.pEngineName = "Test Engine",
-		.engineVersion = 1,
-		.apiVersion = VK_API_VERSION_1_0
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer = vkData->culling.commandBuffer,
+		.offset = commandOffset,
+		.size = sizeof(command)
 	};
-	
-	VkInstanceCreateInfo instanceInfo = {
-		.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL,
+			1, &resetBarrier, 0, NULL);
+
+	//Clip space volume of the Vulkan viewport, x and y in [-1, 1] and z in [0, 1]
+	CullConstants constants = {
+		.planes = {
+			{ 1.0f, 0.0f, 0.0f, 1.0f },
+			{ -1.0f, 0.0f, 0.0f, 1.0f },
+			{ 0.0f, 1.0f, 0.0f, 1.0f },
+			{ 0.0f, -1.0f, 0.0f, 1.0f },
+			{ 0.0f, 0.0f, 1.0f, 0.0f },
+			{ 0.0f, 0.0f, -1.0f, 1.0f }},
+		.firstInstance = frameSlot * vkData->instances.capacity,
+		.instanceCount = vkData->scene.drawCount,
+		.commandIndex = frameSlot,
+		.padding = 0
+	};
+	memcpy(constants.boundingSphere, vkData->vertices.boundingSphere, sizeof(constants.boundingSphere));
+
+	gpuProfilerBegin(&vkData->profiler, cmdBuffer, frameSlot, vkData->culling.profilerRegion);
+
+	vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkData->culling.pipeline);
+	vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkData->culling.pipelineLayout, 0, 1,
+			&vkData->culling.descriptorSet, 0, NULL);
+	vkCmdPushConstants(cmdBuffer, vkData->culling.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+			sizeof(constants), &constants);
+	vkCmdDispatch(cmdBuffer, (vkData->scene.drawCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	gpuProfilerEnd(&vkData->profiler, cmdBuffer, frameSlot, vkData->culling.profilerRegion);
+
+	VkMemoryBarrier cullBarrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
 		.pNext = NULL,
-		.flags = 0,
-		.pApplicationInfo = &appInfo,
-		.enabledLayerCount = 0,
-		.ppEnabledLayerNames = NULL,
-		.enabledExtensionCount = vkData->enabledExtensionCount,
-		.ppEnabledExtensionNames = vkData->enabledExtensions
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT
+	};
+
+	vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &cullBarrier, 0, NULL,
+			0, NULL);
+}
+
+//Rebuilds a frame slot's commands from the scene, the slot must not be in flight anymore
+void recordFrame(VulkanData *vkData, uint32_t frameSlot, uint32_t imageIndex)
+{
+	double start = getTime();
+
+	RecordArgs args = {
+		.vkData = vkData,
+		.frameSlot = frameSlot,
+		.imageIndex = imageIndex
+	};
+
+	//The instanced path is a single draw, not worth spreading over secondaries
+	if (!vkData->instances.enabled)
+		runJobs(&vkData->jobSystem, recordSecondaryCommandBuffer, &args, vkData->threadCount);
+
+	FrameData *frame = &vkData->frames[frameSlot];
+	VK_CHECK(vkResetCommandPool(vkData->device, frame->cmdPool, 0));
+
+	VkCommandBufferBeginInfo cmdBufferInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.pNext = NULL,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		.pInheritanceInfo = NULL
+	};
+
+	VkClearValue clearValues[2] = {
+		[0] = {
+			.color = {
+				.float32[0] = 0.0f,
+				.float32[1] = 0.0f,
+				.float32[2] = 0.0f,
+				.float32[3] = 0.0f }},
+		[1] = {
+			.depthStencil = {
+				.depth = 1.0f,
+				.stencil = 0 }}
+	};
+
+	VkRenderPassBeginInfo renderPassBeginInfo = {
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+		.pNext = NULL,
+		.renderPass = vkData->renderPass,
+		.framebuffer = vkData->swapchain.framebuffers[imageIndex],
+		.renderArea = {
+			.offset = {
+				.x = 0,
+				.y = 0 },
+			.extent = {
+				.width = vkData->swapchain.width,
+				.height = vkData->swapchain.height }},
+		.clearValueCount = 2,
+		.pClearValues = clearValues
 	};
 
-	//Creating Vulkan Instance
-	VK_CHECK(vkCreateInstance(&instanceInfo, NULL, &vkData->instance));
+	//Every thread's pre-pass slice goes before the first color slice, so the whole scene's depth is known
+	//before anything is shaded
+	VkCommandBuffer secondaryCmdBuffers[2 * JOB_SYSTEM_MAX_THREADS];
+	uint32_t secondaryCount = 0;
+	for (uint32_t t = 0; t < vkData->threadCount && vkData->depth.prepass; ++t)
+		secondaryCmdBuffers[secondaryCount++] = vkData->recordThreads[t].depthCmdBuffers[frameSlot];
+	for (uint32_t t = 0; t < vkData->threadCount; ++t)
+		secondaryCmdBuffers[secondaryCount++] = vkData->recordThreads[t].cmdBuffers[frameSlot];
+
+	VK_CHECK(vkBeginCommandBuffer(frame->cmdBuffer, &cmdBufferInfo));
+
+	gpuProfilerReset(&vkData->profiler, frame->cmdBuffer, frameSlot);
+
+	//Dispatches are not allowed inside a render pass
+	if (vkData->culling.enabled)
+		recordCulling(vkData, frame->cmdBuffer, frameSlot);
+
+	gpuProfilerBegin(&vkData->profiler, frame->cmdBuffer, frameSlot, vkData->renderPassRegion);
+
+	if (vkData->instances.enabled)
+	{
+		vkCmdBeginRenderPass(frame->cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		if (vkData->depth.prepass)
+			recordInstancedDraw(vkData, frame->cmdBuffer, vkData->instances.depthPipeline, frameSlot);
+		recordInstancedDraw(vkData, frame->cmdBuffer, vkData->instances.pipeline, frameSlot);
+	}
+	else
+	{
+		vkCmdBeginRenderPass(frame->cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		vkCmdExecuteCommands(frame->cmdBuffer, secondaryCount, secondaryCmdBuffers);
+	}
+
+	vkCmdEndRenderPass(frame->cmdBuffer);
+
+	gpuProfilerEnd(&vkData->profiler, frame->cmdBuffer, frameSlot, vkData->renderPassRegion);
+
+	VK_CHECK(vkEndCommandBuffer(frame->cmdBuffer));
+
+	vkData->recordTime = getTime() - start;
+}
+
+void prepareRecordThreads(VulkanData *vkData)
+{
+	VkCommandPoolCreateInfo cmdPoolCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.pNext = NULL,
+		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		.queueFamilyIndex = vkData->graphicsQueueNodeIndex
+	};
+
+	VkCommandBufferAllocateInfo cmdBufferInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.pNext = NULL,
+		.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+		.commandBufferCount = 1
+	};
+
+	if (vkData->threadCount == 0 || vkData->threadCount > JOB_SYSTEM_MAX_THREADS)
+		ERR_EXIT("Invalid number of recording threads.\nExiting...\n");
+
+	initJobSystem(&vkData->jobSystem, vkData->threadCount);
+
+	for (uint32_t i = 0; i < vkData->threadCount; ++i)
+	{
+		for (uint32_t j = 0; j < MAX_FRAMES_IN_FLIGHT; ++j)
+		{
+			RecordThread *recordThread = &vkData->recordThreads[i];
+			VK_CHECK(vkCreateCommandPool(vkData->device, &cmdPoolCreateInfo, NULL, &recordThread->cmdPools[j]));
+
+			cmdBufferInfo.commandPool = recordThread->cmdPools[j];
+			VK_CHECK(vkAllocateCommandBuffers(vkData->device, &cmdBufferInfo, &recordThread->cmdBuffers[j]));
+			VK_CHECK(vkAllocateCommandBuffers(vkData->device, &cmdBufferInfo, &recordThread->depthCmdBuffers[j]));
+		}
+	}
+}
+
+void destroyRecordThreads(VulkanData *vkData)
+{
+	destroyJobSystem(&vkData->jobSystem);
+
+	for (uint32_t i = 0; i < vkData->threadCount; ++i)
+		for (uint32_t j = 0; j < MAX_FRAMES_IN_FLIGHT; ++j)
+			vkDestroyCommandPool(vkData->device, vkData->recordThreads[i].cmdPools[j], NULL);
+}
+
+//Everything that depends on the swapchain images or their size, rebuilt on every resize
+void prepareSwapchainResources(VulkanData *vkData)
+{
+	prepareDepth(vkData);
+	prepareFramebuffers(vkData);
+	vkData->imageFences = calloc(vkData->swapchain.imageCount, sizeof(VkFence));
+}
+
+void cleanupSwapchainResources(VulkanData *vkData)
+{
+	for (uint32_t i = 0; i < vkData->swapchain.imageCount; ++i)
+		vkDestroyFramebuffer(vkData->device, vkData->swapchain.framebuffers[i], NULL);
+	free(vkData->swapchain.framebuffers);
+	vkData->swapchain.framebuffers = NULL;
+
+	destroyDepth(vkData);
+
+	free(vkData->imageFences);
+	vkData->imageFences = NULL;
+}
+
+void prepareVK(VulkanData *vkData)
+{
+	setupCommandPool(vkData);
+	prepareRecordThreads(vkData);
+	initSetupCommandBuffer(vkData);
+	
+	setupSwapchainBuffers(&vkData->swapchain);
+	selectDepthFormat(vkData);
+	prepareRenderPass(vkData);
+	flushSetupCommandBuffer(vkData);
+	
+	prepareFrames(vkData);
+	prepareVertices(vkData);
+	if (vkData->instances.enabled)
+	{
+		prepareInstances(vkData);
+		if (vkData->culling.enabled)
+			prepareCulling(vkData);
+		for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+			uploadInstances(vkData, i);
+	}
+	prepareDescriptorLayout(vkData);
+	preparePipelineLayout(vkData);
+	preparePipeline(vkData);
+	if (vkData->uniforms.enabled)
+	{
+		prepareUniforms(vkData);
+		prepareDescriptorPool(vkData);
+		prepareDescriptorSet(vkData);
+	}
+	prepareSwapchainResources(vkData);
+}
+
+void initVK(VulkanData *vkData)
+{
+	//Query for required Vulkan extensions
+	uint32_t requiredExtensionCount;
+	const char** requiredExtensions;
+	vkData->enabledExtensionCount = 0;
+
+	//Headless rendering needs no surface extensions at all
+	if (!vkData->swapchain.headless)
+	{
+		requiredExtensions = glfwGetRequiredInstanceExtensions(&requiredExtensionCount);
+
+		vkData->enabledExtensionCount = requiredExtensionCount;
+		memcpy(vkData->enabledExtensions, requiredExtensions,
+				sizeof(requiredExtensions[0]) * requiredExtensionCount);
+	}
+
+	//Create Vulkan Instance
+	VkApplicationInfo appInfo = {
+		.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+		.pNext = NULL,
+		.pApplicationName = "Vulkan Test",
+		.applicationVersion = 0,
+		.pEngineName = "Test Engine",
+		.engineVersion = 1,
+		.apiVersion = VK_API_VERSION_1_0
+	};
+	
+	VkInstanceCreateInfo instanceInfo = {
+		.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.pApplicationInfo = &appInfo,
+		.enabledLayerCount = 0,
+		.ppEnabledLayerNames = NULL,
+		.enabledExtensionCount = vkData->enabledExtensionCount,
+		.ppEnabledExtensionNames = vkData->enabledExtensions
+	};
+
+	//Creating Vulkan Instance
+	VK_CHECK(vkCreateInstance(&instanceInfo, NULL, &vkData->instance));
+
+	//Enumerating physcial devices
+	uint32_t physicalDeviceCount;
+	VK_CHECK(vkEnumeratePhysicalDevices(vkData->instance, &physicalDeviceCount, NULL));
+	if (physicalDeviceCount == 0) ERR_EXIT("No physcial devices were found with Vulkan support.\nExiting...\n");
+
+	printf("Number of physical devices: %u\n", physicalDeviceCount);
+
+	//Selecting the render device
+	VkPhysicalDevice *physicalDevices = malloc(sizeof(VkPhysicalDevice) * physicalDeviceCount);
+	VK_CHECK(vkEnumeratePhysicalDevices(vkData->instance, &physicalDeviceCount, physicalDevices));
+	
+	//Just grabbing the first device present
+	vkData->physicalDevice = physicalDevices[0];
+
+	free(physicalDevices);
+
+	vkGetPhysicalDeviceProperties(vkData->physicalDevice, &vkData->physicalDeviceProps);
+	
+	uint32_t deviceExtensionCount = 0;
+	bool swapchainExtFound = false;
+	vkData->enabledExtensionCount = 0;
+
+	VK_CHECK(vkEnumerateDeviceExtensionProperties(vkData->physicalDevice, NULL, &deviceExtensionCount, NULL));
+
+	if (deviceExtensionCount > 0 && !vkData->swapchain.headless)
+	{
+		VkExtensionProperties *deviceExtensionProps =
+			malloc(deviceExtensionCount * sizeof(VkExtensionProperties));
+		VK_CHECK(vkEnumerateDeviceExtensionProperties(
+					vkData->physicalDevice, NULL, &deviceExtensionCount, deviceExtensionProps));
+
+		for (uint32_t i = 0; i < deviceExtensionCount && !swapchainExtFound; ++i)
+		{
+			if (!strcmp(VK_KHR_SWAPCHAIN_EXTENSION_NAME, deviceExtensionProps[i].extensionName))
+			{
+				swapchainExtFound = true;
+				vkData->enabledExtensions[vkData->enabledExtensionCount++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+			}
+		}
+	}
+
+	//GET_INSTANCE_PROC_ADDR(vkData, GetPhysicalDeviceSurfaceSupportKHR);
+	//GET_INSTANCE_PROC_ADDR(vkData, GetPhysicalDeviceSurfaceCapabilitiesKHR);
+	//GET_INSTANCE_PROC_ADDR(vkData, GetPhysicalDeviceSurfaceFormatsKHR);
+	//GET_INSTANCE_PROC_ADDR(vkData, GetPhysicalDeviceSurfacePresentModesKHR);
+	//GET_INSTANCE_PROC_ADDR(vkData, CreateSwapchainKHR);
+	//GET_INSTANCE_PROC_ADDR(vkData, DestroySwapchainKHR);
+	//GET_INSTANCE_PROC_ADDR(vkData, GetSwapchainImagesKHR);
+	//GET_INSTANCE_PROC_ADDR(vkData, AcquireNextImageKHR);
+	//GET_INSTANCE_PROC_ADDR(vkData, QueuePresentKHR);
+
+	initSwapchainInstance(&vkData->swapchain, vkData->instance, vkData->physicalDevice);
+
+	vkGetPhysicalDeviceQueueFamilyProperties(vkData->physicalDevice, &vkData->queueCount, NULL);
+	if(vkData->queueCount == 0)
+		ERR_EXIT("No device queue was found.\nExiting...\n");
+
+	vkData->queueProps = malloc(vkData->queueCount * sizeof(VkQueueFamilyProperties));
+	vkGetPhysicalDeviceQueueFamilyProperties(vkData->physicalDevice, &vkData->queueCount, vkData->queueProps);
+}
+
+uint32_t getTransferQueueIndex(VulkanData *vkData)
+{
+	//Prefer a dedicated DMA family, then an async compute family, both can run copies next to rendering
+	for (uint32_t i = 0; i < vkData->queueCount; ++i)
+	{
+		VkQueueFlags flags = vkData->queueProps[i].queueFlags;
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+			return i;
+	}
+
+	for (uint32_t i = 0; i < vkData->queueCount; ++i)
+	{
+		VkQueueFlags flags = vkData->queueProps[i].queueFlags;
+		if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+			return i;
+	}
+
+	return vkData->graphicsQueueNodeIndex;
+}
+
+void initDevice(VulkanData *vkData)
+{
+	float queuePriorities[1] = {0.0f};
+
+	VkDeviceQueueCreateInfo queues[2] = {
+		[0] = {
+			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.pNext = NULL,
+			.flags = 0,
+			.queueFamilyIndex = vkData->graphicsQueueNodeIndex,
+			.queueCount = 1,
+			.pQueuePriorities = queuePriorities },
+		[1] = {
+			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.pNext = NULL,
+			.flags = 0,
+			.queueFamilyIndex = vkData->transferQueueNodeIndex,
+			.queueCount = 1,
+			.pQueuePriorities = queuePriorities }
+	};
+
+	VkDeviceCreateInfo device = {
+		.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.queueCreateInfoCount = vkData->transferQueueNodeIndex != vkData->graphicsQueueNodeIndex ? 2 : 1,
+		.pQueueCreateInfos = queues,
+		.enabledLayerCount = 0,
+		.ppEnabledLayerNames = NULL,
+		.enabledExtensionCount = vkData->enabledExtensionCount,
+		.ppEnabledExtensionNames = vkData->enabledExtensions
+	};
+
+	VK_CHECK(vkCreateDevice(vkData->physicalDevice, &device, NULL, &vkData->device));
+
+	//GET_DEVICE_PROC_ADDR(vkData, CreateSwapchainKHR);
+	//GET_DEVICE_PROC_ADDR(vkData, DestroySwapchainKHR);
+	//GET_DEVICE_PROC_ADDR(vkData, GetSwapchainImagesKHR);
+	//GET_DEVICE_PROC_ADDR(vkData, AcquireNextImageKHR);
+	//GET_DEVICE_PROC_ADDR(vkData, QueuePresentKHR);
+}
+
+void initSurface(VulkanData *vkData, GLFWwindow *window)
+{
+	if (!vkData->swapchain.headless)
+		createSurface(&vkData->swapchain, window);
+
+	vkData->graphicsQueueNodeIndex = getSwapchainQueueIndex(&vkData->swapchain);
+	vkData->transferQueueNodeIndex = getTransferQueueIndex(vkData);
+
+	if (vkData->transferQueueNodeIndex != vkData->graphicsQueueNodeIndex)
+		printf("Uploading on separate queue family %u.\n", vkData->transferQueueNodeIndex);
+
+	initDevice(vkData);
+
+	vkGetDeviceQueue(vkData->device, vkData->graphicsQueueNodeIndex, 0, &vkData->queue);
+	vkGetDeviceQueue(vkData->device, vkData->transferQueueNodeIndex, 0, &vkData->transferQueue);
+	initSwapchainDevice(&vkData->swapchain, vkData->device, vkData->queue);
+
+	vkGetPhysicalDeviceMemoryProperties(vkData->physicalDevice, &vkData->memoryProps);
+	initAllocator(&vkData->allocator, vkData->device, vkData->memoryProps, vkData->physicalDeviceProps.limits);
+	initStagingRing(&vkData->staging, vkData->device, &vkData->allocator, vkData->transferQueue,
+			vkData->transferQueueNodeIndex, vkData->queue, vkData->graphicsQueueNodeIndex, STAGING_RING_SIZE);
+
+	initGpuProfiler(&vkData->profiler, vkData->device, vkData->physicalDeviceProps.limits,
+			vkData->queueProps[vkData->graphicsQueueNodeIndex]);
+	vkData->renderPassRegion = addGpuProfilerRegion(&vkData->profiler, "render pass");
+	if (vkData->culling.enabled)
+		vkData->culling.profilerRegion = addGpuProfilerRegion(&vkData->profiler, "culling");
+	setGpuProfilerSlots(&vkData->profiler, MAX_FRAMES_IN_FLIGHT);
+
+	initGpuProfiler(&vkData->uploadProfiler, vkData->device, vkData->physicalDeviceProps.limits,
+			vkData->queueProps[vkData->transferQueueNodeIndex]);
+	addGpuProfilerRegion(&vkData->uploadProfiler, "upload");
+	stagingSetProfiler(&vkData->staging, &vkData->uploadProfiler);
+
+	initPipelineCache(&vkData->pipelineCache, vkData->device, vkData->physicalDeviceProps,
+			vkData->pipelineCachePath);
+}
+
+void cleanupVK(VulkanData *vkData)
+{
+	cleanupSwapchainResources(vkData);
+	destroyRecordThreads(vkData);
+
+	if (vkData->setupCmdBuffer != VK_NULL_HANDLE)
+		vkFreeCommandBuffers(vkData->device, vkData->cmdPool, 1, &vkData->setupCmdBuffer);
+
+	vkDestroyCommandPool(vkData->device, vkData->cmdPool, NULL);
+
+	destroyPipelines(vkData);
+	vkDestroyPipelineLayout(vkData->device, vkData->pipelineLayout, NULL);
+	vkDestroyRenderPass(vkData->device, vkData->renderPass, NULL);
+
+	if (vkData->uniforms.enabled)
+		destroyUniforms(vkData);
+	vkDestroyDescriptorSetLayout(vkData->device, vkData->uniforms.descriptorSetLayout, NULL);
+
+	if (vkData->culling.enabled)
+		destroyCulling(vkData);
+	if (vkData->instances.enabled)
+		destroyInstances(vkData);
+
+	destroyVertices(vkData);
+
+	destroyFrames(vkData);
+
+	destroySwapchainBuffers(&vkData->swapchain);
+}
+
+//The pipeline uses dynamic viewport and scissor, so it and the geometry survive a resize untouched
+void recreateSwapchain(VulkanData *vkData)
+{
+	double start = getTime();
+
+	VK_CHECK(vkDeviceWaitIdle(vkData->device));
+
+	cleanupSwapchainResources(vkData);
+	resizeSwapchain(&vkData->swapchain, vkData->swapchain.width, vkData->swapchain.height);
+	prepareSwapchainResources(vkData);
+
+	vkData->swapchainDirty = false;
+
+	printf("Swapchain recreated at %ux%u in %.3f ms.\n", vkData->swapchain.width, vkData->swapchain.height,
+			1000.0 * (getTime() - start));
+}
+
+void drawVK(VulkanData *vkData)
+{
+	FrameData *frame = &vkData->frames[vkData->currentFrame];
+
+	//Only block when the GPU is still using this frame slot, frameCount frames back
+	VK_CHECK(vkWaitForFences(vkData->device, 1, &frame->fence, VK_TRUE, UINT64_MAX));
+
+	//The slot's last submission is known to be done here, so its timestamps can be read without stalling
+	gpuProfilerCollect(&vkData->profiler, vkData->currentFrame);
+
+	uint32_t imageIndex;
+	VkResult result = acquireNextImage(&vkData->swapchain, UINT64_MAX, frame->presentComplete, &imageIndex);
+
+	//Nothing was acquired and the semaphore stays unsignaled, so the frame is simply skipped
+	if (result == VK_ERROR_OUT_OF_DATE_KHR)
+	{
+		vkData->swapchainDirty = true;
+		vkData->recordTime = 0.0;
+		return;
+	}
+
+	//Still presentable, render this frame and recreate before the next one
+	if (result == VK_SUBOPTIMAL_KHR)
+		vkData->swapchainDirty = true;
+
+	//The image can still be in use by another frame slot if images are acquired out of order
+	if (vkData->imageFences[imageIndex] != VK_NULL_HANDLE && vkData->imageFences[imageIndex] != frame->fence)
+		VK_CHECK(vkWaitForFences(vkData->device, 1, &vkData->imageFences[imageIndex], VK_TRUE, UINT64_MAX));
+	vkData->imageFences[imageIndex] = frame->fence;
+
+	VK_CHECK(vkResetFences(vkData->device, 1, &frame->fence));
+
+	//The slot's region of the instance buffer is free again now that its fence has signaled
+	if (vkData->instances.enabled && vkData->scene.animate)
+		uploadInstances(vkData, vkData->currentFrame);
+
+	recordFrame(vkData, vkData->currentFrame, imageIndex);
+
+	//Take ownership of anything the transfer queue finished uploading before this frame reads it
+	stagingSubmitAcquires(&vkData->staging);
+
+	VkPipelineStageFlags pipelineStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+	VkSubmitInfo submitInfo = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = NULL,
+		.waitSemaphoreCount = 1,
+		.pWaitSemaphores = &frame->presentComplete,
+		.pWaitDstStageMask = &pipelineStages,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &frame->cmdBuffer,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &frame->renderComplete,
+	};
+
+	VK_CHECK(vkQueueSubmit(vkData->queue, 1, &submitInfo, frame->fence));
+	gpuProfilerSubmitted(&vkData->profiler, vkData->currentFrame);
+
+	result = presentQueue(&vkData->swapchain, frame->renderComplete);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+		vkData->swapchainDirty = true;
+
+	vkData->currentFrame = (vkData->currentFrame + 1) % vkData->frameCount;
+}
+
+void prepareStream(VulkanData *vkData, VkDeviceSize size)
+{
+	vkData->stream.size = size;
+	vkData->stream.data = malloc(size);
+	for (VkDeviceSize i = 0; i < size; ++i)
+		((unsigned char *) vkData->stream.data)[i] = (unsigned char) rand();
+
+	VkBufferCreateInfo bufferInfo = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.size = size,
+		.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = 0,
+		.pQueueFamilyIndices = NULL
+	};
+
+	VK_CHECK(vkCreateBuffer(vkData->device, &bufferInfo, NULL, &vkData->stream.buffer));
+	allocateBufferMemory(&vkData->allocator, vkData->stream.buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			&vkData->stream.memory);
+}
+
+void streamUpload(VulkanData *vkData)
+{
+	stagingUpload(&vkData->staging, vkData->stream.buffer, 0, vkData->stream.data, vkData->stream.size);
+	stagingFlush(&vkData->staging);
+}
+
+void destroyStream(VulkanData *vkData)
+{
+	if (vkData->stream.size == 0)
+		return;
+
+	vkDestroyBuffer(vkData->device, vkData->stream.buffer, NULL);
+	freeMemory(&vkData->allocator, &vkData->stream.memory);
+	free(vkData->stream.data);
+	vkData->stream.size = 0;
+}
+
+void setFramesInFlight(VulkanData *vkData, uint32_t frameCount)
+{
+	VK_CHECK(vkDeviceWaitIdle(vkData->device));
+
+	destroyFrames(vkData);
+	vkData->frameCount = frameCount;
+	prepareFrames(vkData);
+
+	//The old frame fences are gone, and after the idle wait no image is in use anyway
+	memset(vkData->imageFences, 0, vkData->swapchain.imageCount * sizeof(VkFence));
+}
+
+void setRecordThreadCount(VulkanData *vkData, uint32_t threadCount)
+{
+	VK_CHECK(vkDeviceWaitIdle(vkData->device));
+
+	destroyRecordThreads(vkData);
+
+	vkData->threadCount = threadCount;
+	prepareRecordThreads(vkData);
+}
+
+//Records the scene with 1, 2, 4... threads up to the core count and reports the best time of each, the device
+//is idle so frame slot 0 is free to be recorded over and over
+void sweepRecordThreads(VulkanData *vkData)
+{
+	const uint32_t repeats = 5;
+	uint32_t originalCount = vkData->threadCount;
+	uint32_t coreCount = getCoreCount();
+
+	printf("Recording %u draws per frame\n", vkData->scene.drawCount);
+	printf("Threads | record time (ms) | Mdraws/s | speedup\n");
+
+	double baseTime = 0.0;
+	for (uint32_t threads = 1; threads <= coreCount; threads *= 2)
+	{
+		setRecordThreadCount(vkData, threads);
+
+		double bestTime = 0.0;
+		for (uint32_t i = 0; i < repeats; ++i)
+		{
+			recordFrame(vkData, 0, 0);
+			if (i == 0 || vkData->recordTime < bestTime)
+				bestTime = vkData->recordTime;
+		}
+
+		if (threads == 1)
+			baseTime = bestTime;
+
+		printf("%7u | %16.3f | %8.2f | %.2fx\n", threads, 1000.0 * bestTime,
+				vkData->scene.drawCount / bestTime / 1000000.0, baseTime / bestTime);
+	}
+
+	setRecordThreadCount(vkData, originalCount);
+}
+
+//Draws frames back to back outside of the main loop for a benchmark, returns the frame count and fills in the
+//frame rate and the total recording time
+static uint32_t renderFor(VulkanData *vkData, double seconds, double *fps, double *recordTime)
+{
+	double start = getTime();
+	double time = start;
+	uint32_t frames = 0;
+	*recordTime = 0.0;
+
+	while (time - start < seconds)
+	{
+		if (vkData->swapchainDirty && vkData->swapchain.width > 0 && vkData->swapchain.height > 0)
+			recreateSwapchain(vkData);
+
+		if (vkData->scene.animate)
+			updateScene(&vkData->scene, time);
+		drawVK(vkData);
+		*recordTime += vkData->recordTime;
+
+		time = getTime();
+		frames++;
+	}
+
+	*fps = frames / (time - start);
+	return frames;
+}
+
+//Reloads the mesh in the float or the packed layout and rebuilds the pipelines that depend on its vertex format
+static void reloadVertices(VulkanData *vkData, bool pack)
+{
+	VK_CHECK(vkDeviceWaitIdle(vkData->device));
+
+	destroyPipelines(vkData);
+	destroyVertices(vkData);
+
+	vkData->vertices.pack = pack;
+	prepareVertices(vkData);
+	if (vkData->instances.enabled)
+		prepareInstanceLayout(vkData);
+	preparePipeline(vkData);
+
+	stagingWaitIdle(&vkData->staging);
+}
+
+//Swaps the scene for one of drawCount draws, or of drawCount full screen layers, for a benchmark and uploads its
+//instances when the instanced path is in use
+static void setBenchmarkScene(VulkanData *vkData, uint32_t drawCount, bool animate, bool layered)
+{
+	VK_CHECK(vkDeviceWaitIdle(vkData->device));
+
+	destroyScene(&vkData->scene);
+	if (layered)
+		initLayeredScene(&vkData->scene, drawCount);
+	else
+		initScene(&vkData->scene, drawCount, animate);
+
+	if (vkData->instances.enabled)
+	{
+		for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+			uploadInstances(vkData, i);
+		stagingWaitIdle(&vkData->staging);
+	}
+}
+
+//Brings back the scene the benchmark started with and drops the timings it left behind
+static void restoreScene(VulkanData *vkData, uint32_t drawCount, bool animate)
+{
+	setBenchmarkScene(vkData, drawCount, animate, false);
+	resetGpuProfilerTimes(&vkData->profiler);
+}
+
+//Renders the scene from float and from packed vertices for a while each and compares their size and GPU time, only
+//meshes stored as floats can be shown both ways
+void benchmarkVertexFormats(VulkanData *vkData)
+{
+	bool originalPack = vkData->vertices.pack;
+
+	printf("Vertex layout | bytes/vertex | vertex data (MiB) | frames/s | GPU time (ms) | Mverts/s (GPU time)\n");
+
+	for (uint32_t pack = 0; pack < 2; ++pack)
+	{
+		reloadVertices(vkData, pack);
+		if (vkData->vertices.packed != (bool) pack)
+		{
+			printf("The mesh is stored packed, there is no float layout to compare against.\n");
+			break;
+		}
+
+		resetGpuProfilerTimes(&vkData->profiler);
+
+		double recordTime;
+		double fps;
+		renderFor(vkData, VERTEX_BENCH_SECONDS, &fps, &recordTime);
+
+		double gpuTime = getGpuProfilerTime(&vkData->profiler, vkData->renderPassRegion);
+		double vertices = (double) vkData->scene.drawCount * vkData->indices.count;
+
+		printf("%13s | %12u | %17.2f | %8.1f | %13.3f | ", pack ? "packed" : "float",
+				vkData->vertices.vertexInputBindings[0].stride, vkData->vertices.size / (1024.0 * 1024.0), fps,
+				gpuTime);
+		if (gpuTime > 0.0)
+			printf("%.2f\n", vertices / gpuTime / 1000.0);
+		else
+			printf("n/a\n");
+	}
+
+	if (vkData->vertices.pack != originalPack)
+		reloadVertices(vkData, originalPack);
+
+	resetGpuProfilerTimes(&vkData->profiler);
+}
+
+//Switches between depth tested shading and a depth pre-pass, which need different pipelines
+static void setDepthPrepass(VulkanData *vkData, bool prepass)
+{
+	VK_CHECK(vkDeviceWaitIdle(vkData->device));
+
+	destroyPipelines(vkData);
+	vkData->depth.prepass = prepass;
+	preparePipeline(vkData);
+}
+
+//Renders a stack of full screen layers drawn back to front, where the depth test alone rejects nothing, once
+//without and once with a depth pre-pass and compares their GPU time. The layers are told apart by their viewport
+//depth range, so this needs the per draw path
+void benchmarkDepthPrepass(VulkanData *vkData)
+{
+	if (vkData->instances.enabled)
+	{
+		printf("The depth benchmark needs per draw viewports, it cannot run with --instanced, --instance-sweep or "
+				"--gpu-cull.\n");
+		return;
+	}
+
+	bool originalPrepass = vkData->depth.prepass;
+	uint32_t originalCount = vkData->scene.drawCount;
+	bool animate = vkData->scene.animate;
 
-	//Enumerating physcial devices
-	uint32_t physicalDeviceCount;
-	VK_CHECK(vkEnumeratePhysicalDevices(vkData->instance, &physicalDeviceCount, NULL));
-	if (physicalDeviceCount == 0) ERR_EXIT("No physcial devices were found with Vulkan support.\nExiting...\n");
+	setBenchmarkScene(vkData, DEPTH_BENCH_LAYERS, false, true);
 
-	printf("Number of physical devices: %u\n", physicalDeviceCount);
+	printf("%u full screen layers drawn back to front\n", DEPTH_BENCH_LAYERS);
+	printf("Depth mode | frames/s | GPU time (ms) | speedup\n");
 
-	//Selecting the render device
-	VkPhysicalDevice *physicalDevices = malloc(sizeof(VkPhysicalDevice) * physicalDeviceCount);
-	VK_CHECK(vkEnumeratePhysicalDevices(vkData->instance, &physicalDeviceCount, physicalDevices));
-	
-	//Just grabbing the first device present
-	vkData->physicalDevice = physicalDevices[0];
+	double baseTime = 0.0;
+	for (uint32_t prepass = 0; prepass < 2; ++prepass)
+	{
+		setDepthPrepass(vkData, prepass);
+		resetGpuProfilerTimes(&vkData->profiler);
+
+		double recordTime;
+		double fps;
+		renderFor(vkData, DEPTH_BENCH_SECONDS, &fps, &recordTime);
+
+		double gpuTime = getGpuProfilerTime(&vkData->profiler, vkData->renderPassRegion);
+		if (!prepass)
+			baseTime = gpuTime;
+
+		printf("%10s | %8.1f | %13.3f | ", prepass ? "pre-pass" : "test only", fps, gpuTime);
+		if (gpuTime > 0.0)
+			printf("%.2fx\n", baseTime / gpuTime);
+		else
+			printf("n/a\n");
+	}
 
-	free(physicalDevices);
+	setDepthPrepass(vkData, originalPrepass);
+	restoreScene(vkData, originalCount, animate);
+}
 
-	vkGetPhysicalDeviceProperties(vkData->physicalDevice, &vkData->physicalDeviceProps);
-	
-	uint32_t deviceExtensionCount = 0;
-	bool swapchainExtFound = false;
-	vkData->enabledExtensionCount = 0;
+//The per draw paths need different vertex shaders, so the pipelines are rebuilt
+static void setDrawDataPath(VulkanData *vkData, DrawDataPath path)
+{
+	VK_CHECK(vkDeviceWaitIdle(vkData->device));
 
-	VK_CHECK(vkEnumerateDeviceExtensionProperties(vkData->physicalDevice, NULL, &deviceExtensionCount, NULL));
+	destroyPipelines(vkData);
+	vkData->drawData = path;
+	preparePipeline(vkData);
+}
 
-	if (deviceExtensionCount > 0)
+//Renders 10k, 100k and 1M draws per frame, with the per draw data as push constants, as dynamic uniform buffer
+//offsets and as instance buffer entries of one instanced draw, and compares CPU recording and GPU time. The
+//instance and uniform resources exist throughout, only the path recordFrame takes is switched. Those the run does
+//not use itself are created here and destroyed again afterwards. GPU culling is off for the whole benchmark, none of
+//the paths should pay for it
+void benchmarkDrawData(VulkanData *vkData)
+{
+	static const uint32_t drawCounts[3] = { 10000, 100000, DRAW_BENCH_MAX };
+	static const char *pathNames[3] = { "push constants", "uniform offsets", "instance buffer" };
+
+	uint32_t originalCount = vkData->scene.drawCount;
+	bool animate = vkData->scene.animate;
+	DrawDataPath originalPath = vkData->drawData;
+	bool instanced = vkData->instances.enabled;
+	bool uniforms = vkData->uniforms.enabled;
+	bool culling = vkData->culling.enabled;
+	uint32_t instanceCapacity = vkData->instances.capacity;
+	uint32_t uniformCapacity = vkData->uniforms.capacity;
+
+	VK_CHECK(vkDeviceWaitIdle(vkData->device));
+	if (!instanced)
 	{
-		VkExtensionProperties *deviceExtensionProps =
-			malloc(deviceExtensionCount * sizeof(VkExtensionProperties));
-		VK_CHECK(vkEnumerateDeviceExtensionProperties(
-					vkData->physicalDevice, NULL, &deviceExtensionCount, deviceExtensionProps));
+		vkData->instances.capacity = DRAW_BENCH_MAX;
+		prepareInstances(vkData);
+		vkData->instances.enabled = true;
+	}
+	if (!uniforms)
+	{
+		vkData->uniforms.capacity = DRAW_BENCH_MAX;
+		prepareUniforms(vkData);
+		prepareDescriptorPool(vkData);
+		prepareDescriptorSet(vkData);
+		vkData->uniforms.enabled = true;
+	}
+	//The culling resources stay, the first setDrawDataPath drops the cull pipeline
+	vkData->culling.enabled = false;
 
-		for (uint32_t i = 0; i < deviceExtensionCount && !swapchainExtFound; ++i)
+	printf("Draws per frame on %u recording threads\n", vkData->threadCount);
+	printf("  Draws | per draw data   | frames/s | record (ms) | GPU time (ms)\n");
+
+	for (uint32_t c = 0; c < 3; ++c)
+	{
+		setBenchmarkScene(vkData, drawCounts[c], animate, false);
+
+		for (uint32_t path = 0; path < 3; ++path)
 		{
-			if (!strcmp(VK_KHR_SWAPCHAIN_EXTENSION_NAME, deviceExtensionProps[i].extensionName))
-			{
-				swapchainExtFound = true;
-				vkData->enabledExtensions[vkData->enabledExtensionCount++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
-			}
+			bool instancedPath = path == 2;
+			if (!instancedPath)
+				setDrawDataPath(vkData, path == 0 ? DRAW_DATA_PUSH : DRAW_DATA_UNIFORM);
+
+			resetGpuProfilerTimes(&vkData->profiler);
+
+			vkData->instances.enabled = instancedPath;
+			double recordTime;
+			double fps;
+			uint32_t frames = renderFor(vkData, DRAW_BENCH_SECONDS, &fps, &recordTime);
+			vkData->instances.enabled = true;
+
+			printf("%7u | %-15s | %8.1f | %11.3f | %.3f\n", drawCounts[c], pathNames[path], fps,
+					1000.0 * recordTime / frames, getGpuProfilerTime(&vkData->profiler, vkData->renderPassRegion));
 		}
 	}
 
-	//GET_INSTANCE_PROC_ADDR(vkData, GetPhysicalDeviceSurfaceSupportKHR);
-	//GET_INSTANCE_PROC_ADDR(vkData, GetPhysicalDeviceSurfaceCapabilitiesKHR);
-	//GET_INSTANCE_PROC_ADDR(vkData, GetPhysicalDeviceSurfaceFormatsKHR);
-	//GET_INSTANCE_PROC_ADDR(vkData, GetPhysicalDeviceSurfacePresentModesKHR);
-	//GET_INSTANCE_PROC_ADDR(vkData, CreateSwapchainKHR);
-	//GET_INSTANCE_PROC_ADDR(vkData, DestroySwapchainKHR);
-	//GET_INSTANCE_PROC_ADDR(vkData, GetSwapchainImagesKHR);
-	//GET_INSTANCE_PROC_ADDR(vkData, AcquireNextImageKHR);
-	//GET_INSTANCE_PROC_ADDR(vkData, QueuePresentKHR);
-
-	vkGetPhysicalDeviceQueueFamilyProperties(vkData->physicalDevice, &vkData->queueCount, NULL);
-	if(vkData->queueCount == 0)
-		ERR_EXIT("No device queue was found.\nExiting...\n");
+	VK_CHECK(vkDeviceWaitIdle(vkData->device));
+	if (!instanced)
+	{
+		destroyInstances(vkData);
+		vkData->instances.enabled = false;
+		vkData->instances.capacity = instanceCapacity;
+	}
+	if (!uniforms)
+	{
+		destroyUniforms(vkData);
+		vkData->uniforms.enabled = false;
+		vkData->uniforms.capacity = uniformCapacity;
+	}
+	vkData->culling.enabled = culling;
 
-	vkData->queueProps = malloc(vkData->queueCount * sizeof(VkQueueFamilyProperties));
-	vkGetPhysicalDeviceQueueFamilyProperties(vkData->physicalDevice, &vkData->queueCount, vkData->queueProps);
+	//Rebuilt after the flags are back, so the instanced pipelines only exist if the run uses them
+	setDrawDataPath(vkData, originalPath);
+	restoreScene(vkData, originalCount, animate);
 }
 
-void initDevice(VulkanData *vkData)
+//Points the scene pipelines at the variant for constants. The previous variants stay in the registry, so switching
+//back is a lookup
+static void setShaderConstants(VulkanData *vkData, const uint32_t constants[PIPELINE_KEY_CONSTANTS])
 {
-	float queuePriorities[1] = {0.0f};
+	//Nothing is destroyed, waiting only keeps the frames in flight out of the next measurement
+	VK_CHECK(vkDeviceWaitIdle(vkData->device));
 
-	VkDeviceQueueCreateInfo queue = {
-		.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.queueFamilyIndex = vkData->graphicsQueueNodeIndex,
-		.queueCount = 1,
-		.pQueuePriorities = queuePriorities
-	};
+	memcpy(vkData->shaderConstants, constants, sizeof(vkData->shaderConstants));
 
-	VkDeviceCreateInfo device = {
-		.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.queueCreateInfoCount = 1,
-		.pQueueCreateInfos = &queue,
-		.enabledLayerCount = 0,
-		.ppEnabledLayerNames = NULL,
-		.enabledExtensionCount = vkData->enabledExtensionCount,
-		.ppEnabledExtensionNames = vkData->enabledExtensions
-	};
+	DepthPass colorPass = vkData->depth.prepass ? DEPTH_PASS_SHADE : DEPTH_PASS_SINGLE;
+	PipelineProgram program = getDrawProgram(vkData);
+	PipelineRegistry *registry = &vkData->pipelineRegistry;
 
-	VK_CHECK(vkCreateDevice(vkData->physicalDevice, &device, NULL, &vkData->device));
+	vkData->pipeline = getPipelineVariant(vkData, registry, program, colorPass);
+	bool built = vkData->pipeline != VK_NULL_HANDLE;
+	if (vkData->depth.prepass)
+	{
+		vkData->depth.pipeline = getPipelineVariant(vkData, registry, program, DEPTH_PASS_PREPASS);
+		built = built && vkData->depth.pipeline != VK_NULL_HANDLE;
+	}
 
-	//GET_DEVICE_PROC_ADDR(vkData, CreateSwapchainKHR);
-	//GET_DEVICE_PROC_ADDR(vkData, DestroySwapchainKHR);
-	//GET_DEVICE_PROC_ADDR(vkData, GetSwapchainImagesKHR);
-	//GET_DEVICE_PROC_ADDR(vkData, AcquireNextImageKHR);
-	//GET_DEVICE_PROC_ADDR(vkData, QueuePresentKHR);
+	if (vkData->instances.enabled)
+	{
+		vkData->instances.pipeline = getPipelineVariant(vkData, registry, PIPELINE_PROGRAM_INSTANCED, colorPass);
+		built = built && vkData->instances.pipeline != VK_NULL_HANDLE;
+	}
+	if (vkData->instances.enabled && vkData->depth.prepass)
+	{
+		vkData->instances.depthPipeline = getPipelineVariant(vkData, registry, PIPELINE_PROGRAM_INSTANCED,
+				DEPTH_PASS_PREPASS);
+		built = built && vkData->instances.depthPipeline != VK_NULL_HANDLE;
+	}
+
+	if (!built)
+		ERR_EXIT("Unable to build a shader variant.\nExiting...\n");
 }
 
-void initSurface(VulkanData *vkData, GLFWwindow *window)
+//Renders full screen layers with a few feature combinations, each once with a variant specialized for them and
+//once with the uber-shader branching on the same values pushed at draw time, and compares GPU time. Only
+//simple.vert and simple.frag have the uber-shader path, so this needs the per draw viewport path
+void benchmarkShaderVariants(VulkanData *vkData)
 {
-	glfwCreateWindowSurface(vkData->instance, window, NULL, &vkData->surface);
-	
-	VkBool32 *supportsPresent = malloc(vkData->queueCount * sizeof(VkBool32));
-	for (uint32_t i = 0; i < vkData->queueCount; ++i)
-		vkData->fpGetPhysicalDeviceSurfaceSupportKHR(
-				vkData->physicalDevice, i, vkData->surface, &supportsPresent[i]);
+	if (vkData->instances.enabled || vkData->drawData != DRAW_DATA_VIEWPORT)
+	{
+		printf("The variant benchmark needs the per draw viewport path, it cannot run with --instanced, "
+				"--instance-sweep, --gpu-cull or --draw-data uniform|push.\n");
+		return;
+	}
+
+	static const struct {
+		const char *name;
+		uint32_t vertexColor;
+		uint32_t detailOctaves;
+	} features[4] = {
+		{ "vertex color", 1, 0 },
+		{ "constant color", 0, 0 },
+		{ "4 detail octaves", 1, 4 },
+		{ "8 detail octaves", 1, 8 }
+	};
+
+	uint32_t originalConstants[PIPELINE_KEY_CONSTANTS];
+	memcpy(originalConstants, vkData->shaderConstants, sizeof(originalConstants));
+	uint32_t originalCount = vkData->scene.drawCount;
+	bool animate = vkData->scene.animate;
 
-	uint32_t graphicsQueueNodeIndex = UINT32_MAX;
-	uint32_t presentQueueNodeIndex = UINT32_MAX;
+	setBenchmarkScene(vkData, VARIANT_BENCH_LAYERS, false, true);
 
-	for (uint32_t i = 0; i < vkData->queueCount && !foundQueue; ++i)
+	printf("%u full screen layers\n", VARIANT_BENCH_LAYERS);
+	printf("Features         | specialized (ms) | uber-shader (ms) | uber-shader cost\n");
+
+	for (uint32_t f = 0; f < 4; ++f)
 	{
-		if ((vkData->queueProps[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0)
+		double gpuTimes[2];
+		for (uint32_t runtime = 0; runtime < 2; ++runtime)
 		{
-			if (graphicsQueueNodeIndex == UINT32_MAX)
-				graphicsQueueNodeIndex = i;
-
-			if (supportsPresent[i] == VK_TRUE)
-			{
-				graphicsQueueNodeIndex = i;
-				presentQueueNodeIndex = i;
-				foundQueue = true;
-			}
+			uint32_t constants[PIPELINE_KEY_CONSTANTS] = { 0 };
+			constants[SHADER_CONSTANT_VERTEX_COLOR] = features[f].vertexColor;
+			constants[SHADER_CONSTANT_DETAIL_OCTAVES] = features[f].detailOctaves;
+			constants[SHADER_CONSTANT_RUNTIME_FEATURES] = runtime;
+			setShaderConstants(vkData, constants);
+			resetGpuProfilerTimes(&vkData->profiler);
+
+			double recordTime;
+			double fps;
+			renderFor(vkData, VARIANT_BENCH_SECONDS, &fps, &recordTime);
+			gpuTimes[runtime] = getGpuProfilerTime(&vkData->profiler, vkData->renderPassRegion);
 		}
+
+		printf("%-16s | %16.3f | %16.3f | ", features[f].name, gpuTimes[0], gpuTimes[1]);
+		if (gpuTimes[0] > 0.0)
+			printf("%+.1f%%\n", 100.0 * (gpuTimes[1] / gpuTimes[0] - 1.0));
+		else
+			printf("n/a\n");
 	}
 
-	if (presentQueueNodeIndex == UINT32_MAX)
+	setShaderConstants(vkData, originalConstants);
+	printPipelineRegistryStats(&vkData->pipelineRegistry);
+	restoreScene(vkData, originalCount, animate);
+}
+
+//Builds WARMUP_BENCH_VARIANTS distinct variants one call at a time, in a single call and spread over a compile pool
+//with a thread per CPU, each with and without derivatives and from an empty pipeline cache. The last run repeats the
+//parallel build with the cache the run before it filled
+void benchmarkPipelineWarmup(VulkanData *vkData)
+{
+	static const PipelineProgram programs[3] = {
+		PIPELINE_PROGRAM_VIEWPORT,
+		PIPELINE_PROGRAM_UNIFORM,
+		PIPELINE_PROGRAM_PUSH
+	};
+	static const DepthPass passes[2] = { DEPTH_PASS_SINGLE, DEPTH_PASS_SHADE };
+	const uint32_t groupCount = 3 * 2;
+
+	static const struct {
+		const char *name;
+		PipelineBatchMode mode;
+		bool derivatives;
+		bool warm;
+	} runs[7] = {
+		{ "serial", PIPELINE_BATCH_SERIAL, false, false },
+		{ "serial, derivatives", PIPELINE_BATCH_SERIAL, true, false },
+		{ "one call", PIPELINE_BATCH_SINGLE_CALL, false, false },
+		{ "one call, derivatives", PIPELINE_BATCH_SINGLE_CALL, true, false },
+		{ "compile pool", PIPELINE_BATCH_PARALLEL, false, false },
+		{ "compile pool, derivatives", PIPELINE_BATCH_PARALLEL, true, false },
+		{ "compile pool, warm cache", PIPELINE_BATCH_PARALLEL, true, true }
+	};
+
+	uint32_t threadCount = getCoreCount();
+
+	JobSystem pool;
+	initJobSystem(&pool, threadCount);
+
+	//Every combination of program and color pass is a root, its specializations derive from it
+	uint32_t count = WARMUP_BENCH_VARIANTS;
+	PipelineKey *keys = calloc(count, sizeof(PipelineKey));
+	int32_t *parents = malloc(count * sizeof(int32_t));
+	VkPipeline *pipelines = malloc(count * sizeof(VkPipeline));
+
+	for (uint32_t i = 0; i < count; ++i)
 	{
-		for (uint32_t i = 0; i < vkData->queueCount; ++i)
-		{
-			if (supportsPresent[i] == VK_TRUE)
-			{
-				presentQueueNodeIndex = i;
-				break;
-			}
-		}
+		uint32_t group = i % groupCount;
+		uint32_t variant = i / groupCount;
+
+		keys[i].program = programs[group % 3];
+		keys[i].pass = passes[group / 3];
+		keys[i].constants[SHADER_CONSTANT_DEQUANTIZE] = variant % 2;
+		keys[i].constants[SHADER_CONSTANT_VERTEX_COLOR] = variant / 2 % 2;
+		keys[i].constants[SHADER_CONSTANT_DETAIL_OCTAVES] = variant / 4;
+		parents[i] = i < groupCount ? -1 : (int32_t) group;
 	}
 
-	free(supportsPresent);
+	VkPipelineCacheCreateInfo cacheInfo = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.initialDataSize = 0,
+		.pInitialData = NULL
+	};
+
+	printf("%u pipeline variants, compile pool of %u threads\n", count, threadCount);
+	printf("Mode                      | warm-up (ms) | per pipeline (ms) | speedup\n");
 
-	if (graphicsQueueNodeIndex == UINT32_MAX || presentQueueNodeIndex == UINT32_MAX)
-		ERR_EXIT("Could not find graphics and present queues.\nExiting...\n");
-	//Possible to use separate queues for graphics and present, but this implementation doesn't incude that
-	if (graphicsQueueNodeIndex != presentQueueNodeIndex)
-		ERR_EXIT("Could not find a common graphics and present queue.\nExiting...\n");
+	VkPipelineCache cache = VK_NULL_HANDLE;
+	double serialTime = 0.0;
+	for (uint32_t r = 0; r < 7; ++r)
+	{
+		//The driver may keep a shader cache of its own on disk, which no empty pipeline cache can hide
+		if (!runs[r].warm)
+		{
+			if (cache != VK_NULL_HANDLE)
+				vkDestroyPipelineCache(vkData->device, cache, NULL);
+			VK_CHECK(vkCreatePipelineCache(vkData->device, &cacheInfo, NULL, &cache));
+		}
 
-	vkData->graphicsQueueNodeIndex = graphicsQueueNodeIndex;
+		double start = getTime();
+		if (!createPipelineVariants(vkData, &pool, cache, keys, runs[r].derivatives ? parents : NULL, count,
+				runs[r].mode, pipelines))
+			ERR_EXIT("Unable to build the warm-up variants.\nExiting...\n");
+		double elapsed = getTime() - start;
 
-	initDevice(vkData);
+		if (r == 0)
+			serialTime = elapsed;
 
-	vkGetDeviceQueue(vkData->device, vkData->graphicsQueueNodeIndex, 0, &vkData->queue);
+		printf("%-25s | %12.1f | %17.3f | %.2fx\n", runs[r].name, 1000.0 * elapsed, 1000.0 * elapsed / count,
+				serialTime / elapsed);
 
-	uint32_t formatCount;
-	VK_CHECK(vkData->fpGetPhysicalDeviceSurfaceFormatsKHR(
-				vkData->physicalDevice, vkData->surface, &formatCount, NULL));
-	if (formatCount == 0)
-		ERR_EXIT("No surface formats were found.\nExiting...\n");
+		for (uint32_t i = 0; i < count; ++i)
+			vkDestroyPipeline(vkData->device, pipelines[i], NULL);
+	}
 
-	VkSurfaceFormatKHR *surfaceFormats = malloc(formatCount * sizeof(VkSurfaceFormatKHR));
-	VK_CHECK(vkData->fpGetPhysicalDeviceSurfaceFormatsKHR(
-				vkData->physicalDevice, vkData->surface, &formatCount, surfaceFormats));
+	vkDestroyPipelineCache(vkData->device, cache, NULL);
 
-	if (formatCount == 1 && surfaceFormats[0].format == VK_FORMAT_UNDEFINED)
-		vkData->format = VK_FORMAT_B8G8R8A8_UNORM;
-	else
-		vkData->format = surfaceFormats[0].format;
+	free(pipelines);
+	free(parents);
+	free(keys);
+	destroyJobSystem(&pool);
+}
 
-	vkData->colorSpace = surfaceFormats[0].colorSpace;
+//Renders the instanced scene at 1, 10, 100... instances for a while each and reports the vertex throughput,
+//both from the frame rate and from the GPU time of the render pass alone. With GPU culling the CPU recording
+//time and the culling pass are reported too
+void sweepInstances(VulkanData *vkData)
+{
+	uint32_t originalCount = vkData->scene.drawCount;
+	bool animate = vkData->scene.animate;
 
-	free(surfaceFormats);
+	printf("Instanced draw of %u indices per instance\n", vkData->indices.count);
+	printf("Instances | frames/s | record (ms) | cull (ms) | GPU time (ms) | Mverts/s (frame rate) | "
+			"Mverts/s (GPU time)\n");
 
-	vkGetPhysicalDeviceMemoryProperties(vkData->physicalDevice, &vkData->memoryProps);
+	for (uint32_t count = 1; count <= vkData->instances.capacity; count *= 10)
+	{
+		setBenchmarkScene(vkData, count, animate, false);
+		resetGpuProfilerTimes(&vkData->profiler);
+
+		double recordTime;
+		double fps;
+		uint32_t frames = renderFor(vkData, INSTANCE_SWEEP_SECONDS, &fps, &recordTime);
+		double gpuTime = getGpuProfilerTime(&vkData->profiler, vkData->renderPassRegion);
+		double cullTime = vkData->culling.enabled ?
+				getGpuProfilerTime(&vkData->profiler, vkData->culling.profilerRegion) : 0.0;
+		double vertices = (double) count * vkData->indices.count;
+
+		printf("%9u | %8.1f | %11.3f | %9.3f | %13.3f | %21.2f | ", count, fps, 1000.0 * recordTime / frames,
+				cullTime, gpuTime, vertices * fps / 1000000.0);
+		if (gpuTime > 0.0)
+			printf("%.2f\n", vertices / gpuTime / 1000.0);
+		else
+			printf("n/a\n");
+	}
+
+	restoreScene(vkData, originalCount, animate);
 }
 
-void destroySwapchain(VulkanData *vkData)
+static bool parseDrawDataPath(const char *name, DrawDataPath *path)
 {
-	for (uint32_t i = 0; i < vkData->swapchainImageCount; ++i)
-		vkDestroyFramebuffer(vkData->device, vkData->framebuffers[i], NULL);
+	if (!strcmp(name, "viewport"))
+		*path = DRAW_DATA_VIEWPORT;
+	else if (!strcmp(name, "uniform"))
+		*path = DRAW_DATA_UNIFORM;
+	else if (!strcmp(name, "push"))
+		*path = DRAW_DATA_PUSH;
+	else
+		return false;
 
-	if (vkData->setupCmdBuffer != VK_NULL_HANDLE)
-		vkFreeCommandBuffers(vkData->device, vkData->cmdPool, 1, &vkData->setupCmdBuffer);
+	return true;
+}
 
-	vkFreeCommandBuffers(vkData->device, vkData->cmdPool,
-			vkData->swapchainImageCount, vkData->buffers.cmdBuffers);
-	vkDestroyCommandPool(vkData->device, vkData->cmdPool, NULL);
+//Compilers and editors can leave empty or half written files behind, which loadShader would exit on
+static bool isShaderValid(VulkanData *vkData, const char *name)
+{
+	size_t size;
+	const uint32_t *code = mapShader(vkData, name, &size);
+	if (code != NULL)
+		munmap((void *) code, size);
 
-	vkDestroyPipeline(vkData->device, vkData->pipeline, NULL);
-	vkDestroyRenderPass(vkData->device, vkData->renderPass, NULL);
+	return code != NULL;
+}
 
-	vkDestroyBuffer(vkData->device, vkData->vertices.buffer, NULL);
-	vkFreeMemory(vkData->device, vkData->vertices.memory, NULL);
+//Runs on the watch thread, the render loop only ever waits for the mutex, never for a pipeline build
+static void reloadShaders(void *userData)
+{
+	VulkanData *vkData = userData;
 
-	vkDestroyBuffer(vkData->device, vkData->indices.buffer, NULL);
-	vkFreeMemory(vkData->device, vkData->indices.memory, NULL);
-	
-	vkDestroySemaphore(vkData->device, vkData->semaphores.presentComplete, NULL);
-	vkDestroySemaphore(vkData->device, vkData->semaphores.renderComplete, NULL);
+	bool valid = isShaderValid(vkData, programShaders[getDrawProgram(vkData)]) && isShaderValid(vkData, "frag.spv");
+	valid = valid && (!vkData->instances.enabled || isShaderValid(vkData, "instanced.spv"));
+	valid = valid && (!vkData->culling.enabled || isShaderValid(vkData, "cull.spv"));
+	if (!valid)
+	{
+		printf("Shader reload skipped, keeping the current pipelines.\n");
+		return;
+	}
+
+	printf("Shaders changed, rebuilding pipelines.\n");
+	PipelineSet set;
+	//Valid SPIR-V can still fail to build, for example with a push block that no longer fits the layout
+	if (!buildPipelines(vkData, &set))
+	{
+		printf("Shader reload failed, keeping the current pipelines.\n");
+		return;
+	}
 
-	for (uint32_t i = 0; i < vkData->swapchainImageCount; ++i)
-		vkDestroyImageView(vkData->device, vkData->buffers.imageViews[i], NULL);
+	pthread_mutex_lock(&vkData->reload.mutex);
+	//The render loop never saw the previous build, it can go right away
+	if (vkData->reload.ready)
+		destroyPipelineSet(&vkData->reload.pending);
+	vkData->reload.pending = set;
+	vkData->reload.ready = true;
+	pthread_mutex_unlock(&vkData->reload.mutex);
+}
 
-	free(vkData->buffers.images);
-	free(vkData->buffers.cmdBuffers);
-	free(vkData->buffers.imageViews);
+static void startShaderReload(VulkanData *vkData)
+{
+	vkData->reload.ready = false;
+	vkData->reload.retiring = false;
+	pthread_mutex_init(&vkData->reload.mutex, NULL);
+	//Reloaded pipelines must be built from the files that changed, not from the copies in the executable
+	vkData->embeddedShaders = false;
+
+	vkData->reload.enabled = initShaderWatch(&vkData->reload.watch, vkData->shaderDirectory, reloadShaders, vkData);
+	if (vkData->reload.enabled)
+		printf("Watching %s for changed SPIR-V.\n", vkData->shaderDirectory);
+	else
+		pthread_mutex_destroy(&vkData->reload.mutex);
 }
 
-void resizeVK(VulkanData *vkData)
+//Called between frames, swaps in a finished build and destroys the pipelines it replaced once they are out of use
+static void updateShaderReload(VulkanData *vkData)
 {
-	printf("Resizing window.\n");
-	destroySwapchain(vkData);
+	if (vkData->reload.retiring)
+	{
+		//Every drawVK waits for one frame slot's fence, after MAX_FRAMES_IN_FLIGHT of them no frame recorded with
+		//the old pipelines can still be executing. A newer build waits until then, it is never more than a few frames
+		if (vkData->reload.retireFrames > 0)
+		{
+			vkData->reload.retireFrames--;
+			return;
+		}
 
-	VK_CHECK(vkQueueWaitIdle(vkData->queue));
-	VK_CHECK(vkDeviceWaitIdle(vkData->device));
+		destroyPipelineSet(&vkData->reload.retired);
+		vkData->reload.retiring = false;
+	}
+
+	pthread_mutex_lock(&vkData->reload.mutex);
+	bool ready = vkData->reload.ready;
+	PipelineSet set = vkData->reload.pending;
+	vkData->reload.ready = false;
+	pthread_mutex_unlock(&vkData->reload.mutex);
 
-	prepareVK(vkData);
+	if (!ready)
+		return;
+
+	swapPipelines(vkData, &set);
+	vkData->reload.retired = set;
+	vkData->reload.retiring = true;
+	vkData->reload.retireFrames = MAX_FRAMES_IN_FLIGHT;
+	printf("Reloaded shaders are in use.\n");
 }
 
-void drawVK(VulkanData *vkData)
+//Expects the device to be idle, so retired pipelines can go immediately
+static void stopShaderReload(VulkanData *vkData)
 {
-	vkData->fpAcquireNextImageKHR(vkData->device, vkData->swapchain, UINT64_MAX,
-			vkData->semaphores.presentComplete, NULL, &vkData->currentBuffer);
-	//vkData->fpAcquireNextImageKHR(vkData->device, vkData->swapchain, 0,
-	//		vkData->semaphores.presentComplete, NULL, &vkData->currentBuffer);
-	
-	VK_CHECK(vkQueueWaitIdle(vkData->queue));
+	if (!vkData->reload.enabled)
+		return;
 
-	VkPipelineStageFlags pipelineStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	
-	VkSubmitInfo submitInfo = {
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.pNext = NULL,
-		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = &vkData->semaphores.presentComplete,
-		.pWaitDstStageMask = &pipelineStages,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &vkData->buffers.cmdBuffers[vkData->currentBuffer],
-		.signalSemaphoreCount = 1,
-		.pSignalSemaphores = &vkData->semaphores.renderComplete,
-	};
+	destroyShaderWatch(&vkData->reload.watch);
+	pthread_mutex_destroy(&vkData->reload.mutex);
 
-	VK_CHECK(vkQueueSubmit(vkData->queue, 1, &submitInfo, VK_NULL_HANDLE));
+	if (vkData->reload.ready)
+		destroyPipelineSet(&vkData->reload.pending);
+	if (vkData->reload.retiring)
+		destroyPipelineSet(&vkData->reload.retired);
 
-	VkPresentInfoKHR presentInfo = {
-		.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-		.pNext = NULL,
-		.waitSemaphoreCount = 1,
-		.pWaitSemaphores = &vkData->semaphores.renderComplete,
-		.swapchainCount = 1,
-		.pSwapchains = &vkData->swapchain,
-		.pImageIndices = &vkData->currentBuffer,
-		.pResults = NULL
-	};
+	vkData->reload.enabled = false;
+}
 
-	VK_CHECK(vkData->fpQueuePresentKHR(vkData->queue, &presentInfo));
+static bool shouldClose(Window *window, uint32_t frameLimit, uint64_t frameNumber)
+{
+	if (frameLimit > 0 && frameNumber >= frameLimit)
+		return true;
+	if (window->glfwWindow)
+		return glfwWindowShouldClose(window->glfwWindow);
+	return false;
 }
 
-void runWindow(Window *window)
+void runWindow(Window *window, Options *options)
 {
-	clock_t oldTime = clock();
+	VulkanData *vkData = &window->vkData;
+	bool sweepFrames = options->sweepFrames;
+	uint64_t frameNumber = 0;
+
+	double sweepFps[MAX_FRAMES_IN_FLIGHT];
+	double sweepCpuTime[MAX_FRAMES_IN_FLIGHT];
+	FrameStatsSummary sweepSummary[MAX_FRAMES_IN_FLIGHT];
+
+	if (sweepFrames)
+		setFramesInFlight(vkData, 1);
 
-	while (!glfwWindowShouldClose(window->glfwWindow))
+	if (options->hotReload)
+		startShaderReload(vkData);
+
+	FrameStats stats;
+	initFrameStats(&stats, options->frameBudget / 1000.0, 1.0, options->statsCsvPath);
+
+	double reportTime = getTime();
+	double sweepTime = reportTime;
+	double cpuTime = 0.0;
+	double sweepCpu = 0.0;
+	double recordTime = 0.0;
+	uint32_t frames = 0;
+	uint32_t sweepCount = 0;
+
+	while (!shouldClose(window, options->frameLimit, frameNumber))
 	{
-		glfwPollEvents();
+		if (window->glfwWindow)
+			glfwPollEvents();
+
+		if (vkData->swapchainDirty)
+		{
+			//A minimized window has a zero sized surface, no swapchain can be created until it comes back
+			if (vkData->swapchain.width == 0 || vkData->swapchain.height == 0)
+			{
+				glfwWaitEvents();
+				continue;
+			}
+
+			recreateSwapchain(vkData);
+			stats.lastFrameTime = getTime();
+		}
+
+		double frameStart = getTime();
+		if (vkData->scene.animate)
+			updateScene(&vkData->scene, frameStart);
+		if (vkData->stream.size > 0)
+			streamUpload(vkData);
+		if (vkData->reload.enabled)
+			updateShaderReload(vkData);
+		drawVK(vkData);
+		double time = getTime();
+		frameNumber++;
+
+		frameStatsTick(&stats);
+
+		recordTime += vkData->recordTime;
+		cpuTime += time - frameStart;
+		sweepCpu += time - frameStart;
+		frames++;
+		sweepCount++;
+
+		FrameStatsSummary summary;
+		if (frameStatsReport(&stats, &summary))
+		{
+			printf("Frames in flight: %u, %.1f frames/s, CPU frame time: %.3f ms, recording: %.3f ms "
+					"(%.2fM draws/s on %u threads)\n", vkData->frameCount, frames / (time - reportTime),
+					1000.0 * cpuTime / frames, 1000.0 * recordTime / frames,
+					(double) vkData->scene.drawCount * frames / recordTime / 1000000.0, vkData->threadCount);
+			printGpuProfiler(&vkData->profiler);
+			printGpuProfiler(&vkData->uploadProfiler);
+			if (vkData->stream.size > 0)
+				printf("Streamed %.1f MiB, %u staging stalls\n",
+						vkData->staging.bytesUploaded / (1024.0 * 1024.0), vkData->staging.stallCount);
+
+			//Poor man's overlay, keeps the numbers visible without a text renderer
+			if (window->glfwWindow)
+			{
+				char title[128];
+				snprintf(title, sizeof(title), "Vulkan Test Program - %.1f fps, p99 %.2f ms",
+						frames / (time - reportTime), 1000.0 * summary.p99);
+				glfwSetWindowTitle(window->glfwWindow, title);
+			}
+
+			reportTime = time;
+			cpuTime = recordTime = 0.0;
+			frames = 0;
+			vkData->staging.bytesUploaded = 0;
+			vkData->staging.stallCount = 0;
+		}
+
+		if (sweepFrames && time - sweepTime >= FRAME_SWEEP_SECONDS)
+		{
+			sweepFps[vkData->frameCount - 1] = sweepCount / (time - sweepTime);
+			sweepCpuTime[vkData->frameCount - 1] = 1000.0 * sweepCpu / sweepCount;
+			getFrameStatsSummary(&stats, &sweepSummary[vkData->frameCount - 1]);
 
-		clock_t time = clock();
-		float dt = ((float) (time - oldTime)) / CLOCKS_PER_SEC;
-		oldTime = time;
+			if (vkData->frameCount == MAX_FRAMES_IN_FLIGHT)
+				break;
 
-		//printf("Frames per second: %f\n", 1.0 / dt);
+			setFramesInFlight(vkData, vkData->frameCount + 1);
+			resetFrameStats(&stats);
+			sweepTime = reportTime = getTime();
+			sweepCpu = cpuTime = recordTime = 0.0;
+			sweepCount = frames = 0;
+		}
+	}
 
-		drawVK(&window->vkData);
+	VK_CHECK(vkDeviceWaitIdle(vkData->device));
+	stopShaderReload(vkData);
 
-		vkDeviceWaitIdle(window->vkData.device);
+	if (sweepFrames && vkData->frameCount == MAX_FRAMES_IN_FLIGHT)
+	{
+		printf("Frames in flight | frames/s | CPU frame time (ms) | p50 (ms) | p99 (ms)\n");
+		for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+			printf("%16u | %8.1f | %19.3f | %8.3f | %.3f\n", i + 1, sweepFps[i], sweepCpuTime[i],
+					1000.0 * sweepSummary[i].p50, 1000.0 * sweepSummary[i].p99);
 	}
+
+	destroyFrameStats(&stats);
 }
 
 void error_callback(int error, const char* description)
@@ -1211,20 +3710,73 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
 {
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, GLFW_TRUE);
+
+	//Cycle through the present profiles, the new mode takes effect when the swapchain is recreated
+	if (key == GLFW_KEY_P && action == GLFW_PRESS)
+	{
+		VulkanData *vkData = glfwGetWindowUserPointer(window);
+		vkData->swapchain.presentProfile = (vkData->swapchain.presentProfile + 1) % PRESENT_PROFILE_COUNT;
+		vkData->swapchainDirty = true;
+	}
 }
 
 void resize_callback(GLFWwindow *window, int width, int height)
 {
 	VulkanData *vkData = glfwGetWindowUserPointer(window);
-	vkData->width = width;
-	vkData->height = height;
-	printf("Resize callback called.\n");
-	resizeVK(vkData);
+	vkData->swapchain.width = width;
+	vkData->swapchain.height = height;
+
+	//Recreated from the main loop, rebuilding from inside the callback would stall every event of a drag
+	vkData->swapchainDirty = true;
 }
 
-void initWindow(Window *window)
+void initWindow(Window *window, Options *options)
 {
 	memset(window, 0, sizeof(Window));
+	window->vkData.frameCount = options->frameCount;
+	window->vkData.threadCount = options->threadCount;
+	initScene(&window->vkData.scene, options->drawCount, options->animate);
+	window->vkData.culling.enabled = options->gpuCull;
+	window->vkData.instances.enabled = options->instanced || options->instanceSweep || options->gpuCull;
+	window->vkData.instances.capacity = options->drawCount;
+	if (options->instanceSweep && window->vkData.instances.capacity < INSTANCE_SWEEP_MAX)
+		window->vkData.instances.capacity = INSTANCE_SWEEP_MAX;
+	//The draw benchmark creates the instance and uniform buffers the run does not use, and uses the others as they are
+	if (options->drawBench && window->vkData.instances.enabled &&
+			window->vkData.instances.capacity < DRAW_BENCH_MAX)
+		window->vkData.instances.capacity = DRAW_BENCH_MAX;
+	window->vkData.swapchain.headless = options->headless;
+	window->vkData.swapchain.width = options->width;
+	window->vkData.swapchain.height = options->height;
+	window->vkData.swapchain.presentProfile = options->presentProfile;
+	window->vkData.pipelineCachePath = options->pipelineCache ? PIPELINE_CACHE_PATH : NULL;
+	resolveShaderDirectory(&window->vkData);
+#ifdef EMBED_SHADERS
+	window->vkData.embeddedShaders = true;
+	printf("Using the shaders embedded in the executable.\n");
+#else
+	printf("Loading shaders from %s\n", window->vkData.shaderDirectory);
+#endif
+	window->vkData.meshPath = options->meshPath;
+	window->vkData.vertices.pack = options->packVertices;
+	window->vkData.depth.prepass = options->depthPrepass;
+	window->vkData.drawData = options->drawData;
+	window->vkData.shaderConstants[SHADER_CONSTANT_VERTEX_COLOR] = 1;
+	window->vkData.uniforms.enabled = options->drawData == DRAW_DATA_UNIFORM;
+	//The benchmarks swap in scenes of their own
+	window->vkData.uniforms.capacity = options->drawCount > DEPTH_BENCH_LAYERS ? options->drawCount :
+			DEPTH_BENCH_LAYERS;
+	if (options->drawBench && window->vkData.uniforms.enabled && window->vkData.uniforms.capacity < DRAW_BENCH_MAX)
+		window->vkData.uniforms.capacity = DRAW_BENCH_MAX;
+
+	//Headless runs must work on machines without a display, so GLFW is never initialized
+	if (options->headless)
+	{
+		initVK(&window->vkData);
+		initSurface(&window->vkData, NULL);
+		prepareVK(&window->vkData);
+		return;
+	}
 
 	glfwSetErrorCallback(error_callback);
 
@@ -1233,13 +3785,10 @@ void initWindow(Window *window)
 	if(!glfwVulkanSupported())
 		ERR_EXIT("GLFW failed to find the Vulkan loader, do you have the most recent driver?\nExiting...\n");
 
-	window->vkData.width = 300;
-	window->vkData.height = 300;
-
 	initVK(&window->vkData);
 	
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	window->glfwWindow = glfwCreateWindow(window->vkData.width, window->vkData.height,
+	window->glfwWindow = glfwCreateWindow(window->vkData.swapchain.width, window->vkData.swapchain.height,
 			"Vulkan Test Program", NULL, NULL);
 	if (!window->glfwWindow)
 		ERR_EXIT("Failed to create GLFW window.\nExiting...\n");
@@ -1256,10 +3805,23 @@ void initWindow(Window *window)
 
 void destroyVulkan(VulkanData *vkData)
 {
-	destroySwapchain(vkData);
+	destroyStagingRing(&vkData->staging, &vkData->allocator);
+	destroyGpuProfiler(&vkData->uploadProfiler);
+	destroyGpuProfiler(&vkData->profiler);
+	destroyStream(vkData);
+
+	cleanupVK(vkData);
+	destroySwapchain(&vkData->swapchain);
+
+	savePipelineCache(&vkData->pipelineCache);
+	destroyPipelineCache(&vkData->pipelineCache);
+
+	printAllocatorStats(&vkData->allocator);
+	destroyAllocator(&vkData->allocator);
+
+	destroyScene(&vkData->scene);
 
 	vkDestroyDevice(vkData->device, NULL);
-	vkDestroySurfaceKHR(vkData->instance, vkData->surface, NULL);
 	vkDestroyInstance(vkData->instance, NULL);
 
 	free(vkData->queueProps);
@@ -1268,18 +3830,176 @@ void destroyVulkan(VulkanData *vkData)
 void destroyWindow(Window *window)
 {
 	destroyVulkan(&window->vkData);
-	glfwDestroyWindow(window->glfwWindow);
-	glfwTerminate();
+
+	if (window->glfwWindow)
+	{
+		glfwDestroyWindow(window->glfwWindow);
+		glfwTerminate();
+	}
 }
 
-int main()
+int main(int argc, char **argv)
 {
+	Options options = {
+		.frameCount = 2,
+		.sweepFrames = false,
+		.headless = false,
+		.frameLimit = 0,
+		.width = 300,
+		.height = 300,
+		.streamMegabytes = 0,
+		.pipelineCache = true,
+		.presentProfile = PRESENT_PROFILE_UNCAPPED,
+		.frameBudget = 1000.0 / 60.0,
+		.statsCsvPath = NULL,
+		.threadCount = 1,
+		.drawCount = 1,
+		.animate = false,
+		.recordSweep = false,
+		.instanced = false,
+		.instanceSweep = false,
+		.gpuCull = false,
+		.meshPath = NULL,
+		.packVertices = false,
+		.vertexBench = false,
+		.depthPrepass = false,
+		.depthBench = false,
+		.drawData = DRAW_DATA_VIEWPORT,
+		.drawBench = false,
+		.hotReload = false,
+		.variantBench = false,
+		.warmupBench = false
+	};
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+			options.frameCount = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "--sweep-frames"))
+			options.sweepFrames = true;
+		else if (!strcmp(argv[i], "--headless"))
+			options.headless = true;
+		else if (!strcmp(argv[i], "--frame-limit") && i + 1 < argc)
+			options.frameLimit = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "--stream-mb") && i + 1 < argc)
+			options.streamMegabytes = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "--present") && i + 1 < argc && parsePresentProfile(argv[i + 1],
+					&options.presentProfile))
+			++i;
+		else if (!strcmp(argv[i], "--frame-budget") && i + 1 < argc)
+			options.frameBudget = strtod(argv[++i], NULL);
+		else if (!strcmp(argv[i], "--stats-csv") && i + 1 < argc)
+			options.statsCsvPath = argv[++i];
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+			options.threadCount = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "--draws") && i + 1 < argc)
+			options.drawCount = strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "--animate"))
+			options.animate = true;
+		else if (!strcmp(argv[i], "--record-sweep"))
+			options.recordSweep = true;
+		else if (!strcmp(argv[i], "--instanced"))
+			options.instanced = true;
+		else if (!strcmp(argv[i], "--instance-sweep"))
+			options.instanceSweep = true;
+		else if (!strcmp(argv[i], "--gpu-cull"))
+			options.gpuCull = true;
+		else if (!strcmp(argv[i], "--mesh") && i + 1 < argc)
+			options.meshPath = argv[++i];
+		else if (!strcmp(argv[i], "--packed-vertices"))
+			options.packVertices = true;
+		else if (!strcmp(argv[i], "--vertex-bench"))
+			options.vertexBench = true;
+		else if (!strcmp(argv[i], "--depth-prepass"))
+			options.depthPrepass = true;
+		else if (!strcmp(argv[i], "--depth-bench"))
+			options.depthBench = true;
+		else if (!strcmp(argv[i], "--draw-data") && i + 1 < argc && parseDrawDataPath(argv[i + 1],
+					&options.drawData))
+			++i;
+		else if (!strcmp(argv[i], "--draw-bench"))
+			options.drawBench = true;
+		else if (!strcmp(argv[i], "--hot-reload"))
+			options.hotReload = true;
+		else if (!strcmp(argv[i], "--variant-bench"))
+			options.variantBench = true;
+		else if (!strcmp(argv[i], "--warmup-bench"))
+			options.warmupBench = true;
+		else if (!strcmp(argv[i], "--no-pipeline-cache"))
+			options.pipelineCache = false;
+		else if (!strcmp(argv[i], "--size") && i + 2 < argc)
+		{
+			options.width = strtoul(argv[++i], NULL, 10);
+			options.height = strtoul(argv[++i], NULL, 10);
+		}
+		else
+		{
+			printf("Usage: %s [--frames 1-%u] [--sweep-frames] [--headless] [--frame-limit N] "
+					"[--size WIDTH HEIGHT] [--stream-mb N] [--no-pipeline-cache]\n"
+					"       [--present low-latency|power-saving|uncapped] [--frame-budget MS] [--stats-csv PATH]\n"
+					"       [--threads N] [--draws N] [--animate] [--record-sweep]\n"
+					"       [--instanced] [--instance-sweep] [--gpu-cull]\n"
+					"       [--mesh PATH] [--packed-vertices] [--vertex-bench]\n"
+					"       [--depth-prepass] [--depth-bench] [--draw-data viewport|uniform|push] [--draw-bench]\n"
+					"       [--hot-reload] [--variant-bench] [--warmup-bench]\n",
+					argv[0], MAX_FRAMES_IN_FLIGHT);
+			return 1;
+		}
+	}
+
+	if (options.frameCount == 0 || options.frameCount > MAX_FRAMES_IN_FLIGHT)
+	{
+		printf("Number of frames in flight must be between 1 and %u.\n", MAX_FRAMES_IN_FLIGHT);
+		return 1;
+	}
+
+	if (options.threadCount == 0 || options.threadCount > JOB_SYSTEM_MAX_THREADS)
+	{
+		printf("Number of recording threads must be between 1 and %u.\n", JOB_SYSTEM_MAX_THREADS);
+		return 1;
+	}
+
+	if (options.drawCount == 0)
+	{
+		printf("Number of draws must be at least 1.\n");
+		return 1;
+	}
+
+	//Without a window there is nothing to close, so headless runs always stop on their own
+	if (options.headless && options.frameLimit == 0 && !options.sweepFrames)
+		options.frameLimit = HEADLESS_DEFAULT_FRAMES;
+
 	Window window;
-	initWindow(&window);
+	initWindow(&window, &options);
+
+	if (options.streamMegabytes > 0)
+		prepareStream(&window.vkData, (VkDeviceSize) options.streamMegabytes * 1024 * 1024);
+
+	if (options.recordSweep)
+		sweepRecordThreads(&window.vkData);
+
+	if (options.instanceSweep)
+		sweepInstances(&window.vkData);
+
+	if (options.vertexBench)
+		benchmarkVertexFormats(&window.vkData);
+
+	if (options.depthBench)
+		benchmarkDepthPrepass(&window.vkData);
+
+	if (options.drawBench)
+		benchmarkDrawData(&window.vkData);
+
+	if (options.variantBench)
+		benchmarkShaderVariants(&window.vkData);
+
+	if (options.warmupBench)
+		benchmarkPipelineWarmup(&window.vkData);
 
+	printAllocatorStats(&window.vkData.allocator);
 	printf("Setup complete, starting main loop.\n");
 
-	runWindow(&window);
+	runWindow(&window, &options);
 
 	printf("Loop exited normally, cleaning up Vulkan structures.\n");
 
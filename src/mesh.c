@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mesh.h"
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+uint32_t getMeshFormatSize(MeshAttributeFormat format)
+{
+	switch (format)
+	{
+		case MESH_FORMAT_FLOAT3:
+			return 3 * sizeof(float);
+		case MESH_FORMAT_SNORM16x4:
+			return 4 * sizeof(int16_t);
+		case MESH_FORMAT_UNORM8x4:
+			return 4 * sizeof(uint8_t);
+	}
+
+	return 0;
+}
+
+void computeBoundingSphere(const float *positions, uint32_t stride, uint32_t count, float sphere[4])
+{
+	float minPos[3] = { 0.0f, 0.0f, 0.0f };
+	float maxPos[3] = { 0.0f, 0.0f, 0.0f };
+
+	for (uint32_t v = 0; v < count; ++v)
+	{
+		const float *position = (const float *) ((const char *) positions + (size_t) v * stride);
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			minPos[c] = v == 0 ? position[c] : fminf(minPos[c], position[c]);
+			maxPos[c] = v == 0 ? position[c] : fmaxf(maxPos[c], position[c]);
+		}
+	}
+
+	for (uint32_t c = 0; c < 3; ++c)
+		sphere[c] = 0.5f * (minPos[c] + maxPos[c]);
+
+	float radius = 0.0f;
+	for (uint32_t v = 0; v < count; ++v)
+	{
+		const float *position = (const float *) ((const char *) positions + (size_t) v * stride);
+		float dx = position[0] - sphere[0];
+		float dy = position[1] - sphere[1];
+		float dz = position[2] - sphere[2];
+		radius = fmaxf(radius, sqrtf(dx * dx + dy * dy + dz * dz));
+	}
+
+	sphere[3] = radius;
+}
+
+void initMeshHeader(MeshHeader *header, uint32_t vertexCount, uint32_t vertexStride, uint32_t indexCount)
+{
+	memset(header, 0, sizeof(MeshHeader));
+	header->magic = MESH_MAGIC;
+	header->version = MESH_VERSION;
+	header->vertexCount = vertexCount;
+	header->indexCount = indexCount;
+	header->vertexStride = vertexStride;
+
+	header->vertexOffset = alignUp(sizeof(MeshHeader), MESH_ALIGNMENT);
+	header->vertexSize = (uint64_t) vertexCount * vertexStride;
+	header->indexOffset = alignUp(header->vertexOffset + header->vertexSize, MESH_ALIGNMENT);
+	header->indexStride = vertexCount <= MESH_MAX_16BIT_VERTICES ? sizeof(uint16_t) : sizeof(uint32_t);
+	header->indexSize = (uint64_t) indexCount * header->indexStride;
+
+	for (uint32_t c = 0; c < 4; ++c)
+	{
+		header->positionScale[c] = 1.0f;
+		header->positionBias[c] = 0.0f;
+	}
+}
+
+void narrowMeshIndices(uint32_t *indices, uint32_t count)
+{
+	//Front to back is safe, every 16 bit write lands at or before the 32 bit value it came from
+	uint16_t *narrow = (uint16_t *) indices;
+	for (uint32_t i = 0; i < count; ++i)
+		narrow[i] = (uint16_t) indices[i];
+}
+
+static const MeshAttribute * findAttribute(const MeshHeader *header, uint32_t location)
+{
+	for (uint32_t i = 0; i < header->attributeCount; ++i)
+	{
+		if (header->attributes[i].location == location)
+			return &header->attributes[i];
+	}
+
+	return NULL;
+}
+
+bool isMeshFloatLayout(const MeshHeader *header)
+{
+	const MeshAttribute *position = findAttribute(header, 0);
+	const MeshAttribute *color = findAttribute(header, 1);
+	return position != NULL && position->format == MESH_FORMAT_FLOAT3 && color != NULL &&
+			color->format == MESH_FORMAT_FLOAT3;
+}
+
+static uint8_t packUnorm8(float value)
+{
+	return (uint8_t) lrintf(fminf(fmaxf(value, 0.0f), 1.0f) * 255.0f);
+}
+
+void * packMeshVertices(const MeshHeader *header, const void *vertices, MeshHeader *packedHeader)
+{
+	const uint32_t packedStride = 4 * sizeof(int16_t) + 4 * sizeof(uint8_t);
+	const MeshAttribute *position = findAttribute(header, 0);
+	const MeshAttribute *color = findAttribute(header, 1);
+
+	initMeshHeader(packedHeader, header->vertexCount, packedStride, header->indexCount);
+	memcpy(packedHeader->boundingSphere, header->boundingSphere, sizeof(header->boundingSphere));
+
+	//The indices are used as they are, whatever stride they were stored with
+	packedHeader->indexStride = header->indexStride;
+	packedHeader->indexSize = header->indexSize;
+
+	packedHeader->attributeCount = 2;
+	packedHeader->attributes[0].location = 0;
+	packedHeader->attributes[0].format = MESH_FORMAT_SNORM16x4;
+	packedHeader->attributes[0].offset = 0;
+	packedHeader->attributes[1].location = 1;
+	packedHeader->attributes[1].format = MESH_FORMAT_UNORM8x4;
+	packedHeader->attributes[1].offset = 4 * sizeof(int16_t);
+
+	//Scale and bias map the bounding box onto [-1, 1] per axis, so every axis gets the full 16 bits
+	float minPos[3] = { 0.0f, 0.0f, 0.0f };
+	float maxPos[3] = { 0.0f, 0.0f, 0.0f };
+	for (uint32_t v = 0; v < header->vertexCount; ++v)
+	{
+		const char *src = (const char *) vertices + (size_t) v * header->vertexStride;
+		const float *p = (const float *) (src + position->offset);
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			minPos[c] = v == 0 ? p[c] : fminf(minPos[c], p[c]);
+			maxPos[c] = v == 0 ? p[c] : fmaxf(maxPos[c], p[c]);
+		}
+	}
+
+	for (uint32_t c = 0; c < 3; ++c)
+	{
+		float halfExtent = 0.5f * (maxPos[c] - minPos[c]);
+		packedHeader->positionScale[c] = halfExtent > 0.0f ? halfExtent : 1.0f;
+		packedHeader->positionBias[c] = 0.5f * (minPos[c] + maxPos[c]);
+	}
+
+	char *packed = malloc(packedHeader->vertexSize);
+
+	for (uint32_t v = 0; v < header->vertexCount; ++v)
+	{
+		const char *src = (const char *) vertices + (size_t) v * header->vertexStride;
+		const float *p = (const float *) (src + position->offset);
+		const float *rgb = (const float *) (src + color->offset);
+
+		int16_t packedPosition[4] = { 0, 0, 0, 0 };
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			float normalized = (p[c] - packedHeader->positionBias[c]) / packedHeader->positionScale[c];
+			packedPosition[c] = (int16_t) lrintf(fminf(fmaxf(normalized, -1.0f), 1.0f) * 32767.0f);
+		}
+
+		uint8_t packedColor[4] = { packUnorm8(rgb[0]), packUnorm8(rgb[1]), packUnorm8(rgb[2]), 255 };
+
+		char *dst = packed + (size_t) v * packedStride;
+		memcpy(dst, packedPosition, sizeof(packedPosition));
+		memcpy(dst + sizeof(packedPosition), packedColor, sizeof(packedColor));
+	}
+
+	return packed;
+}
+
+//Everything the loader relies on is checked here, past this point the mapping is trusted
+static bool validateHeader(const MeshHeader *header, size_t fileSize, const char *path)
+{
+	if (header->magic != MESH_MAGIC)
+	{
+		printf("%s is not a mesh file.\n", path);
+		return false;
+	}
+
+	if (header->version != MESH_VERSION)
+	{
+		printf("%s has mesh format version %u, expected %u.\n", path, header->version, MESH_VERSION);
+		return false;
+	}
+
+	if (header->attributeCount == 0 || header->attributeCount > MESH_MAX_ATTRIBUTES || header->vertexStride == 0)
+	{
+		printf("%s has an invalid vertex layout.\n", path);
+		return false;
+	}
+
+	//Every pipeline feeds the position and color inputs straight from this layout, a location the shaders lack or
+	//one bound twice would be invalid usage the driver never reports
+	uint32_t locations = 0;
+	for (uint32_t i = 0; i < header->attributeCount; ++i)
+	{
+		const MeshAttribute *attribute = &header->attributes[i];
+		uint32_t size = getMeshFormatSize(attribute->format);
+		if (size == 0 || attribute->offset + size > header->vertexStride)
+		{
+			printf("%s has an invalid vertex attribute at location %u.\n", path, attribute->location);
+			return false;
+		}
+
+		if (attribute->location >= 32 || (locations & (1u << attribute->location)))
+		{
+			printf("%s has a repeated or out of range vertex attribute location %u.\n", path, attribute->location);
+			return false;
+		}
+		locations |= 1u << attribute->location;
+	}
+
+	if ((locations & 3u) != 3u)
+	{
+		printf("%s lacks a vertex position or color attribute.\n", path);
+		return false;
+	}
+
+	if (header->indexStride != sizeof(uint32_t) && (header->indexStride != sizeof(uint16_t) ||
+			header->vertexCount > MESH_MAX_16BIT_VERTICES))
+	{
+		printf("%s has %u byte indices for %u vertices.\n", path, header->indexStride, header->vertexCount);
+		return false;
+	}
+
+	if (header->vertexOffset % MESH_ALIGNMENT != 0 || header->indexOffset % MESH_ALIGNMENT != 0 ||
+			header->vertexSize != (uint64_t) header->vertexCount * header->vertexStride ||
+			header->indexSize != (uint64_t) header->indexCount * header->indexStride ||
+			header->vertexOffset + header->vertexSize > fileSize || header->indexOffset + header->indexSize > fileSize)
+	{
+		printf("%s is truncated or its blobs are misplaced.\n", path);
+		return false;
+	}
+
+	return true;
+}
+
+bool mapMesh(Mesh *mesh, const char *path)
+{
+	memset(mesh, 0, sizeof(Mesh));
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		printf("Cannot open mesh file %s.\n", path);
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || (size_t) fileStat.st_size < sizeof(MeshHeader))
+	{
+		printf("%s is too small to be a mesh file.\n", path);
+		close(fd);
+		return false;
+	}
+
+	void *mapping = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (mapping == MAP_FAILED)
+	{
+		printf("Cannot map mesh file %s.\n", path);
+		return false;
+	}
+
+	//The blobs are read front to back exactly once, on their way into the staging ring, so start the readahead
+	//now and let the kernel drop pages behind the copy
+	madvise(mapping, fileStat.st_size, MADV_SEQUENTIAL);
+	madvise(mapping, fileStat.st_size, MADV_WILLNEED);
+
+	const MeshHeader *header = mapping;
+	if (!validateHeader(header, fileStat.st_size, path))
+	{
+		munmap(mapping, fileStat.st_size);
+		return false;
+	}
+
+	mesh->mapping = mapping;
+	mesh->mappingSize = fileStat.st_size;
+	mesh->header = header;
+	mesh->vertices = (const char *) mapping + header->vertexOffset;
+	mesh->indices = (const char *) mapping + header->indexOffset;
+
+	return true;
+}
+
+bool writeMesh(const char *path, const MeshHeader *header, const void *vertices, const void *indices)
+{
+	FILE *file = fopen(path, "wb");
+	if (file == NULL)
+	{
+		printf("Cannot open %s for writing.\n", path);
+		return false;
+	}
+
+	static const char padding[MESH_ALIGNMENT] = { 0 };
+
+	bool written = fwrite(header, sizeof(MeshHeader), 1, file) == 1;
+	written = written && fwrite(padding, 1, header->vertexOffset - sizeof(MeshHeader), file) ==
+			header->vertexOffset - sizeof(MeshHeader);
+	written = written && fwrite(vertices, 1, header->vertexSize, file) == header->vertexSize;
+	written = written && fwrite(padding, 1, header->indexOffset - header->vertexOffset - header->vertexSize, file) ==
+			header->indexOffset - header->vertexOffset - header->vertexSize;
+	written = written && fwrite(indices, 1, header->indexSize, file) == header->indexSize;
+
+	if (fclose(file) != 0)
+		written = false;
+
+	if (!written)
+		printf("Failed to write mesh file %s.\n", path);
+
+	return written;
+}
+
+void unmapMesh(Mesh *mesh)
+{
+	if (mesh->mapping != NULL)
+		munmap(mesh->mapping, mesh->mappingSize);
+
+	memset(mesh, 0, sizeof(Mesh));
+}
@@ -0,0 +1,87 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//"MESH" read as a little endian word, files are always little endian
+#define MESH_MAGIC 0x4853454d
+#define MESH_VERSION 3
+//Vertex and index blobs start on this boundary so they can be copied straight out of the mapping
+#define MESH_ALIGNMENT 16
+#define MESH_MAX_ATTRIBUTES 8
+//Meshes up to this many vertices store 16 bit indices
+#define MESH_MAX_16BIT_VERTICES 65536
+
+typedef enum _MeshAttributeFormat {
+	MESH_FORMAT_FLOAT3,
+	//Position relative to the mesh bounds, multiplied by positionScale and offset by positionBias in the shader
+	MESH_FORMAT_SNORM16x4,
+	MESH_FORMAT_UNORM8x4
+} MeshAttributeFormat;
+
+typedef struct _MeshAttribute {
+	//Shader input location, 0 is the position and 1 the color
+	uint32_t location;
+	uint32_t format;
+	uint32_t offset;
+} MeshAttribute;
+
+//First bytes of a mesh file, the blobs follow at the offsets given here
+typedef struct _MeshHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t vertexStride;
+	//Bytes per index, 2 whenever the vertex count allows it, otherwise 4
+	uint32_t indexStride;
+	uint32_t attributeCount;
+	//Keeps the 64 bit fields below aligned
+	uint32_t reserved;
+	MeshAttribute attributes[MESH_MAX_ATTRIBUTES];
+	//Model space, xyz center and w radius
+	float boundingSphere[4];
+	//Dequantizes packed positions, identity for float positions. w is unused
+	float positionScale[4];
+	float positionBias[4];
+	uint64_t vertexOffset;
+	uint64_t vertexSize;
+	uint64_t indexOffset;
+	uint64_t indexSize;
+} MeshHeader;
+
+//A mesh file mapped read only, vertices and indices point into the mapping
+typedef struct _Mesh {
+	void *mapping;
+	size_t mappingSize;
+	const MeshHeader *header;
+	const void *vertices;
+	const void *indices;
+} Mesh;
+
+uint32_t getMeshFormatSize(MeshAttributeFormat format);
+
+//Sphere around the bounding box of count positions, stride is in bytes
+void computeBoundingSphere(const float *positions, uint32_t stride, uint32_t count, float sphere[4]);
+
+//Fills in the counts, offsets and sizes of a header for blobs laid out back to back after it, picking the smallest
+//index stride that can address every vertex
+void initMeshHeader(MeshHeader *header, uint32_t vertexCount, uint32_t vertexStride, uint32_t indexCount);
+
+//Narrows 32 bit indices to 16 bits in place, the first count * 2 bytes of indices hold the result
+void narrowMeshIndices(uint32_t *indices, uint32_t count);
+
+//True for float3 positions at location 0 and float3 colors at location 1, the layout packMeshVertices takes
+bool isMeshFloatLayout(const MeshHeader *header);
+
+//Quantizes a float layout mesh to snorm16 positions and RGBA8 colors, 12 instead of 24 bytes per vertex. Returns the
+//packed vertices, to be freed by the caller, and fills in the packed header with the same indices
+void * packMeshVertices(const MeshHeader *header, const void *vertices, MeshHeader *packedHeader);
+
+bool mapMesh(Mesh *mesh, const char *path);
+bool writeMesh(const char *path, const MeshHeader *header, const void *vertices, const void *indices);
+void unmapMesh(Mesh *mesh);
+
+#endif
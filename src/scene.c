@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "scene.h"
+
+void initScene(Scene *scene, uint32_t drawCount, bool animate)
+{
+	scene->drawCount = drawCount;
+	scene->draws = malloc(drawCount * sizeof(SceneDraw));
+	scene->columns = (uint32_t) ceil(sqrt((double) drawCount));
+	scene->rows = (drawCount + scene->columns - 1) / scene->columns;
+	scene->animate = animate;
+	scene->layered = false;
+
+	updateScene(scene, 0.0);
+}
+
+void initLayeredScene(Scene *scene, uint32_t layerCount)
+{
+	initScene(scene, layerCount, false);
+	scene->layered = true;
+
+	updateScene(scene, 0.0);
+}
+
+//Tiles the draws over the render target, animated draws bob up and down in their cell. Layered scenes stack
+//them instead
+void updateScene(Scene *scene, double time)
+{
+	if (scene->layered)
+	{
+		for (uint32_t i = 0; i < scene->drawCount; ++i)
+		{
+			SceneDraw *draw = &scene->draws[i];
+			draw->x = 0.0f;
+			draw->y = 0.0f;
+			draw->width = 1.0f;
+			draw->height = 1.0f;
+			draw->minDepth = 1.0f - (float) (i + 1) / scene->drawCount;
+			draw->maxDepth = 1.0f - (float) i / scene->drawCount;
+		}
+
+		return;
+	}
+
+	float cellWidth = 1.0f / scene->columns;
+	float cellHeight = 1.0f / scene->rows;
+
+	for (uint32_t i = 0; i < scene->drawCount; ++i)
+	{
+		SceneDraw *draw = &scene->draws[i];
+		draw->x = (i % scene->columns) * cellWidth;
+		draw->y = (i / scene->columns) * cellHeight;
+		draw->width = cellWidth;
+		draw->height = cellHeight;
+		draw->minDepth = 0.0f;
+		draw->maxDepth = 1.0f;
+
+		if (scene->animate)
+			draw->y += 0.25f * cellHeight * (float) sin(2.0 * time + 0.1 * i);
+	}
+}
+
+void destroyScene(Scene *scene)
+{
+	free(scene->draws);
+	scene->draws = NULL;
+	scene->drawCount = 0;
+}
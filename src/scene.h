@@ -0,0 +1,36 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//Where one copy of the geometry goes, in fractions of the render target
+typedef struct _SceneDraw {
+	float x;
+	float y;
+	float width;
+	float height;
+	//Depth range the geometry's z of [0, 1] is mapped to
+	float minDepth;
+	float maxDepth;
+} SceneDraw;
+
+//Everything a frame is recorded from, the command buffers are rebuilt from it every frame
+typedef struct _Scene {
+	uint32_t drawCount;
+	SceneDraw *draws;
+	//Grid the draws are laid out on when they are not animated
+	uint32_t columns;
+	uint32_t rows;
+	bool animate;
+	//Every draw covers the whole render target in its own depth slab, drawn back to front, the worst case for
+	//overdraw
+	bool layered;
+} Scene;
+
+void initScene(Scene *scene, uint32_t drawCount, bool animate);
+void initLayeredScene(Scene *scene, uint32_t layerCount);
+void updateScene(Scene *scene, double time);
+void destroyScene(Scene *scene);
+
+#endif
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "shaderwatch.h"
+#include "vktools.h"
+
+//Reads every queued event, returns true if any of them finished writing a .spv file
+static bool readEvents(int fd)
+{
+	//inotify(7) wants the buffer aligned for struct inotify_event
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	bool changed = false;
+
+	//The descriptor is non-blocking, the loop ends with EAGAIN once the queue is empty
+	ssize_t length;
+	while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+	{
+		for (char *p = buffer; p < buffer + length; )
+		{
+			const struct inotify_event *event = (const struct inotify_event *) p;
+			size_t nameLength = event->len > 0 ? strlen(event->name) : 0;
+			if (nameLength > 4 && !strcmp(event->name + nameLength - 4, ".spv"))
+				changed = true;
+
+			p += sizeof(struct inotify_event) + event->len;
+		}
+	}
+
+	return changed;
+}
+
+static void * watchMain(void *arg)
+{
+	ShaderWatch *watch = arg;
+
+	struct pollfd fds[2] = {
+		[0] = { .fd = watch->inotifyFd, .events = POLLIN, .revents = 0 },
+		[1] = { .fd = watch->stopPipe[0], .events = POLLIN, .revents = 0 }
+	};
+	bool changed = false;
+
+	for (;;)
+	{
+		//After a change only wait for the directory to settle, a timeout means the burst of writes is over
+		int ready = poll(fds, 2, changed ? SHADER_WATCH_SETTLE_MS : -1);
+		if (ready < 0 && errno == EINTR)
+			continue;
+		if (ready < 0 || (fds[1].revents & POLLIN))
+			break;
+
+		if (ready == 0)
+		{
+			changed = false;
+			watch->callback(watch->userData);
+		}
+		else if (fds[0].revents & POLLIN)
+			changed |= readEvents(watch->inotifyFd);
+	}
+
+	return NULL;
+}
+
+bool initShaderWatch(ShaderWatch *watch, const char *directory, ShaderWatchCallback callback, void *userData)
+{
+	watch->callback = callback;
+	watch->userData = userData;
+
+	watch->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch->inotifyFd < 0)
+	{
+		printf("Unable to initialize inotify: %s\n", strerror(errno));
+		return false;
+	}
+
+	//Compilers usually write the file in place, editors and build scripts often rename a finished file over it
+	if (inotify_add_watch(watch->inotifyFd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+	{
+		printf("Unable to watch %s: %s\n", directory, strerror(errno));
+		close(watch->inotifyFd);
+		return false;
+	}
+
+	if (pipe(watch->stopPipe) != 0)
+	{
+		printf("Unable to create the shader watch pipe: %s\n", strerror(errno));
+		close(watch->inotifyFd);
+		return false;
+	}
+
+	if (pthread_create(&watch->thread, NULL, watchMain, watch) != 0)
+		ERR_EXIT("Unable to create shader watch thread.\nExiting...\n");
+
+	return true;
+}
+
+void destroyShaderWatch(ShaderWatch *watch)
+{
+	char stop = 0;
+	if (write(watch->stopPipe[1], &stop, 1) != 1)
+		ERR_EXIT("Unable to stop shader watch thread.\nExiting...\n");
+	pthread_join(watch->thread, NULL);
+
+	close(watch->stopPipe[0]);
+	close(watch->stopPipe[1]);
+	close(watch->inotifyFd);
+}
@@ -0,0 +1,30 @@
+#ifndef SHADERWATCH_H
+#define SHADERWATCH_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+//A rebuild of all shaders writes several files in quick succession, they are reported together once the directory
+//has been quiet for this long
+#define SHADER_WATCH_SETTLE_MS 100
+
+//Called on the watch thread, which is blocked until it returns, so it can do slow work such as building pipelines
+typedef void (*ShaderWatchCallback)(void *userData);
+
+typedef struct _ShaderWatch {
+	int inotifyFd;
+	//destroyShaderWatch writes to the second descriptor to wake the thread up
+	int stopPipe[2];
+	pthread_t thread;
+
+	ShaderWatchCallback callback;
+	void *userData;
+} ShaderWatch;
+
+//Watches directory with inotify and calls callback whenever .spv files in it were written or moved in. Returns false
+//when the directory cannot be watched
+bool initShaderWatch(ShaderWatch *watch, const char *directory, ShaderWatchCallback callback, void *userData);
+//Waits for a callback in progress to return
+void destroyShaderWatch(ShaderWatch *watch);
+
+#endif
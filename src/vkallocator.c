@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "vkallocator.h"
+#include "vktools.h"
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+//True if the end of resource A and the start of resource B fall on the same page
+static bool onSamePage(VkDeviceSize offsetA, VkDeviceSize sizeA, VkDeviceSize offsetB, VkDeviceSize pageSize)
+{
+	VkDeviceSize endPageA = (offsetA + sizeA - 1) & ~(pageSize - 1);
+	VkDeviceSize startPageB = offsetB & ~(pageSize - 1);
+	return endPageA == startPageB;
+}
+
+static MemoryChunk * createChunk(VkDeviceSize offset, VkDeviceSize size)
+{
+	MemoryChunk *chunk = malloc(sizeof(MemoryChunk));
+	chunk->offset = offset;
+	chunk->size = size;
+	chunk->free = true;
+	chunk->linear = true;
+	chunk->prev = NULL;
+	chunk->next = NULL;
+	return chunk;
+}
+
+static MemoryBlock * createBlock(Allocator *allocator, uint32_t memoryTypeIndex, VkDeviceSize size)
+{
+	if (allocator->deviceAllocationCount >= allocator->maxAllocationCount)
+		return NULL;
+
+	VkMemoryAllocateInfo memAllocInfo = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.pNext = NULL,
+		.allocationSize = size,
+		.memoryTypeIndex = memoryTypeIndex
+	};
+
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(allocator->device, &memAllocInfo, NULL, &memory) != VK_SUCCESS)
+		return NULL;
+
+	MemoryBlock *block = malloc(sizeof(MemoryBlock));
+	block->memory = memory;
+	block->size = size;
+	block->used = 0;
+	block->memoryTypeIndex = memoryTypeIndex;
+	block->allocationCount = 0;
+	block->mapped = NULL;
+	block->chunks = createChunk(0, size);
+
+	if (allocator->memoryProps.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		VK_CHECK(vkMapMemory(allocator->device, memory, 0, VK_WHOLE_SIZE, 0, &block->mapped));
+
+	block->next = allocator->blocks[memoryTypeIndex];
+	allocator->blocks[memoryTypeIndex] = block;
+	allocator->deviceAllocationCount++;
+
+	return block;
+}
+
+static void destroyBlock(Allocator *allocator, MemoryBlock *block)
+{
+	MemoryChunk *chunk = block->chunks;
+	while (chunk != NULL)
+	{
+		MemoryChunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+
+	if (block->mapped != NULL)
+		vkUnmapMemory(allocator->device, block->memory);
+
+	vkFreeMemory(allocator->device, block->memory, NULL);
+	allocator->deviceAllocationCount--;
+	free(block);
+}
+
+//First fit over the free chunks of a block, splitting off the alignment padding and the remainder
+static MemoryChunk * allocateFromBlock(Allocator *allocator, MemoryBlock *block, VkMemoryRequirements memReqs,
+		bool linear)
+{
+	VkDeviceSize granularity = allocator->bufferImageGranularity;
+
+	for (MemoryChunk *chunk = block->chunks; chunk != NULL; chunk = chunk->next)
+	{
+		if (!chunk->free || chunk->size < memReqs.size)
+			continue;
+
+		VkDeviceSize offset = alignUp(chunk->offset, memReqs.alignment);
+
+		//Linear and optimal resources may not share a bufferImageGranularity page
+		MemoryChunk *prev = chunk->prev;
+		if (prev != NULL && prev->linear != linear && onSamePage(prev->offset, prev->size, offset, granularity))
+			offset = alignUp(offset, granularity);
+
+		VkDeviceSize padding = offset - chunk->offset;
+		if (padding + memReqs.size > chunk->size)
+			continue;
+
+		MemoryChunk *next = chunk->next;
+		if (next != NULL && next->linear != linear && onSamePage(offset, memReqs.size, next->offset, granularity))
+			continue;
+
+		if (padding > 0)
+		{
+			MemoryChunk *paddingChunk = createChunk(chunk->offset, padding);
+			paddingChunk->prev = prev;
+			paddingChunk->next = chunk;
+			if (prev != NULL)
+				prev->next = paddingChunk;
+			else
+				block->chunks = paddingChunk;
+			chunk->prev = paddingChunk;
+
+			chunk->offset = offset;
+			chunk->size -= padding;
+		}
+
+		if (chunk->size > memReqs.size)
+		{
+			MemoryChunk *remainder = createChunk(offset + memReqs.size, chunk->size - memReqs.size);
+			remainder->prev = chunk;
+			remainder->next = next;
+			if (next != NULL)
+				next->prev = remainder;
+			chunk->next = remainder;
+
+			chunk->size = memReqs.size;
+		}
+
+		chunk->free = false;
+		chunk->linear = linear;
+
+		block->used += chunk->size;
+		block->allocationCount++;
+
+		return chunk;
+	}
+
+	return NULL;
+}
+
+void initAllocator(Allocator *allocator, VkDevice device, VkPhysicalDeviceMemoryProperties memoryProps,
+		VkPhysicalDeviceLimits limits)
+{
+	allocator->device = device;
+	allocator->memoryProps = memoryProps;
+	allocator->bufferImageGranularity = limits.bufferImageGranularity > 0 ? limits.bufferImageGranularity : 1;
+	allocator->blockSize = ALLOCATOR_BLOCK_SIZE;
+	allocator->maxAllocationCount = limits.maxMemoryAllocationCount;
+	allocator->deviceAllocationCount = 0;
+
+	for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; ++i)
+		allocator->blocks[i] = NULL;
+}
+
+bool allocateMemory(Allocator *allocator, VkMemoryRequirements memReqs, VkFlags requirementsMask, bool linear,
+		Allocation *allocation)
+{
+	uint32_t memoryTypeIndex;
+	if (!getMemoryTypeIndex(allocator->memoryProps, memReqs.memoryTypeBits, requirementsMask, &memoryTypeIndex))
+		return false;
+
+	MemoryBlock *block;
+	MemoryChunk *chunk = NULL;
+
+	for (block = allocator->blocks[memoryTypeIndex]; block != NULL; block = block->next)
+	{
+		if (block->size - block->used < memReqs.size)
+			continue;
+
+		chunk = allocateFromBlock(allocator, block, memReqs, linear);
+		if (chunk != NULL)
+			break;
+	}
+
+	if (chunk == NULL)
+	{
+		VkDeviceSize blockSize = allocator->blockSize;
+		if (memReqs.size > blockSize)
+			blockSize = memReqs.size;
+
+		block = createBlock(allocator, memoryTypeIndex, blockSize);
+		if (block == NULL)
+			return false;
+
+		chunk = allocateFromBlock(allocator, block, memReqs, linear);
+	}
+
+	allocation->memory = block->memory;
+	allocation->offset = chunk->offset;
+	allocation->size = chunk->size;
+	allocation->mapped = block->mapped != NULL ? (char *) block->mapped + chunk->offset : NULL;
+	allocation->block = block;
+	allocation->chunk = chunk;
+
+	return true;
+}
+
+void allocateBufferMemory(Allocator *allocator, VkBuffer buffer, VkFlags requirementsMask, Allocation *allocation)
+{
+	VkMemoryRequirements memReqs;
+	vkGetBufferMemoryRequirements(allocator->device, buffer, &memReqs);
+
+	if (!allocateMemory(allocator, memReqs, requirementsMask, true, allocation))
+		ERR_EXIT("Unable to allocate memory for buffer.\nExiting...\n");
+
+	VK_CHECK(vkBindBufferMemory(allocator->device, buffer, allocation->memory, allocation->offset));
+}
+
+void allocateImageMemory(Allocator *allocator, VkImage image, VkImageTiling tiling, VkFlags requirementsMask,
+		Allocation *allocation)
+{
+	VkMemoryRequirements memReqs;
+	vkGetImageMemoryRequirements(allocator->device, image, &memReqs);
+
+	if (!allocateMemory(allocator, memReqs, requirementsMask, tiling == VK_IMAGE_TILING_LINEAR, allocation))
+		ERR_EXIT("Unable to allocate memory for image.\nExiting...\n");
+
+	VK_CHECK(vkBindImageMemory(allocator->device, image, allocation->memory, allocation->offset));
+}
+
+void freeMemory(Allocator *allocator, Allocation *allocation)
+{
+	MemoryBlock *block = allocation->block;
+	MemoryChunk *chunk = allocation->chunk;
+
+	if (block == NULL)
+		return;
+
+	chunk->free = true;
+	block->used -= chunk->size;
+	block->allocationCount--;
+
+	MemoryChunk *next = chunk->next;
+	if (next != NULL && next->free)
+	{
+		chunk->size += next->size;
+		chunk->next = next->next;
+		if (next->next != NULL)
+			next->next->prev = chunk;
+		free(next);
+	}
+
+	MemoryChunk *prev = chunk->prev;
+	if (prev != NULL && prev->free)
+	{
+		prev->size += chunk->size;
+		prev->next = chunk->next;
+		if (chunk->next != NULL)
+			chunk->next->prev = prev;
+		free(chunk);
+	}
+
+	//Oversized blocks only ever hold the one resource they were made for
+	if (block->allocationCount == 0 && block->size > allocator->blockSize)
+	{
+		MemoryBlock **link = &allocator->blocks[block->memoryTypeIndex];
+		while (*link != block)
+			link = &(*link)->next;
+		*link = block->next;
+
+		destroyBlock(allocator, block);
+	}
+
+	allocation->block = NULL;
+	allocation->chunk = NULL;
+	allocation->memory = VK_NULL_HANDLE;
+	allocation->mapped = NULL;
+}
+
+void printAllocatorStats(Allocator *allocator)
+{
+	printf("Device memory allocations: %u of %u\n", allocator->deviceAllocationCount,
+			allocator->maxAllocationCount);
+
+	for (uint32_t i = 0; i < allocator->memoryProps.memoryTypeCount; ++i)
+	{
+		if (allocator->blocks[i] == NULL)
+			continue;
+
+		uint32_t blockCount = 0;
+		uint32_t allocationCount = 0;
+		uint32_t freeRangeCount = 0;
+		VkDeviceSize totalSize = 0;
+		VkDeviceSize usedSize = 0;
+		VkDeviceSize largestFree = 0;
+
+		for (MemoryBlock *block = allocator->blocks[i]; block != NULL; block = block->next)
+		{
+			blockCount++;
+			allocationCount += block->allocationCount;
+			totalSize += block->size;
+			usedSize += block->used;
+
+			for (MemoryChunk *chunk = block->chunks; chunk != NULL; chunk = chunk->next)
+			{
+				if (!chunk->free)
+					continue;
+
+				freeRangeCount++;
+				if (chunk->size > largestFree)
+					largestFree = chunk->size;
+			}
+		}
+
+		VkDeviceSize freeSize = totalSize - usedSize;
+
+		//0 when all free space is one contiguous range, approaching 1 as it gets split up
+		double fragmentation = freeSize > 0 ? 1.0 - (double) largestFree / freeSize : 0.0;
+
+		printf("  Memory type %u (flags 0x%x): %u blocks, %u allocations, %llu / %llu KiB used, "
+				"%u free ranges, largest free %llu KiB, fragmentation %.2f\n",
+				i, allocator->memoryProps.memoryTypes[i].propertyFlags, blockCount, allocationCount,
+				(unsigned long long) usedSize / 1024, (unsigned long long) totalSize / 1024,
+				freeRangeCount, (unsigned long long) largestFree / 1024, fragmentation);
+	}
+}
+
+void destroyAllocator(Allocator *allocator)
+{
+	for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; ++i)
+	{
+		MemoryBlock *block = allocator->blocks[i];
+		while (block != NULL)
+		{
+			MemoryBlock *next = block->next;
+			if (block->allocationCount > 0)
+				printf("Warning: destroying memory block with %u live allocations.\n", block->allocationCount);
+			destroyBlock(allocator, block);
+			block = next;
+		}
+
+		allocator->blocks[i] = NULL;
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef VKALLOCATOR_H
+#define VKALLOCATOR_H
+
+#include <stdbool.h>
+
+#include <vulkan/vulkan.h>
+
+//Size of the device memory blocks requested from the driver, larger requests get a block of their own
+#define ALLOCATOR_BLOCK_SIZE (64 * 1024 * 1024)
+
+typedef struct _MemoryChunk {
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	bool free;
+	//Buffers and linear images are "linear", optimal tiling images are not
+	bool linear;
+	struct _MemoryChunk *prev;
+	struct _MemoryChunk *next;
+} MemoryChunk;
+
+typedef struct _MemoryBlock {
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+	VkDeviceSize used;
+	uint32_t memoryTypeIndex;
+	uint32_t allocationCount;
+	//Host visible blocks stay mapped for their whole lifetime
+	void *mapped;
+	//Every byte of the block is covered by exactly one chunk, sorted by offset
+	MemoryChunk *chunks;
+	struct _MemoryBlock *next;
+} MemoryBlock;
+
+typedef struct _Allocation {
+	VkDeviceMemory memory;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	void *mapped;
+	MemoryBlock *block;
+	MemoryChunk *chunk;
+} Allocation;
+
+typedef struct _Allocator {
+	VkDevice device;
+	VkPhysicalDeviceMemoryProperties memoryProps;
+	VkDeviceSize bufferImageGranularity;
+	VkDeviceSize blockSize;
+	uint32_t maxAllocationCount;
+	uint32_t deviceAllocationCount;
+	MemoryBlock *blocks[VK_MAX_MEMORY_TYPES];
+} Allocator;
+
+void initAllocator(Allocator *allocator, VkDevice device, VkPhysicalDeviceMemoryProperties memoryProps,
+		VkPhysicalDeviceLimits limits);
+
+bool allocateMemory(Allocator *allocator, VkMemoryRequirements memReqs, VkFlags requirementsMask, bool linear,
+		Allocation *allocation);
+void allocateBufferMemory(Allocator *allocator, VkBuffer buffer, VkFlags requirementsMask, Allocation *allocation);
+void allocateImageMemory(Allocator *allocator, VkImage image, VkImageTiling tiling, VkFlags requirementsMask,
+		Allocation *allocation);
+void freeMemory(Allocator *allocator, Allocation *allocation);
+
+void printAllocatorStats(Allocator *allocator);
+
+void destroyAllocator(Allocator *allocator);
+
+#endif
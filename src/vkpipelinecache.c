@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vkpipelinecache.h"
+#include "vktools.h"
+
+static void * readFile(const char *path, size_t *size)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+		return NULL;
+
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	rewind(file);
+
+	void *data = NULL;
+	if (length > 0)
+	{
+		data = malloc(length);
+		if (fread(data, 1, length, file) != (size_t) length)
+		{
+			free(data);
+			data = NULL;
+		}
+	}
+
+	fclose(file);
+	*size = data != NULL ? (size_t) length : 0;
+	return data;
+}
+
+//Data written by another driver or GPU is useless at best, so it is rejected before the driver sees it
+static bool isCompatible(PipelineCache *pipelineCache, const void *data, size_t size)
+{
+	PipelineCacheHeader header;
+	if (size < sizeof(header))
+		return false;
+
+	memcpy(&header, data, sizeof(header));
+
+	return header.headerLength >= sizeof(header) &&
+		header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+		header.vendorID == pipelineCache->deviceProps.vendorID &&
+		header.deviceID == pipelineCache->deviceProps.deviceID &&
+		!memcmp(header.pipelineCacheUUID, pipelineCache->deviceProps.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+static VkPipelineCache createCache(VkDevice device, const void *data, size_t size)
+{
+	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.initialDataSize = size,
+		.pInitialData = data
+	};
+
+	VkPipelineCache cache;
+	VK_CHECK(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, NULL, &cache));
+	return cache;
+}
+
+void initPipelineCache(PipelineCache *pipelineCache, VkDevice device, VkPhysicalDeviceProperties deviceProps,
+		const char *path)
+{
+	pipelineCache->device = device;
+	pipelineCache->deviceProps = deviceProps;
+	pipelineCache->path = path;
+	pipelineCache->loadedSize = 0;
+
+	size_t size = 0;
+	void *data = path != NULL ? readFile(path, &size) : NULL;
+
+	if (data != NULL && !isCompatible(pipelineCache, data, size))
+	{
+		printf("Ignoring pipeline cache %s, it was written by a different device or driver.\n", path);
+		free(data);
+		data = NULL;
+		size = 0;
+	}
+
+	pipelineCache->cache = createCache(device, data, size);
+	pipelineCache->loadedSize = size;
+
+	if (data != NULL)
+		printf("Loaded %zu bytes of pipeline cache from %s.\n", size, path);
+
+	free(data);
+}
+
+void savePipelineCache(PipelineCache *pipelineCache)
+{
+	if (pipelineCache->path == NULL)
+		return;
+
+	//Pick up whatever another instance wrote since startup so concurrent runs do not throw each other's work away
+	size_t diskSize = 0;
+	void *diskData = readFile(pipelineCache->path, &diskSize);
+	if (diskData != NULL && isCompatible(pipelineCache, diskData, diskSize))
+	{
+		VkPipelineCache diskCache = createCache(pipelineCache->device, diskData, diskSize);
+		VK_CHECK(vkMergePipelineCaches(pipelineCache->device, pipelineCache->cache, 1, &diskCache));
+		vkDestroyPipelineCache(pipelineCache->device, diskCache, NULL);
+	}
+	free(diskData);
+
+	size_t size;
+	VK_CHECK(vkGetPipelineCacheData(pipelineCache->device, pipelineCache->cache, &size, NULL));
+	void *data = malloc(size);
+	VK_CHECK(vkGetPipelineCacheData(pipelineCache->device, pipelineCache->cache, &size, data));
+
+	//Write next to the real file and rename, a crash mid-write must not leave a truncated cache behind
+	char tmpPath[1024];
+	snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", pipelineCache->path);
+
+	FILE *file = fopen(tmpPath, "wb");
+	if (file == NULL)
+	{
+		printf("Unable to write pipeline cache to %s.\n", tmpPath);
+		free(data);
+		return;
+	}
+
+	bool written = fwrite(data, 1, size, file) == size;
+	written = fclose(file) == 0 && written;
+
+	if (written && rename(tmpPath, pipelineCache->path) == 0)
+		printf("Saved %zu bytes of pipeline cache to %s.\n", size, pipelineCache->path);
+	else
+	{
+		printf("Unable to write pipeline cache to %s.\n", pipelineCache->path);
+		remove(tmpPath);
+	}
+
+	free(data);
+}
+
+void destroyPipelineCache(PipelineCache *pipelineCache)
+{
+	vkDestroyPipelineCache(pipelineCache->device, pipelineCache->cache, NULL);
+	pipelineCache->cache = VK_NULL_HANDLE;
+}
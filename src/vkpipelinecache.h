@@ -0,0 +1,33 @@
+#ifndef VKPIPELINECACHE_H
+#define VKPIPELINECACHE_H
+
+#include <stdbool.h>
+
+#include <vulkan/vulkan.h>
+
+#define PIPELINE_CACHE_PATH "pipeline_cache.bin"
+
+//Layout of the header every driver writes at the start of vkGetPipelineCacheData
+typedef struct _PipelineCacheHeader {
+	uint32_t headerLength;
+	uint32_t headerVersion;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+} PipelineCacheHeader;
+
+typedef struct _PipelineCache {
+	VkDevice device;
+	VkPhysicalDeviceProperties deviceProps;
+	VkPipelineCache cache;
+	const char *path;
+	//Size of the data that was accepted from disk, 0 when the cache started out empty
+	size_t loadedSize;
+} PipelineCache;
+
+void initPipelineCache(PipelineCache *pipelineCache, VkDevice device, VkPhysicalDeviceProperties deviceProps,
+		const char *path);
+void savePipelineCache(PipelineCache *pipelineCache);
+void destroyPipelineCache(PipelineCache *pipelineCache);
+
+#endif
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vkpipelineregistry.h"
+#include "framestats.h"
+
+#define PIPELINE_REGISTRY_INITIAL_CAPACITY 16
+
+//FNV-1a over the key words
+static uint32_t hashKey(const PipelineKey *key)
+{
+	const uint8_t *bytes = (const uint8_t *) key;
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < sizeof(PipelineKey); ++i)
+		hash = (hash ^ bytes[i]) * 16777619u;
+
+	return hash;
+}
+
+//The slot holding key, or the empty slot it would go into
+static PipelineRegistryEntry * findEntry(PipelineRegistryEntry *entries, uint32_t capacity, const PipelineKey *key)
+{
+	uint32_t slot = hashKey(key) & (capacity - 1);
+	while (entries[slot].pipeline != VK_NULL_HANDLE && memcmp(&entries[slot].key, key, sizeof(PipelineKey)) != 0)
+		slot = (slot + 1) & (capacity - 1);
+
+	return &entries[slot];
+}
+
+static void grow(PipelineRegistry *registry)
+{
+	uint32_t capacity = registry->capacity * 2;
+	PipelineRegistryEntry *entries = calloc(capacity, sizeof(PipelineRegistryEntry));
+
+	for (uint32_t i = 0; i < registry->capacity; ++i)
+	{
+		if (registry->entries[i].pipeline != VK_NULL_HANDLE)
+			*findEntry(entries, capacity, &registry->entries[i].key) = registry->entries[i];
+	}
+
+	free(registry->entries);
+	registry->entries = entries;
+	registry->capacity = capacity;
+}
+
+void initPipelineRegistry(PipelineRegistry *registry, VkDevice device, PipelineBuildFunction build, void *userData)
+{
+	registry->device = device;
+	registry->build = build;
+	registry->userData = userData;
+
+	registry->capacity = PIPELINE_REGISTRY_INITIAL_CAPACITY;
+	registry->entries = calloc(registry->capacity, sizeof(PipelineRegistryEntry));
+	registry->count = 0;
+
+	registry->hits = registry->misses = 0;
+	registry->buildTime = 0.0;
+}
+
+//Stores a pipeline for a key the registry does not hold yet
+static void insertEntry(PipelineRegistry *registry, const PipelineKey *key, VkPipeline pipeline)
+{
+	if (2 * (registry->count + 1) > registry->capacity)
+		grow(registry);
+
+	PipelineRegistryEntry *entry = findEntry(registry->entries, registry->capacity, key);
+	entry->key = *key;
+	entry->pipeline = pipeline;
+	registry->count++;
+}
+
+VkPipeline getPipeline(PipelineRegistry *registry, const PipelineKey *key)
+{
+	PipelineRegistryEntry *entry = findEntry(registry->entries, registry->capacity, key);
+	if (entry->pipeline != VK_NULL_HANDLE)
+	{
+		registry->hits++;
+		return entry->pipeline;
+	}
+
+	if (!prefetchPipelines(registry, key, 1))
+		return VK_NULL_HANDLE;
+
+	return findEntry(registry->entries, registry->capacity, key)->pipeline;
+}
+
+bool prefetchPipelines(PipelineRegistry *registry, const PipelineKey *keys, uint32_t count)
+{
+	PipelineKey *missing = malloc(count * sizeof(PipelineKey));
+	uint32_t missingCount = 0;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (findEntry(registry->entries, registry->capacity, &keys[i])->pipeline != VK_NULL_HANDLE)
+			continue;
+
+		//The same key twice would be built twice
+		bool duplicate = false;
+		for (uint32_t j = 0; j < missingCount && !duplicate; ++j)
+			duplicate = memcmp(&missing[j], &keys[i], sizeof(PipelineKey)) == 0;
+		if (!duplicate)
+			missing[missingCount++] = keys[i];
+	}
+
+	bool built = true;
+	if (missingCount > 0)
+	{
+		VkPipeline *pipelines = malloc(missingCount * sizeof(VkPipeline));
+
+		double start = getTime();
+		built = registry->build(registry->userData, missing, missingCount, pipelines);
+		registry->buildTime += getTime() - start;
+		registry->misses += missingCount;
+
+		//Nothing is stored on failure, the next lookup tries again
+		for (uint32_t i = 0; i < missingCount && built; ++i)
+			insertEntry(registry, &missing[i], pipelines[i]);
+
+		free(pipelines);
+	}
+
+	free(missing);
+	return built;
+}
+
+void printPipelineRegistryStats(PipelineRegistry *registry)
+{
+	printf("Pipeline registry: %u variants, %u lookups served from the registry, %.3f ms building\n",
+			registry->count, registry->hits, 1000.0 * registry->buildTime);
+}
+
+void destroyPipelineRegistry(PipelineRegistry *registry)
+{
+	for (uint32_t i = 0; i < registry->capacity; ++i)
+	{
+		if (registry->entries[i].pipeline != VK_NULL_HANDLE)
+			vkDestroyPipeline(registry->device, registry->entries[i].pipeline, NULL);
+	}
+
+	free(registry->entries);
+	registry->entries = NULL;
+	registry->capacity = registry->count = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef VKPIPELINEREGISTRY_H
+#define VKPIPELINEREGISTRY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <vulkan/vulkan.h>
+
+#define PIPELINE_KEY_CONSTANTS 4
+
+//Everything that tells two pipelines apart. Hashed and compared as raw words, so it must stay free of padding
+typedef struct _PipelineKey {
+	//Caller defined id of the shaders, vertex layout and fixed function state
+	uint32_t program;
+	//Caller defined use within the render pass, such as depth only
+	uint32_t pass;
+	//Specialization constant values, index i is constant_id i
+	uint32_t constants[PIPELINE_KEY_CONSTANTS];
+} PipelineKey;
+
+//Creates the pipelines for count keys the registry has not seen yet, all at once so they can share driver calls.
+//Returns false with every pipeline it created destroyed again if any of them cannot be built
+typedef bool (*PipelineBuildFunction)(void *userData, const PipelineKey *keys, uint32_t count, VkPipeline *pipelines);
+
+typedef struct _PipelineRegistryEntry {
+	PipelineKey key;
+	//VK_NULL_HANDLE marks an empty slot
+	VkPipeline pipeline;
+} PipelineRegistryEntry;
+
+//Owns every variant built through it. Not synchronized, a thread building pipelines of its own, such as a shader
+//reload, uses a registry of its own
+typedef struct _PipelineRegistry {
+	VkDevice device;
+	PipelineBuildFunction build;
+	void *userData;
+
+	//Open addressing with linear probing, capacity is a power of two and never more than half used
+	PipelineRegistryEntry *entries;
+	uint32_t capacity;
+	uint32_t count;
+
+	uint32_t hits;
+	uint32_t misses;
+	//Seconds spent in build
+	double buildTime;
+} PipelineRegistry;
+
+void initPipelineRegistry(PipelineRegistry *registry, VkDevice device, PipelineBuildFunction build, void *userData);
+//Returns the pipeline for key, building it on first use. VK_NULL_HANDLE if the build failed
+VkPipeline getPipeline(PipelineRegistry *registry, const PipelineKey *key);
+//Builds every key the registry does not hold yet with a single call of build, so a whole set of pipelines can be
+//batched instead of built one lookup at a time. Returns false and stores nothing if the build failed
+bool prefetchPipelines(PipelineRegistry *registry, const PipelineKey *keys, uint32_t count);
+void printPipelineRegistryStats(PipelineRegistry *registry);
+//Destroys every pipeline the registry holds
+void destroyPipelineRegistry(PipelineRegistry *registry);
+
+#endif
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "vkprofiler.h"
+#include "vktools.h"
+
+static uint32_t getQueryIndex(GpuProfiler *profiler, uint32_t slot, uint32_t region)
+{
+	return (slot * profiler->regionCount + region) * 2;
+}
+
+void initGpuProfiler(GpuProfiler *profiler, VkDevice device, VkPhysicalDeviceLimits limits,
+		VkQueueFamilyProperties queueProps)
+{
+	profiler->device = device;
+	profiler->timestampPeriod = limits.timestampPeriod;
+	profiler->timestampMask = queueProps.timestampValidBits >= 64 ?
+		UINT64_MAX : (1ull << queueProps.timestampValidBits) - 1;
+
+	//vkCmdResetQueryPool needs a graphics or compute queue, pure transfer queues cannot be profiled on 1.0
+	profiler->enabled = queueProps.timestampValidBits > 0 &&
+		(queueProps.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+
+	profiler->queryPool = VK_NULL_HANDLE;
+	profiler->slotCount = 0;
+	profiler->slotSubmitted = NULL;
+	profiler->regionCount = 0;
+}
+
+uint32_t addGpuProfilerRegion(GpuProfiler *profiler, const char *name)
+{
+	if (profiler->regionCount == PROFILER_MAX_REGIONS)
+		ERR_EXIT("Too many GPU profiler regions.\nExiting...\n");
+
+	GpuProfilerRegion *region = &profiler->regions[profiler->regionCount];
+	region->name = name;
+	region->total = 0.0;
+	region->samples = 0;
+
+	return profiler->regionCount++;
+}
+
+void setGpuProfilerSlots(GpuProfiler *profiler, uint32_t slotCount)
+{
+	if (profiler->queryPool != VK_NULL_HANDLE)
+		vkDestroyQueryPool(profiler->device, profiler->queryPool, NULL);
+	free(profiler->slotSubmitted);
+
+	profiler->queryPool = VK_NULL_HANDLE;
+	profiler->slotCount = slotCount;
+	profiler->slotSubmitted = calloc(slotCount, sizeof(bool));
+
+	if (!profiler->enabled || slotCount == 0 || profiler->regionCount == 0)
+		return;
+
+	VkQueryPoolCreateInfo queryPoolInfo = {
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.queryType = VK_QUERY_TYPE_TIMESTAMP,
+		.queryCount = slotCount * profiler->regionCount * 2,
+		.pipelineStatistics = 0
+	};
+
+	VK_CHECK(vkCreateQueryPool(profiler->device, &queryPoolInfo, NULL, &profiler->queryPool));
+}
+
+void gpuProfilerReset(GpuProfiler *profiler, VkCommandBuffer cmdBuffer, uint32_t slot)
+{
+	if (profiler->queryPool == VK_NULL_HANDLE)
+		return;
+
+	vkCmdResetQueryPool(cmdBuffer, profiler->queryPool, getQueryIndex(profiler, slot, 0),
+			profiler->regionCount * 2);
+}
+
+void gpuProfilerBegin(GpuProfiler *profiler, VkCommandBuffer cmdBuffer, uint32_t slot, uint32_t region)
+{
+	if (profiler->queryPool == VK_NULL_HANDLE)
+		return;
+
+	vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profiler->queryPool,
+			getQueryIndex(profiler, slot, region));
+}
+
+void gpuProfilerEnd(GpuProfiler *profiler, VkCommandBuffer cmdBuffer, uint32_t slot, uint32_t region)
+{
+	if (profiler->queryPool == VK_NULL_HANDLE)
+		return;
+
+	vkCmdWriteTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler->queryPool,
+			getQueryIndex(profiler, slot, region) + 1);
+}
+
+void gpuProfilerSubmitted(GpuProfiler *profiler, uint32_t slot)
+{
+	if (profiler->queryPool != VK_NULL_HANDLE)
+		profiler->slotSubmitted[slot] = true;
+}
+
+void gpuProfilerCollect(GpuProfiler *profiler, uint32_t slot)
+{
+	if (profiler->queryPool == VK_NULL_HANDLE || !profiler->slotSubmitted[slot])
+		return;
+
+	uint64_t timestamps[PROFILER_MAX_REGIONS * 2];
+
+	//No WAIT bit, the caller guarantees completion and a stall here would defeat the point
+	VkResult result = vkGetQueryPoolResults(profiler->device, profiler->queryPool, getQueryIndex(profiler, slot, 0),
+			profiler->regionCount * 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	profiler->slotSubmitted[slot] = false;
+
+	//Regions that were never written in this slot leave the whole set unavailable
+	if (result == VK_NOT_READY)
+		return;
+	VK_CHECK(result);
+
+	for (uint32_t i = 0; i < profiler->regionCount; ++i)
+	{
+		uint64_t ticks = (timestamps[i * 2 + 1] - timestamps[i * 2]) & profiler->timestampMask;
+		profiler->regions[i].total += ticks * profiler->timestampPeriod / 1000000.0;
+		profiler->regions[i].samples++;
+	}
+}
+
+double getGpuProfilerTime(GpuProfiler *profiler, uint32_t region)
+{
+	GpuProfilerRegion *profilerRegion = &profiler->regions[region];
+	return profilerRegion->samples > 0 ? profilerRegion->total / profilerRegion->samples : 0.0;
+}
+
+void resetGpuProfilerTimes(GpuProfiler *profiler)
+{
+	for (uint32_t i = 0; i < profiler->regionCount; ++i)
+	{
+		profiler->regions[i].total = 0.0;
+		profiler->regions[i].samples = 0;
+	}
+}
+
+void printGpuProfiler(GpuProfiler *profiler)
+{
+	if (profiler->queryPool == VK_NULL_HANDLE)
+		return;
+
+	for (uint32_t i = 0; i < profiler->regionCount; ++i)
+	{
+		GpuProfilerRegion *region = &profiler->regions[i];
+		if (region->samples > 0)
+			printf("%s%s: %.3f ms", i > 0 ? ", " : "GPU time ", region->name, region->total / region->samples);
+		else
+			printf("%s%s: -", i > 0 ? ", " : "GPU time ", region->name);
+
+		region->total = 0.0;
+		region->samples = 0;
+	}
+
+	printf("\n");
+}
+
+void destroyGpuProfiler(GpuProfiler *profiler)
+{
+	if (profiler->queryPool != VK_NULL_HANDLE)
+		vkDestroyQueryPool(profiler->device, profiler->queryPool, NULL);
+	free(profiler->slotSubmitted);
+
+	profiler->queryPool = VK_NULL_HANDLE;
+	profiler->slotSubmitted = NULL;
+	profiler->slotCount = 0;
+}
@@ -0,0 +1,57 @@
+#ifndef VKPROFILER_H
+#define VKPROFILER_H
+
+#include <stdbool.h>
+
+#include <vulkan/vulkan.h>
+
+#define PROFILER_MAX_REGIONS 8
+
+typedef struct _GpuProfilerRegion {
+	const char *name;
+	double total;
+	uint32_t samples;
+} GpuProfilerRegion;
+
+//Timestamp pairs per region, one set of them per slot. A slot is whatever unit the caller re-submits once the
+//previous use has finished on the GPU (a swapchain image's command buffer, a staging batch), so results can be
+//read back without waiting.
+typedef struct _GpuProfiler {
+	VkDevice device;
+	//False when the queue family cannot write or reset timestamps, every call is a no-op then
+	bool enabled;
+	double timestampPeriod;
+	uint64_t timestampMask;
+
+	VkQueryPool queryPool;
+	uint32_t slotCount;
+	bool *slotSubmitted;
+
+	GpuProfilerRegion regions[PROFILER_MAX_REGIONS];
+	uint32_t regionCount;
+} GpuProfiler;
+
+void initGpuProfiler(GpuProfiler *profiler, VkDevice device, VkPhysicalDeviceLimits limits,
+		VkQueueFamilyProperties queueProps);
+uint32_t addGpuProfilerRegion(GpuProfiler *profiler, const char *name);
+//Recreates the query pool, regions have to be added before this
+void setGpuProfilerSlots(GpuProfiler *profiler, uint32_t slotCount);
+
+void gpuProfilerReset(GpuProfiler *profiler, VkCommandBuffer cmdBuffer, uint32_t slot);
+void gpuProfilerBegin(GpuProfiler *profiler, VkCommandBuffer cmdBuffer, uint32_t slot, uint32_t region);
+void gpuProfilerEnd(GpuProfiler *profiler, VkCommandBuffer cmdBuffer, uint32_t slot, uint32_t region);
+
+void gpuProfilerSubmitted(GpuProfiler *profiler, uint32_t slot);
+//Call once the slot's previous submission is known to be complete, before it is submitted again
+void gpuProfilerCollect(GpuProfiler *profiler, uint32_t slot);
+
+//Average GPU milliseconds of a region since the last reset, 0 if nothing was collected
+double getGpuProfilerTime(GpuProfiler *profiler, uint32_t region);
+void resetGpuProfilerTimes(GpuProfiler *profiler);
+
+//Prints the average GPU time of every region since the last call and starts over
+void printGpuProfiler(GpuProfiler *profiler);
+
+void destroyGpuProfiler(GpuProfiler *profiler);
+
+#endif
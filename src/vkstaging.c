@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vkstaging.h"
+#include "vktools.h"
+
+//Uploads are read as vertex and index data, or by the culling compute pass
+#define STAGING_DST_STAGES (VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+#define STAGING_DST_ACCESS (VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT)
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+//Hands the space of every finished batch back to the ring, strictly in submission order
+static void retireBatches(StagingRing *ring)
+{
+	while (ring->batches[ring->oldestBatch].pending)
+	{
+		StagingBatch *batch = &ring->batches[ring->oldestBatch];
+		if (vkGetFenceStatus(ring->device, batch->fence) != VK_SUCCESS)
+			break;
+		if (ring->ownershipTransfer &&
+				(batch->acquirePending || vkGetFenceStatus(ring->device, batch->acquireFence) != VK_SUCCESS))
+			break;
+
+		if (ring->profiler != NULL)
+			gpuProfilerCollect(ring->profiler, ring->oldestBatch);
+
+		ring->tail = batch->end;
+		batch->pending = false;
+		ring->oldestBatch = (ring->oldestBatch + 1) % STAGING_MAX_BATCHES;
+	}
+
+	//Nothing in flight and nothing recorded, start over at the front of the ring
+	if (!ring->batches[ring->oldestBatch].pending &&
+			(!ring->recording || ring->batches[ring->currentBatch].copyCount == 0))
+		ring->head = ring->tail = 0;
+}
+
+static void waitOldestBatch(StagingRing *ring)
+{
+	StagingBatch *batch = &ring->batches[ring->oldestBatch];
+	if (!batch->pending)
+		ERR_EXIT("Staging upload does not fit in the staging ring.\nExiting...\n");
+
+	ring->stallCount++;
+	VK_CHECK(vkWaitForFences(ring->device, 1, &batch->fence, VK_TRUE, UINT64_MAX));
+
+	//The ring space is only free once the graphics queue has taken ownership as well
+	if (ring->ownershipTransfer)
+	{
+		if (batch->acquirePending)
+			stagingSubmitAcquires(ring);
+		VK_CHECK(vkWaitForFences(ring->device, 1, &batch->acquireFence, VK_TRUE, UINT64_MAX));
+	}
+
+	retireBatches(ring);
+}
+
+static void beginBatch(StagingRing *ring)
+{
+	StagingBatch *batch = &ring->batches[ring->currentBatch];
+
+	//Every batch is in flight, the oldest one has to finish before its command buffer can be reused
+	while (batch->pending)
+		waitOldestBatch(ring);
+
+	VK_CHECK(vkResetFences(ring->device, 1, &batch->fence));
+
+	VkCommandBufferBeginInfo cmdBufferInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.pNext = NULL,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		.pInheritanceInfo = NULL
+	};
+
+	VK_CHECK(vkBeginCommandBuffer(batch->cmdBuffer, &cmdBufferInfo));
+
+	if (ring->profiler != NULL)
+	{
+		gpuProfilerReset(ring->profiler, batch->cmdBuffer, ring->currentBatch);
+		gpuProfilerBegin(ring->profiler, batch->cmdBuffer, ring->currentBatch, 0);
+	}
+
+	batch->copyCount = 0;
+	batch->barrierCount = 0;
+	ring->recording = true;
+}
+
+//Queues a release/acquire barrier pair for a copied range, extending the previous one when they are contiguous
+static void addOwnershipBarrier(StagingBatch *batch, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+		uint32_t srcQueueFamilyIndex, uint32_t dstQueueFamilyIndex)
+{
+	if (batch->barrierCount > 0)
+	{
+		VkBufferMemoryBarrier *last = &batch->barriers[batch->barrierCount - 1];
+		if (last->buffer == buffer && last->offset + last->size == offset)
+		{
+			last->size += size;
+			return;
+		}
+	}
+
+	if (batch->barrierCount == batch->barrierCapacity)
+	{
+		batch->barrierCapacity = batch->barrierCapacity > 0 ? batch->barrierCapacity * 2 : 16;
+		batch->barriers = realloc(batch->barriers, batch->barrierCapacity * sizeof(VkBufferMemoryBarrier));
+	}
+
+	VkBufferMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.pNext = NULL,
+		.srcAccessMask = 0,
+		.dstAccessMask = 0,
+		.srcQueueFamilyIndex = srcQueueFamilyIndex,
+		.dstQueueFamilyIndex = dstQueueFamilyIndex,
+		.buffer = buffer,
+		.offset = offset,
+		.size = size
+	};
+
+	batch->barriers[batch->barrierCount++] = barrier;
+}
+
+static VkDeviceSize reserve(StagingRing *ring, VkDeviceSize size)
+{
+	for (;;)
+	{
+		VkDeviceSize offset = alignUp(ring->head, STAGING_ALIGNMENT);
+
+		//Never let head catch up with tail from below, head == tail means the ring is empty
+		if (ring->head >= ring->tail)
+		{
+			if (offset + size <= ring->size)
+				return offset;
+			if (size < ring->tail)
+				return 0;
+		}
+		else if (offset + size < ring->tail)
+		{
+			return offset;
+		}
+
+		//Out of space, make sure the copies recorded so far are on their way before blocking on them
+		if (ring->recording && ring->batches[ring->currentBatch].copyCount > 0)
+		{
+			stagingFlush(ring);
+			beginBatch(ring);
+		}
+
+		waitOldestBatch(ring);
+	}
+}
+
+void initStagingRing(StagingRing *ring, VkDevice device, Allocator *allocator, VkQueue queue,
+		uint32_t queueFamilyIndex, VkQueue graphicsQueue, uint32_t graphicsQueueFamilyIndex, VkDeviceSize size)
+{
+	memset(ring, 0, sizeof(StagingRing));
+	ring->device = device;
+	ring->queue = queue;
+	ring->queueFamilyIndex = queueFamilyIndex;
+	ring->graphicsQueue = graphicsQueue;
+	ring->graphicsQueueFamilyIndex = graphicsQueueFamilyIndex;
+	ring->ownershipTransfer = queueFamilyIndex != graphicsQueueFamilyIndex;
+	ring->size = size;
+
+	VkBufferCreateInfo bufferInfo = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.size = size,
+		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = 0,
+		.pQueueFamilyIndices = NULL
+	};
+
+	VK_CHECK(vkCreateBuffer(device, &bufferInfo, NULL, &ring->buffer));
+	allocateBufferMemory(allocator, ring->buffer,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &ring->memory);
+
+	VkCommandPoolCreateInfo cmdPoolInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.pNext = NULL,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		.queueFamilyIndex = queueFamilyIndex
+	};
+
+	VK_CHECK(vkCreateCommandPool(device, &cmdPoolInfo, NULL, &ring->cmdPool));
+
+	VkCommandBufferAllocateInfo cmdBufferAllocInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.pNext = NULL,
+		.commandPool = ring->cmdPool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1
+	};
+
+	VkFenceCreateInfo fenceInfo = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0
+	};
+
+	for (uint32_t i = 0; i < STAGING_MAX_BATCHES; ++i)
+	{
+		VK_CHECK(vkAllocateCommandBuffers(device, &cmdBufferAllocInfo, &ring->batches[i].cmdBuffer));
+		VK_CHECK(vkCreateFence(device, &fenceInfo, NULL, &ring->batches[i].fence));
+	}
+
+	if (!ring->ownershipTransfer)
+		return;
+
+	cmdPoolInfo.queueFamilyIndex = graphicsQueueFamilyIndex;
+	VK_CHECK(vkCreateCommandPool(device, &cmdPoolInfo, NULL, &ring->acquireCmdPool));
+	cmdBufferAllocInfo.commandPool = ring->acquireCmdPool;
+
+	VkSemaphoreCreateInfo semaphoreInfo = {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0
+	};
+
+	for (uint32_t i = 0; i < STAGING_MAX_BATCHES; ++i)
+	{
+		VK_CHECK(vkAllocateCommandBuffers(device, &cmdBufferAllocInfo, &ring->batches[i].acquireCmdBuffer));
+		VK_CHECK(vkCreateFence(device, &fenceInfo, NULL, &ring->batches[i].acquireFence));
+		VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, NULL, &ring->batches[i].semaphore));
+	}
+}
+
+//Must be set before the first upload, the profiler needs one slot per batch
+void stagingSetProfiler(StagingRing *ring, GpuProfiler *profiler)
+{
+	ring->profiler = profiler;
+	if (profiler != NULL)
+		setGpuProfilerSlots(profiler, STAGING_MAX_BATCHES);
+}
+
+void stagingUpload(StagingRing *ring, VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data,
+		VkDeviceSize size)
+{
+	//Large uploads go through in pieces so the GPU can start copying while the rest is written
+	VkDeviceSize maxPiece = ring->size / 4;
+
+	while (size > 0)
+	{
+		VkDeviceSize pieceSize = size < maxPiece ? size : maxPiece;
+
+		if (!ring->recording)
+			beginBatch(ring);
+
+		VkDeviceSize offset = reserve(ring, pieceSize);
+		memcpy((char *) ring->memory.mapped + offset, data, pieceSize);
+		ring->head = offset + pieceSize;
+
+		StagingBatch *batch = &ring->batches[ring->currentBatch];
+
+		VkBufferCopy copyRegion = {
+			.srcOffset = offset,
+			.dstOffset = dstOffset,
+			.size = pieceSize
+		};
+
+		vkCmdCopyBuffer(batch->cmdBuffer, ring->buffer, dstBuffer, 1, &copyRegion);
+		batch->copyCount++;
+
+		if (ring->ownershipTransfer)
+			addOwnershipBarrier(batch, dstBuffer, dstOffset, pieceSize, ring->queueFamilyIndex,
+					ring->graphicsQueueFamilyIndex);
+		batch->end = ring->head;
+
+		ring->bytesUploaded += pieceSize;
+		data = (const char *) data + pieceSize;
+		dstOffset += pieceSize;
+		size -= pieceSize;
+	}
+}
+
+static void recordOwnershipTransfer(StagingBatch *batch)
+{
+	//Release on the transfer queue, the destination stage and access are ignored here
+	for (uint32_t i = 0; i < batch->barrierCount; ++i)
+	{
+		batch->barriers[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		batch->barriers[i].dstAccessMask = 0;
+	}
+
+	vkCmdPipelineBarrier(batch->cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, NULL, batch->barrierCount, batch->barriers, 0, NULL);
+
+	//Matching acquire on the graphics queue, after the semaphore wait made the copies available
+	for (uint32_t i = 0; i < batch->barrierCount; ++i)
+	{
+		batch->barriers[i].srcAccessMask = 0;
+		batch->barriers[i].dstAccessMask = STAGING_DST_ACCESS;
+	}
+
+	VkCommandBufferBeginInfo cmdBufferInfo = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.pNext = NULL,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		.pInheritanceInfo = NULL
+	};
+
+	VK_CHECK(vkBeginCommandBuffer(batch->acquireCmdBuffer, &cmdBufferInfo));
+	vkCmdPipelineBarrier(batch->acquireCmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, STAGING_DST_STAGES, 0, 0, NULL,
+			batch->barrierCount, batch->barriers, 0, NULL);
+	VK_CHECK(vkEndCommandBuffer(batch->acquireCmdBuffer));
+}
+
+void stagingFlush(StagingRing *ring)
+{
+	if (!ring->recording)
+		return;
+
+	StagingBatch *batch = &ring->batches[ring->currentBatch];
+
+	if (ring->profiler != NULL)
+		gpuProfilerEnd(ring->profiler, batch->cmdBuffer, ring->currentBatch, 0);
+
+	if (ring->ownershipTransfer)
+	{
+		recordOwnershipTransfer(batch);
+	}
+	else
+	{
+		//Make the copies visible to vertex input of anything submitted after this batch
+		VkMemoryBarrier memoryBarrier = {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.pNext = NULL,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = STAGING_DST_ACCESS
+		};
+
+		vkCmdPipelineBarrier(batch->cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, STAGING_DST_STAGES, 0, 1,
+				&memoryBarrier, 0, NULL, 0, NULL);
+	}
+
+	VK_CHECK(vkEndCommandBuffer(batch->cmdBuffer));
+
+	VkSubmitInfo submitInfo = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = NULL,
+		.waitSemaphoreCount = 0,
+		.pWaitSemaphores = NULL,
+		.pWaitDstStageMask = NULL,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &batch->cmdBuffer,
+		.signalSemaphoreCount = ring->ownershipTransfer ? 1 : 0,
+		.pSignalSemaphores = ring->ownershipTransfer ? &batch->semaphore : NULL
+	};
+
+	VK_CHECK(vkQueueSubmit(ring->queue, 1, &submitInfo, batch->fence));
+	if (ring->profiler != NULL)
+		gpuProfilerSubmitted(ring->profiler, ring->currentBatch);
+
+	batch->end = ring->head;
+	batch->pending = true;
+	batch->acquirePending = ring->ownershipTransfer;
+	ring->recording = false;
+	ring->currentBatch = (ring->currentBatch + 1) % STAGING_MAX_BATCHES;
+}
+
+//Hands every flushed batch over to the graphics queue, must run before graphics work that reads the uploads
+void stagingSubmitAcquires(StagingRing *ring)
+{
+	if (!ring->ownershipTransfer)
+		return;
+
+	VkPipelineStageFlags waitStage = STAGING_DST_STAGES;
+
+	for (uint32_t i = 0; i < STAGING_MAX_BATCHES; ++i)
+	{
+		StagingBatch *batch = &ring->batches[(ring->oldestBatch + i) % STAGING_MAX_BATCHES];
+		if (!batch->pending)
+			break;
+		if (!batch->acquirePending)
+			continue;
+
+		VkSubmitInfo submitInfo = {
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.pNext = NULL,
+			.waitSemaphoreCount = 1,
+			.pWaitSemaphores = &batch->semaphore,
+			.pWaitDstStageMask = &waitStage,
+			.commandBufferCount = 1,
+			.pCommandBuffers = &batch->acquireCmdBuffer,
+			.signalSemaphoreCount = 0,
+			.pSignalSemaphores = NULL
+		};
+
+		VK_CHECK(vkResetFences(ring->device, 1, &batch->acquireFence));
+		VK_CHECK(vkQueueSubmit(ring->graphicsQueue, 1, &submitInfo, batch->acquireFence));
+		batch->acquirePending = false;
+	}
+}
+
+void stagingWaitIdle(StagingRing *ring)
+{
+	stagingFlush(ring);
+
+	while (ring->batches[ring->oldestBatch].pending)
+		waitOldestBatch(ring);
+}
+
+void destroyStagingRing(StagingRing *ring, Allocator *allocator)
+{
+	stagingWaitIdle(ring);
+
+	for (uint32_t i = 0; i < STAGING_MAX_BATCHES; ++i)
+	{
+		vkDestroyFence(ring->device, ring->batches[i].fence, NULL);
+		free(ring->batches[i].barriers);
+
+		if (ring->ownershipTransfer)
+		{
+			vkDestroyFence(ring->device, ring->batches[i].acquireFence, NULL);
+			vkDestroySemaphore(ring->device, ring->batches[i].semaphore, NULL);
+		}
+	}
+
+	vkDestroyCommandPool(ring->device, ring->cmdPool, NULL);
+	if (ring->ownershipTransfer)
+		vkDestroyCommandPool(ring->device, ring->acquireCmdPool, NULL);
+
+	vkDestroyBuffer(ring->device, ring->buffer, NULL);
+	freeMemory(allocator, &ring->memory);
+}
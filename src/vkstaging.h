@@ -0,0 +1,77 @@
+#ifndef VKSTAGING_H
+#define VKSTAGING_H
+
+#include <stdbool.h>
+
+#include <vulkan/vulkan.h>
+
+#include "vkallocator.h"
+#include "vkprofiler.h"
+
+#define STAGING_RING_SIZE (16 * 1024 * 1024)
+#define STAGING_MAX_BATCHES 8
+#define STAGING_ALIGNMENT 16
+
+//One submission worth of copies, its region of the ring is recycled once the fence signals
+typedef struct _StagingBatch {
+	VkCommandBuffer cmdBuffer;
+	VkFence fence;
+	VkDeviceSize end;
+	uint32_t copyCount;
+	bool pending;
+
+	//Only used when uploads run on a separate queue family and ownership has to be handed to graphics
+	VkSemaphore semaphore;
+	VkCommandBuffer acquireCmdBuffer;
+	VkFence acquireFence;
+	VkBufferMemoryBarrier *barriers;
+	uint32_t barrierCount;
+	uint32_t barrierCapacity;
+	bool acquirePending;
+} StagingBatch;
+
+typedef struct _StagingRing {
+	VkDevice device;
+	VkQueue queue;
+	uint32_t queueFamilyIndex;
+	VkCommandPool cmdPool;
+
+	VkQueue graphicsQueue;
+	uint32_t graphicsQueueFamilyIndex;
+	VkCommandPool acquireCmdPool;
+	bool ownershipTransfer;
+
+	VkBuffer buffer;
+	Allocation memory;
+	VkDeviceSize size;
+
+	//Writes go at head, everything from tail up to head is still owned by the GPU
+	VkDeviceSize head;
+	VkDeviceSize tail;
+
+	StagingBatch batches[STAGING_MAX_BATCHES];
+	uint32_t currentBatch;
+	uint32_t oldestBatch;
+	bool recording;
+
+	VkDeviceSize bytesUploaded;
+	uint32_t stallCount;
+
+	//Optional, times every batch on the upload queue with one slot per batch
+	GpuProfiler *profiler;
+} StagingRing;
+
+void initStagingRing(StagingRing *ring, VkDevice device, Allocator *allocator, VkQueue queue,
+		uint32_t queueFamilyIndex, VkQueue graphicsQueue, uint32_t graphicsQueueFamilyIndex, VkDeviceSize size);
+
+void stagingSetProfiler(StagingRing *ring, GpuProfiler *profiler);
+
+void stagingUpload(StagingRing *ring, VkBuffer dstBuffer, VkDeviceSize dstOffset, const void *data,
+		VkDeviceSize size);
+void stagingFlush(StagingRing *ring);
+void stagingSubmitAcquires(StagingRing *ring);
+void stagingWaitIdle(StagingRing *ring);
+
+void destroyStagingRing(StagingRing *ring, Allocator *allocator);
+
+#endif
@@ -1,3 +1,7 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "vkswapchain.h"
 #include "vktools.h"
 
@@ -15,12 +19,87 @@
 		ERR_EXIT("vkGetDeviceProcAddr failed to find vk" #entrypoint ".\nExiting...\n"); \
 }
 
-void loadInstanceFunctions(Swapchain *swapchain, VkInstance instance)
+static const char *presentProfileNames[PRESENT_PROFILE_COUNT] = {
+	[PRESENT_PROFILE_LOW_LATENCY] = "low-latency",
+	[PRESENT_PROFILE_POWER_SAVING] = "power-saving",
+	[PRESENT_PROFILE_UNCAPPED] = "uncapped"
+};
+
+#define MAX_PRESENT_MODE_PREFERENCES 3
+
+typedef struct _PresentModePreferences {
+	uint32_t count;
+	VkPresentModeKHR modes[MAX_PRESENT_MODE_PREFERENCES];
+} PresentModePreferences;
+
+//Tried in order, FIFO is last everywhere because it is the only mode every implementation must support
+static const PresentModePreferences presentModePreferences[PRESENT_PROFILE_COUNT] = {
+	[PRESENT_PROFILE_LOW_LATENCY] = { 3, { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR,
+		VK_PRESENT_MODE_FIFO_KHR } },
+	[PRESENT_PROFILE_POWER_SAVING] = { 1, { VK_PRESENT_MODE_FIFO_KHR } },
+	[PRESENT_PROFILE_UNCAPPED] = { 3, { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR,
+		VK_PRESENT_MODE_FIFO_KHR } }
+};
+
+const char * getPresentProfileName(PresentProfile profile)
+{
+	return profile < PRESENT_PROFILE_COUNT ? presentProfileNames[profile] : "unknown";
+}
+
+const char * getPresentModeName(VkPresentModeKHR mode)
+{
+	switch (mode) {
+		case VK_PRESENT_MODE_IMMEDIATE_KHR: return "IMMEDIATE";
+		case VK_PRESENT_MODE_MAILBOX_KHR: return "MAILBOX";
+		case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+		case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+		default: return "UNKNOWN";
+	}
+}
+
+bool parsePresentProfile(const char *name, PresentProfile *profile)
+{
+	for (uint32_t i = 0; i < PRESENT_PROFILE_COUNT; ++i) {
+		if (!strcmp(name, presentProfileNames[i])) {
+			*profile = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void initSwapchainInstance(Swapchain *swapchain, VkInstance instance, VkPhysicalDevice physicalDevice)
+{
+	swapchain->instance = instance;
+	swapchain->physicalDevice = physicalDevice;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &swapchain->memoryProps);
+	swapchain->reportedProfile = PRESENT_PROFILE_COUNT;
+
+	if (swapchain->headless) {
+		swapchain->format = VK_FORMAT_B8G8R8A8_UNORM;
+		swapchain->presentLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	} else {
+		swapchain->presentLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		loadInstanceFunctions(swapchain);
+	}
+}
+
+void initSwapchainDevice(Swapchain *swapchain, VkDevice device, VkQueue queue)
 {
-	GET_INSTANCE_PROC_ADDR(vkData, GetPhysicalDeviceSurfaceSupportKHR);
-	GET_INSTANCE_PROC_ADDR(vkData, GetPhysicalDeviceSurfaceCapabilitiesKHR);
-	GET_INSTANCE_PROC_ADDR(vkData, GetPhysicalDeviceSurfaceFormatsKHR);
-	GET_INSTANCE_PROC_ADDR(vkData, GetPhysicalDeviceSurfacePresentModesKHR);
+	swapchain->device = device;
+	swapchain->queue = queue;
+
+	if (!swapchain->headless)
+		loadDeviceFunctions(swapchain);
+}
+
+void loadInstanceFunctions(Swapchain *swapchain)
+{
+	GET_INSTANCE_PROC_ADDR(swapchain, swapchain->instance, GetPhysicalDeviceSurfaceSupportKHR);
+	GET_INSTANCE_PROC_ADDR(swapchain, swapchain->instance, GetPhysicalDeviceSurfaceCapabilitiesKHR);
+	GET_INSTANCE_PROC_ADDR(swapchain, swapchain->instance, GetPhysicalDeviceSurfaceFormatsKHR);
+	GET_INSTANCE_PROC_ADDR(swapchain, swapchain->instance, GetPhysicalDeviceSurfacePresentModesKHR);
 	//GET_INSTANCE_PROC_ADDR(vkData, CreateSwapchainKHR);
 	//GET_INSTANCE_PROC_ADDR(vkData, DestroySwapchainKHR);
 	//GET_INSTANCE_PROC_ADDR(vkData, GetSwapchainImagesKHR);
@@ -28,13 +107,13 @@ void loadInstanceFunctions(Swapchain *swapchain, VkInstance instance)
 	//GET_INSTANCE_PROC_ADDR(vkData, QueuePresentKHR);
 }
 
-void loadDeviceFunctions(Swapchain *swapchain, VkDevice device)
+void loadDeviceFunctions(Swapchain *swapchain)
 {
-	GET_DEVICE_PROC_ADDR(vkData, CreateSwapchainKHR);
-	GET_DEVICE_PROC_ADDR(vkData, DestroySwapchainKHR);
-	GET_DEVICE_PROC_ADDR(vkData, GetSwapchainImagesKHR);
-	GET_DEVICE_PROC_ADDR(vkData, AcquireNextImageKHR);
-	GET_DEVICE_PROC_ADDR(vkData, QueuePresentKHR);
+	GET_DEVICE_PROC_ADDR(swapchain, swapchain->device, CreateSwapchainKHR);
+	GET_DEVICE_PROC_ADDR(swapchain, swapchain->device, DestroySwapchainKHR);
+	GET_DEVICE_PROC_ADDR(swapchain, swapchain->device, GetSwapchainImagesKHR);
+	GET_DEVICE_PROC_ADDR(swapchain, swapchain->device, AcquireNextImageKHR);
+	GET_DEVICE_PROC_ADDR(swapchain, swapchain->device, QueuePresentKHR);
 }
 
 void createSurface(Swapchain *swapchain, GLFWwindow *window)
@@ -63,16 +142,21 @@ void createSurface(Swapchain *swapchain, GLFWwindow *window)
 uint32_t getSwapchainQueueIndex(Swapchain *swapchain)
 {
 	uint32_t queueCount;
-	vkGetPhysicalDeviceQueueFamilyProperties(swapchain->physicalDevice, queueCount, NULL);
+	vkGetPhysicalDeviceQueueFamilyProperties(swapchain->physicalDevice, &queueCount, NULL);
 	if(queueCount == 0) ERR_EXIT("No device queue was found.\nExiting...\n");
 
 	VkQueueFamilyProperties *queueProps = malloc(queueCount * sizeof(VkQueueFamilyProperties));
-	vkGetPhysicalDeviceQueueFamilyProperties(swapchain->physicalDevice, queueCount, queueProps);
+	vkGetPhysicalDeviceQueueFamilyProperties(swapchain->physicalDevice, &queueCount, queueProps);
 
+	//Without a surface every graphics queue can "present"
 	VkBool32 *supportsPresent = malloc(queueCount * sizeof(VkBool32));
-	for (uint32_t i = 0; i < queueCount; ++i)
-		swapchain->fpGetPhysicalDeviceSurfaceSupportKHR(swapchain->physicalDevice, i, swapchain->surface,
-				&supportsPresent[i]);
+	for (uint32_t i = 0; i < queueCount; ++i) {
+		if (swapchain->headless)
+			supportsPresent[i] = VK_TRUE;
+		else
+			swapchain->fpGetPhysicalDeviceSurfaceSupportKHR(swapchain->physicalDevice, i, swapchain->surface,
+					&supportsPresent[i]);
+	}
 
 	uint32_t graphicsQueueNodeIndex = UINT32_MAX;
 	uint32_t presentQueueNodeIndex = UINT32_MAX;
@@ -112,12 +196,149 @@ uint32_t getSwapchainQueueIndex(Swapchain *swapchain)
 	return graphicsQueueNodeIndex;
 }
 
+static void setupHeadlessBuffers(Swapchain *swapchain)
+{
+	swapchain->imageCount = HEADLESS_IMAGE_COUNT;
+	swapchain->buffers = malloc(swapchain->imageCount * sizeof(SwapchainBuffers));
+
+	VkImageCreateInfo imageInfo = {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = swapchain->format,
+		.extent = {
+			.width = swapchain->width,
+			.height = swapchain->height,
+			.depth = 1 },
+		.mipLevels = 1,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.queueFamilyIndexCount = 0,
+		.pQueueFamilyIndices = NULL,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+	};
+
+	VkMemoryRequirements memReqs;
+	VkMemoryAllocateInfo memAllocInfo = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.pNext = NULL
+	};
+
+	for (uint32_t i = 0; i < swapchain->imageCount; ++i) {
+		VK_CHECK(vkCreateImage(swapchain->device, &imageInfo, NULL, &swapchain->buffers[i].image));
+
+		vkGetImageMemoryRequirements(swapchain->device, swapchain->buffers[i].image, &memReqs);
+		memAllocInfo.allocationSize = memReqs.size;
+		if (!getMemoryTypeIndex(swapchain->memoryProps, memReqs.memoryTypeBits,
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memAllocInfo.memoryTypeIndex))
+			ERR_EXIT("Unable to find suitable memory type for headless image.\nExiting...\n");
+
+		VK_CHECK(vkAllocateMemory(swapchain->device, &memAllocInfo, NULL, &swapchain->buffers[i].memory));
+		VK_CHECK(vkBindImageMemory(swapchain->device, swapchain->buffers[i].image, swapchain->buffers[i].memory,
+					0));
+	}
+}
+
+static void setupImageViews(Swapchain *swapchain)
+{
+	for (uint32_t i = 0; i < swapchain->imageCount; ++i) {
+		VkImageViewCreateInfo colorAttachmentView = {
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.pNext = NULL,
+			.flags = 0,
+			.image = swapchain->buffers[i].image,
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = swapchain->format,
+			.components = {
+				.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+				.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+				.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+				.a = VK_COMPONENT_SWIZZLE_IDENTITY },
+			.subresourceRange = {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = 0,
+				.levelCount = 1,
+				.baseArrayLayer = 0,
+				.layerCount = 1 }
+		};
+
+		VK_CHECK(vkCreateImageView(swapchain->device, &colorAttachmentView, NULL, &swapchain->buffers[i].view));
+	}
+}
+
+static VkPresentModeKHR choosePresentMode(Swapchain *swapchain)
+{
+	uint32_t presentModeCount;
+	VK_CHECK(swapchain->fpGetPhysicalDeviceSurfacePresentModesKHR(swapchain->physicalDevice, swapchain->surface,
+				&presentModeCount, NULL));
+
+	VkPresentModeKHR *presentModes = malloc(presentModeCount * sizeof(VkPresentModeKHR));
+	VK_CHECK(swapchain->fpGetPhysicalDeviceSurfacePresentModesKHR(swapchain->physicalDevice, swapchain->surface,
+				&presentModeCount, presentModes));
+
+	const PresentModePreferences *preferences = &presentModePreferences[swapchain->presentProfile];
+	VkPresentModeKHR chosenMode = VK_PRESENT_MODE_FIFO_KHR;
+	bool found = false;
+	for (uint32_t i = 0; i < preferences->count && !found; ++i) {
+		for (uint32_t j = 0; j < presentModeCount && !found; ++j) {
+			if (presentModes[j] == preferences->modes[i]) {
+				chosenMode = presentModes[j];
+				found = true;
+			}
+		}
+	}
+
+	free(presentModes);
+	return chosenMode;
+}
+
+static uint32_t chooseImageCount(VkPresentModeKHR presentMode, VkSurfaceCapabilitiesKHR *surfaceCapabilities)
+{
+	uint32_t imageCount;
+
+	switch (presentMode) {
+		//Mailbox needs one image on screen, one queued and one to render into or it degrades to FIFO
+		case VK_PRESENT_MODE_MAILBOX_KHR:
+			imageCount = surfaceCapabilities->minImageCount + 1;
+			if (imageCount < 3)
+				imageCount = 3;
+			break;
+		//Double buffering is enough when nothing waits for vblank
+		case VK_PRESENT_MODE_IMMEDIATE_KHR:
+			imageCount = surfaceCapabilities->minImageCount;
+			if (imageCount < 2)
+				imageCount = 2;
+			break;
+		//Fewer queued images keep the GPU idle longer between vblanks and cut latency under FIFO
+		default:
+			imageCount = surfaceCapabilities->minImageCount;
+			break;
+	}
+
+	if (surfaceCapabilities->maxImageCount > 0 && imageCount > surfaceCapabilities->maxImageCount)
+		imageCount = surfaceCapabilities->maxImageCount;
+
+	return imageCount;
+}
+
 void setupSwapchainBuffers(Swapchain *swapchain)
 {
+	swapchain->currentBuffer = 0;
+
+	if (swapchain->headless) {
+		setupHeadlessBuffers(swapchain);
+		setupImageViews(swapchain);
+		return;
+	}
+
 	VkSwapchainKHR oldSwapchain = swapchain->swapchain;
 
 	VkSurfaceCapabilitiesKHR surfaceCapabilities;
-	VK_CHECK(vkData->fpGetPhysicalDeviceSurfaceCapabilitiesKHR(swapchain->physicalDevice, swapchain->surface,
+	VK_CHECK(swapchain->fpGetPhysicalDeviceSurfaceCapabilitiesKHR(swapchain->physicalDevice, swapchain->surface,
 				&surfaceCapabilities));
 
 	VkExtent2D swapchainExtent;
@@ -130,25 +351,22 @@ void setupSwapchainBuffers(Swapchain *swapchain)
 		swapchain->height = surfaceCapabilities.currentExtent.height;
 	}
 
-	//printf("Creating surface, width: %u heiht: %u\n", vkData->width, vkData->height);
+	VkPresentModeKHR swapchainPresentMode = choosePresentMode(swapchain);
+	uint32_t desiredNumberOfSwapchainImages = chooseImageCount(swapchainPresentMode, &surfaceCapabilities);
 
-	/*uint32_t presentModeCount;
-	VK_CHECK(vkData->fpGetPhysicalDeviceSurfacePresentModesKHR(vkData->physicalDevice, vkData->surface,
-	&presentModeCount, NULL));
+	//Resizes recreate the swapchain for every event of a drag, the choice is only worth reporting once per profile
+	if (swapchain->presentProfile != swapchain->reportedProfile) {
+		VkPresentModeKHR preferredMode = presentModePreferences[swapchain->presentProfile].modes[0];
+		if (swapchainPresentMode != preferredMode)
+			printf("%s is not supported, falling back to %s.\n", getPresentModeName(preferredMode),
+					getPresentModeName(swapchainPresentMode));
 
-	VkPresentModeKHR *presentModes = malloc(presentModeCount * sizeof(VkPresentModeKHR));
-	VK_CHECK(vkData->fpGetPhysicalDeviceSurfacePresentModesKHR(vkData->physicalDevice, vkData->surface,
-	&presentModeCount, presentModes));*/
-
-	VkPresentModeKHR swapchainPresentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
-	//VkPresentModeKHR swapchainPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
-	//VkPresentModeKHR swapchainPresentMode = VK_PRESENT_MODE_FIFO_KHR;
-	//VkPresentModeKHR swapchainPresentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
-
-	uint32_t desiredNumberOfSwapchainImages = surfaceCapabilities.minImageCount + 1;
-	if (surfaceCapabilities.maxImageCount > 0 &&
-			desiredNumberOfSwapchainImages > surfaceCapabilities.maxImageCount)
-		desiredNumberOfSwapchainImages = surfaceCapabilities.maxImageCount;
+		printf("Present profile %s: %s with %u images requested.\n",
+				getPresentProfileName(swapchain->presentProfile), getPresentModeName(swapchainPresentMode),
+				desiredNumberOfSwapchainImages);
+		swapchain->reportedProfile = swapchain->presentProfile;
+	}
+	swapchain->presentMode = swapchainPresentMode;
 
 	VkSurfaceTransformFlagsKHR preTransform;
 	if (surfaceCapabilities.supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR)
@@ -192,47 +410,74 @@ void setupSwapchainBuffers(Swapchain *swapchain)
 
 	swapchain->buffers = malloc(swapchain->imageCount * sizeof(SwapchainBuffers));
 
-	for (uint32_t i = 0; i < vkData->swapchainImageCount; ++i) {
+	for (uint32_t i = 0; i < swapchain->imageCount; ++i) {
 		swapchain->buffers[i].image = swapchainImages[i];
-		//setImageLayout(vkData->setupCmdBuffer, vkData->buffers.images[i], VK_IMAGE_ASPECT_COLOR_BIT,
-		//VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+		swapchain->buffers[i].memory = VK_NULL_HANDLE;
+	}
 
-		VkImageViewCreateInfo colorAttachmentView = {
-			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+	setupImageViews(swapchain);
+
+	free(swapchainImages);
+}
+
+static bool isOutOfDate(VkResult result)
+{
+	return result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR;
+}
+
+VkResult acquireNextImage(Swapchain *swapchain, uint64_t timeout, VkSemaphore waitSemaphore, uint32_t *imageIndex)
+{
+	if (swapchain->headless) {
+		//Nothing to wait on, just signal the semaphore so the caller's submit can proceed
+		VkSubmitInfo submitInfo = {
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
 			.pNext = NULL,
-			.flags = 0,
-			.image = swapchain->buffers[i].image,
-			.viewType = VK_IMAGE_VIEW_TYPE_2D,
-			.format = swapchain->format,
-			.components = {
-				.r = VK_COMPONENT_SWIZZLE_IDENTITY,
-				.g = VK_COMPONENT_SWIZZLE_IDENTITY,
-				.b = VK_COMPONENT_SWIZZLE_IDENTITY,
-				.a = VK_COMPONENT_SWIZZLE_IDENTITY },
-			.subresourceRange = {
-				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-				.baseMipLevel = 0,
-				.levelCount = 1,
-				.baseArrayLayer = 0,
-				.layerCount = 1 }
+			.waitSemaphoreCount = 0,
+			.pWaitSemaphores = NULL,
+			.pWaitDstStageMask = NULL,
+			.commandBufferCount = 0,
+			.pCommandBuffers = NULL,
+			.signalSemaphoreCount = 1,
+			.pSignalSemaphores = &waitSemaphore
 		};
 
-		VK_CHECK(vkCreateImageView(device, &colorAttachmentView, NULL, &swapchain->buffers[i].view));
+		VK_CHECK(vkQueueSubmit(swapchain->queue, 1, &submitInfo, VK_NULL_HANDLE));
+		swapchain->currentBuffer = (swapchain->currentBuffer + 1) % swapchain->imageCount;
+		*imageIndex = swapchain->currentBuffer;
+		return VK_SUCCESS;
 	}
 
-	free(swapchainImages);
-}
+	VkResult result = swapchain->fpAcquireNextImageKHR(swapchain->device, swapchain->swapchain, timeout,
+			waitSemaphore, VK_NULL_HANDLE, &swapchain->currentBuffer);
+	if (!isOutOfDate(result))
+		VK_CHECK(result);
 
-uint32_t acquireNextImage(Swapchain *swapchain, uint64_t timeout, VkSemaphore waitSemaphore)
-{
-	VK_CHECK(swapchain->fpAcquireNextImageKHR(swapchain->device, swapchain->swapchain, timeout, waitSemaphore,
-				NULL, &swapchain->currentBuffer));
-	return swapchain->currentBuffer;
+	*imageIndex = swapchain->currentBuffer;
+	return result;
 }
 
-void presentQueue(Swapchain *swapchain, VkSemaphore waitSemaphore)
+VkResult presentQueue(Swapchain *swapchain, VkSemaphore waitSemaphore)
 {
-	VkPresntInfoKHR presentInfo = {
+	if (swapchain->headless) {
+		//Consume the render semaphore so it can be signaled again, there is no presentation engine to throttle us
+		VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		VkSubmitInfo submitInfo = {
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.pNext = NULL,
+			.waitSemaphoreCount = 1,
+			.pWaitSemaphores = &waitSemaphore,
+			.pWaitDstStageMask = &waitStage,
+			.commandBufferCount = 0,
+			.pCommandBuffers = NULL,
+			.signalSemaphoreCount = 0,
+			.pSignalSemaphores = NULL
+		};
+
+		VK_CHECK(vkQueueSubmit(swapchain->queue, 1, &submitInfo, VK_NULL_HANDLE));
+		return VK_SUCCESS;
+	}
+
+	VkPresentInfoKHR presentInfo = {
 		.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
 		.pNext = NULL,
 		.waitSemaphoreCount = 1,
@@ -243,47 +488,52 @@ void presentQueue(Swapchain *swapchain, VkSemaphore waitSemaphore)
 		.pResults = NULL
 	};
 
-	VK_CHECK(swapchain->fpQueuePresentKHR(swapchain->queue, &presentInfo));
+	VkResult result = swapchain->fpQueuePresentKHR(swapchain->queue, &presentInfo);
+	if (!isOutOfDate(result))
+		VK_CHECK(result);
+
+	return result;
 }
 
-void resizeSwapchain(Swapchain *swapchain)
+void resizeSwapchain(Swapchain *swapchain, uint32_t width, uint32_t height)
 {
-	printf("Resizing window.\n");
-	destroySwapchain(swapchain);
-
-	VK_CHECK(vkQueueWaitIdle(swapchain->queue));
+	printf("Resizing swapchain.\n");
 	VK_CHECK(vkDeviceWaitIdle(swapchain->device));
 
-	prepare(vkData);
+	destroySwapchainBuffers(swapchain);
+
+	swapchain->width = width;
+	swapchain->height = height;
+
+	setupSwapchainBuffers(swapchain);
 }
 
-void destroySwapchain(Swapchain *swapchain)
+void destroySwapchainBuffers(Swapchain *swapchain)
 {
-	for (uint32_t i = 0; i < vkData->swapchainImageCount; ++i)
-		vkDestroyFramebuffer(vkData->device, vkData->framebuffers[i], NULL);
+	for (uint32_t i = 0; i < swapchain->imageCount; ++i) {
+		vkDestroyImageView(swapchain->device, swapchain->buffers[i].view, NULL);
 
-	if (vkData->setupCmdBuffer != VK_NULL_HANDLE)
-		vkFreeCommandBuffers(vkData->device, vkData->cmdPool, 1, &vkData->setupCmdBuffer);
-
-	vkFreeCommandBuffers(vkData->device, vkData->cmdPool, vkData->swapchainImageCount, vkData->buffers.cmdBuffers);
-	vkDestroyCommandPool(vkData->device, vkData->cmdPool, NULL);
+		if (swapchain->headless) {
+			vkDestroyImage(swapchain->device, swapchain->buffers[i].image, NULL);
+			vkFreeMemory(swapchain->device, swapchain->buffers[i].memory, NULL);
+		}
+	}
 
-	vkDestroyPipeline(vkData->device, vkData->pipeline, NULL);
-	vkDestroyRenderPass(vkData->device, vkData->renderPass, NULL);
+	free(swapchain->buffers);
+	swapchain->buffers = NULL;
+	swapchain->imageCount = 0;
+}
 
-	vkDestroyBuffer(vkData->device, vkData->vertices.buffer, NULL);
-	vkFreeMemory(vkData->device, vkData->vertices.memory, NULL);
+void destroySwapchain(Swapchain *swapchain)
+{
+	destroySwapchainBuffers(swapchain);
 
-	vkDestroyBuffer(vkData->device, vkData->indices.buffer, NULL);
-	vkFreeMemory(vkData->device, vkData->indices.memory, NULL);
-	
-	vkDestroySemaphore(vkData->device, vkData->semaphores.presentComplete, NULL);
-	vkDestroySemaphore(vkData->device, vkData->semaphores.renderComplete, NULL);
+	if (swapchain->headless)
+		return;
 
-	for (uint32_t i = 0; i < vkData->swapchainImageCount; ++i)
-		vkDestroyImageView(vkData->device, vkData->buffers.imageViews[i], NULL);
+	swapchain->fpDestroySwapchainKHR(swapchain->device, swapchain->swapchain, NULL);
+	swapchain->swapchain = VK_NULL_HANDLE;
 
-	free(vkData->buffers.images);
-	free(vkData->buffers.cmdBuffers);
-	free(vkData->buffers.imageViews);
+	vkDestroySurfaceKHR(swapchain->instance, swapchain->surface, NULL);
+	swapchain->surface = VK_NULL_HANDLE;
 }
@@ -1,15 +1,33 @@
 #ifndef VKSWAPCHAIN_H
 #define VKSWAPCHAIN_H
 
+#include <stdbool.h>
+
 #include <vulkan/vulkan.h>
 #include <GLFW/glfw3.h>
 
+//Number of offscreen images in the headless ring
+#define HEADLESS_IMAGE_COUNT 3
+
+//What the swapchain is tuned for, each maps to a preferred present mode and image count
+typedef enum _PresentProfile {
+	PRESENT_PROFILE_LOW_LATENCY,	//MAILBOX, newest frame wins, no tearing
+	PRESENT_PROFILE_POWER_SAVING,	//FIFO, capped at the refresh rate
+	PRESENT_PROFILE_UNCAPPED,	//IMMEDIATE, as fast as possible, may tear
+	PRESENT_PROFILE_COUNT
+} PresentProfile;
+
 typedef struct _SwapchainBuffers {
 	VkImage image;
 	VkImageView view;
+	//Only used by the headless backend, swapchain images are owned by the presentation engine
+	VkDeviceMemory memory;
 } SwapchainBuffers;
 
 typedef struct _Swapchain {
+	//Renders into a ring of device-local images instead of a window surface
+	bool headless;
+
 	VkSurfaceKHR surface;
 	VkFormat format;
 	VkColorSpaceKHR colorSpace;
@@ -17,13 +35,20 @@ typedef struct _Swapchain {
 	uint32_t imageCount;
 	uint32_t currentBuffer;
 
+	//Layout the images must be in when they are handed to presentQueue
+	VkImageLayout presentLayout;
+
+	//Requested profile and the mode that was actually picked for it on the last setupSwapchainBuffers
+	PresentProfile presentProfile;
+	VkPresentModeKHR presentMode;
+	//Profile the choice was last printed for, PRESENT_PROFILE_COUNT before the first setupSwapchainBuffers
+	PresentProfile reportedProfile;
+
 	uint32_t width;
 	uint32_t height;
 
 	VkFramebuffer *framebuffers;
-	SwapchainBuffers buffers;
-
-	VkPresentInfoKHR presentInfo;
+	SwapchainBuffers *buffers;
 
 	PFN_vkGetPhysicalDeviceSurfaceSupportKHR fpGetPhysicalDeviceSurfaceSupportKHR;
 	PFN_vkGetPhysicalDeviceSurfaceCapabilitiesKHR fpGetPhysicalDeviceSurfaceCapabilitiesKHR;
@@ -37,6 +62,7 @@ typedef struct _Swapchain {
 
 	VkInstance instance;
 	VkPhysicalDevice physicalDevice;
+	VkPhysicalDeviceMemoryProperties memoryProps;
 	VkDevice device;
 	VkQueue queue;
 } Swapchain;
@@ -50,12 +76,18 @@ void loadDeviceFunctions(Swapchain *swapchain);
 void createSurface(Swapchain *swapchain, GLFWwindow *window);
 uint32_t getSwapchainQueueIndex(Swapchain *swapchain);
 
+const char * getPresentProfileName(PresentProfile profile);
+const char * getPresentModeName(VkPresentModeKHR mode);
+bool parsePresentProfile(const char *name, PresentProfile *profile);
+
 void setupSwapchainBuffers(Swapchain *swapchain);
+void destroySwapchainBuffers(Swapchain *swapchain);
 
-uint32_t acquireNextImage(Swapchain *swapchain, uint64_t timeout, VkSeamphore waitSemaphore);
-void presentQueue(Swapchain *swapchain, VkSemaphore waitSemaphore);
+//Both return VK_ERROR_OUT_OF_DATE_KHR and VK_SUBOPTIMAL_KHR to the caller, any other failure is fatal
+VkResult acquireNextImage(Swapchain *swapchain, uint64_t timeout, VkSemaphore waitSemaphore, uint32_t *imageIndex);
+VkResult presentQueue(Swapchain *swapchain, VkSemaphore waitSemaphore);
 
-void resizeSwapchain(Swapchain *swapchain);
+void resizeSwapchain(Swapchain *swapchain, uint32_t width, uint32_t height);
 
 void destroySwapchain(Swapchain *swapchain);
 
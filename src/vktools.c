@@ -83,6 +83,8 @@ bool getMemoryTypeIndex(VkPhysicalDeviceMemoryProperties memoryProps, uint32_t t
 		}
 		typeBits >>= 1;
 	}
+
+	return false;
 }
 
 VkCommandBuffer getCommandBuffer(VkDevice device, VkCommandPool cmdPool, bool begin)
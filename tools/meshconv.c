@@ -0,0 +1,567 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#include "mesh.h"
+#include "meshopt.h"
+
+//Converts OBJ and PLY files into the binary mesh format loaded by vulkan-test with --mesh
+
+#define LINE_SIZE 4096
+
+typedef struct _FloatArray {
+	float *data;
+	size_t count;
+	size_t capacity;
+} FloatArray;
+
+typedef struct _IndexArray {
+	uint32_t *data;
+	size_t count;
+	size_t capacity;
+} IndexArray;
+
+//Everything read from the source file, positions and colors are 3 floats per vertex
+typedef struct _SourceMesh {
+	FloatArray positions;
+	FloatArray colors;
+	IndexArray indices;
+} SourceMesh;
+
+static void pushFloat(FloatArray *array, float value)
+{
+	if (array->count == array->capacity)
+	{
+		array->capacity = array->capacity > 0 ? 2 * array->capacity : 1024;
+		array->data = realloc(array->data, array->capacity * sizeof(float));
+	}
+
+	array->data[array->count++] = value;
+}
+
+static void pushIndex(IndexArray *array, uint32_t value)
+{
+	if (array->count == array->capacity)
+	{
+		array->capacity = array->capacity > 0 ? 2 * array->capacity : 1024;
+		array->data = realloc(array->data, array->capacity * sizeof(uint32_t));
+	}
+
+	array->data[array->count++] = value;
+}
+
+//Polygons are split into a fan around their first corner
+static void pushPolygon(SourceMesh *mesh, const uint32_t *corners, uint32_t cornerCount)
+{
+	for (uint32_t i = 2; i < cornerCount; ++i)
+	{
+		pushIndex(&mesh->indices, corners[0]);
+		pushIndex(&mesh->indices, corners[i - 1]);
+		pushIndex(&mesh->indices, corners[i]);
+	}
+}
+
+//Supports "v x y z [r g b]" and "f" with any number of corners, texture coordinates and normals are ignored
+static bool loadObj(SourceMesh *mesh, const char *path)
+{
+	FILE *file = fopen(path, "r");
+	if (file == NULL)
+	{
+		printf("Cannot open %s.\n", path);
+		return false;
+	}
+
+	char line[LINE_SIZE];
+	uint32_t corners[256];
+	bool hasColors = true;
+
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		if (line[0] == 'v' && line[1] == ' ')
+		{
+			float values[6];
+			int count = sscanf(line + 2, "%f %f %f %f %f %f", &values[0], &values[1], &values[2], &values[3],
+					&values[4], &values[5]);
+			if (count < 3)
+				continue;
+
+			for (int c = 0; c < 3; ++c)
+				pushFloat(&mesh->positions, values[c]);
+
+			//Colors are only kept if every vertex has them
+			hasColors = hasColors && count == 6;
+			for (int c = 0; c < 3; ++c)
+				pushFloat(&mesh->colors, count == 6 ? values[3 + c] : 1.0f);
+		}
+		else if (line[0] == 'f' && line[1] == ' ')
+		{
+			uint32_t cornerCount = 0;
+			uint32_t vertexCount = mesh->positions.count / 3;
+
+			for (char *token = strtok(line + 2, " \t\r\n"); token != NULL && cornerCount < 256;
+					token = strtok(NULL, " \t\r\n"))
+			{
+				long index = strtol(token, NULL, 10);
+				//Negative indices count back from the last vertex read so far
+				if (index < 0)
+					index += vertexCount + 1;
+				if (index < 1 || index > vertexCount)
+				{
+					printf("%s references vertex %s which does not exist.\n", path, token);
+					fclose(file);
+					return false;
+				}
+
+				corners[cornerCount++] = index - 1;
+			}
+
+			pushPolygon(mesh, corners, cornerCount);
+		}
+	}
+
+	fclose(file);
+
+	if (!hasColors)
+		mesh->colors.count = 0;
+
+	return true;
+}
+
+typedef enum _PlyType {
+	PLY_NONE,
+	PLY_INT8,
+	PLY_UINT8,
+	PLY_INT16,
+	PLY_UINT16,
+	PLY_INT32,
+	PLY_UINT32,
+	PLY_FLOAT32,
+	PLY_FLOAT64
+} PlyType;
+
+typedef struct _PlyProperty {
+	char name[64];
+	PlyType type;
+	//Only set for lists, the type of the element count in front of them
+	PlyType countType;
+} PlyProperty;
+
+typedef struct _PlyElement {
+	char name[64];
+	uint32_t count;
+	PlyProperty properties[32];
+	uint32_t propertyCount;
+} PlyElement;
+
+static PlyType parsePlyType(const char *name)
+{
+	static const struct {
+		const char *name;
+		PlyType type;
+	} types[] = {
+		{ "char", PLY_INT8 }, { "int8", PLY_INT8 },
+		{ "uchar", PLY_UINT8 }, { "uint8", PLY_UINT8 },
+		{ "short", PLY_INT16 }, { "int16", PLY_INT16 },
+		{ "ushort", PLY_UINT16 }, { "uint16", PLY_UINT16 },
+		{ "int", PLY_INT32 }, { "int32", PLY_INT32 },
+		{ "uint", PLY_UINT32 }, { "uint32", PLY_UINT32 },
+		{ "float", PLY_FLOAT32 }, { "float32", PLY_FLOAT32 },
+		{ "double", PLY_FLOAT64 }, { "float64", PLY_FLOAT64 }
+	};
+
+	for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i)
+	{
+		if (!strcmp(name, types[i].name))
+			return types[i].type;
+	}
+
+	return PLY_NONE;
+}
+
+//Reads one value of any type as a double, from text or little endian binary
+static bool readPlyValue(FILE *file, bool binary, PlyType type, double *value)
+{
+	if (!binary)
+		return fscanf(file, "%lf", value) == 1;
+
+	unsigned char bytes[8];
+	static const size_t sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+	if (fread(bytes, 1, sizes[type], file) != sizes[type])
+		return false;
+
+	switch (type)
+	{
+		case PLY_INT8: { int8_t v; memcpy(&v, bytes, 1); *value = v; break; }
+		case PLY_UINT8: { uint8_t v; memcpy(&v, bytes, 1); *value = v; break; }
+		case PLY_INT16: { int16_t v; memcpy(&v, bytes, 2); *value = v; break; }
+		case PLY_UINT16: { uint16_t v; memcpy(&v, bytes, 2); *value = v; break; }
+		case PLY_INT32: { int32_t v; memcpy(&v, bytes, 4); *value = v; break; }
+		case PLY_UINT32: { uint32_t v; memcpy(&v, bytes, 4); *value = v; break; }
+		case PLY_FLOAT32: { float v; memcpy(&v, bytes, 4); *value = v; break; }
+		case PLY_FLOAT64: { double v; memcpy(&v, bytes, 8); *value = v; break; }
+		default: return false;
+	}
+
+	return true;
+}
+
+//Supports ascii and binary_little_endian with x/y/z, optional red/green/blue and a vertex_indices face list
+static bool loadPly(SourceMesh *mesh, const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+	{
+		printf("Cannot open %s.\n", path);
+		return false;
+	}
+
+	char line[LINE_SIZE];
+	PlyElement elements[16];
+	uint32_t elementCount = 0;
+	bool binary = false;
+	bool valid = fgets(line, sizeof(line), file) != NULL && !strncmp(line, "ply", 3);
+
+	while (valid && fgets(line, sizeof(line), file) != NULL)
+	{
+		char word[3][64];
+		int count = sscanf(line, "%63s %63s %63s", word[0], word[1], word[2]);
+
+		if (count >= 1 && !strcmp(word[0], "end_header"))
+			break;
+
+		if (count >= 2 && !strcmp(word[0], "format"))
+		{
+			binary = !strcmp(word[1], "binary_little_endian");
+			valid = binary || !strcmp(word[1], "ascii");
+		}
+		else if (count == 3 && !strcmp(word[0], "element") && elementCount < 16)
+		{
+			PlyElement *element = &elements[elementCount++];
+			strcpy(element->name, word[1]);
+			element->count = strtoul(word[2], NULL, 10);
+			element->propertyCount = 0;
+		}
+		else if (count >= 3 && !strcmp(word[0], "property") && elementCount > 0)
+		{
+			PlyElement *element = &elements[elementCount - 1];
+			if (element->propertyCount == 32)
+				continue;
+
+			PlyProperty *property = &element->properties[element->propertyCount++];
+			if (!strcmp(word[1], "list"))
+			{
+				char typeName[64];
+				if (sscanf(line, "%*s %*s %*s %63s %63s", typeName, property->name) != 2)
+					valid = false;
+				property->countType = parsePlyType(word[2]);
+				property->type = parsePlyType(typeName);
+			}
+			else
+			{
+				strcpy(property->name, word[2]);
+				property->countType = PLY_NONE;
+				property->type = parsePlyType(word[1]);
+			}
+
+			valid = valid && property->type != PLY_NONE;
+		}
+	}
+
+	if (!valid)
+	{
+		printf("%s is not an ascii or little endian PLY file.\n", path);
+		fclose(file);
+		return false;
+	}
+
+	uint32_t vertexBase = 0;
+	bool hasColors = false;
+	uint32_t corners[256];
+
+	for (uint32_t e = 0; e < elementCount && valid; ++e)
+	{
+		PlyElement *element = &elements[e];
+		bool isVertex = !strcmp(element->name, "vertex");
+		bool isFace = !strcmp(element->name, "face");
+
+		if (isVertex)
+		{
+			vertexBase = mesh->positions.count / 3;
+			for (uint32_t p = 0; p < element->propertyCount; ++p)
+				hasColors = hasColors || !strcmp(element->properties[p].name, "red");
+		}
+
+		for (uint32_t i = 0; i < element->count && valid; ++i)
+		{
+			float position[3] = { 0.0f, 0.0f, 0.0f };
+			float color[3] = { 1.0f, 1.0f, 1.0f };
+
+			for (uint32_t p = 0; p < element->propertyCount && valid; ++p)
+			{
+				PlyProperty *property = &element->properties[p];
+				double value;
+
+				if (property->countType != PLY_NONE)
+				{
+					double listSize;
+					valid = readPlyValue(file, binary, property->countType, &listSize);
+					uint32_t cornerCount = 0;
+					for (uint32_t c = 0; c < (uint32_t) listSize && valid; ++c)
+					{
+						valid = readPlyValue(file, binary, property->type, &value);
+						if (cornerCount < 256)
+							corners[cornerCount++] = vertexBase + (uint32_t) value;
+					}
+
+					if (valid && isFace && (!strcmp(property->name, "vertex_indices") ||
+							!strcmp(property->name, "vertex_index")))
+						pushPolygon(mesh, corners, cornerCount);
+					continue;
+				}
+
+				valid = readPlyValue(file, binary, property->type, &value);
+
+				//Integer colors are 0-255, float colors already 0-1
+				float scale = property->type == PLY_FLOAT32 || property->type == PLY_FLOAT64 ? 1.0f : 1.0f / 255.0f;
+				if (!strcmp(property->name, "x"))
+					position[0] = value;
+				else if (!strcmp(property->name, "y"))
+					position[1] = value;
+				else if (!strcmp(property->name, "z"))
+					position[2] = value;
+				else if (!strcmp(property->name, "red"))
+					color[0] = value * scale;
+				else if (!strcmp(property->name, "green"))
+					color[1] = value * scale;
+				else if (!strcmp(property->name, "blue"))
+					color[2] = value * scale;
+			}
+
+			if (isVertex)
+			{
+				for (int c = 0; c < 3; ++c)
+				{
+					pushFloat(&mesh->positions, position[c]);
+					pushFloat(&mesh->colors, color[c]);
+				}
+			}
+		}
+	}
+
+	fclose(file);
+
+	if (!valid)
+	{
+		printf("%s ends early or has malformed element data.\n", path);
+		return false;
+	}
+
+	if (!hasColors)
+		mesh->colors.count = 0;
+
+	uint32_t vertexCount = mesh->positions.count / 3;
+	for (size_t i = 0; i < mesh->indices.count; ++i)
+	{
+		if (mesh->indices.data[i] >= vertexCount)
+		{
+			printf("%s references vertex %u which does not exist.\n", path, mesh->indices.data[i]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//Fits the mesh into the clip volume, x and y in [-1, 1] and z in [0, 1], keeping its proportions
+static void normalizePositions(SourceMesh *mesh)
+{
+	size_t vertexCount = mesh->positions.count / 3;
+	float minPos[3];
+	float maxPos[3];
+
+	for (int c = 0; c < 3; ++c)
+		minPos[c] = maxPos[c] = mesh->positions.data[c];
+
+	for (size_t v = 1; v < vertexCount; ++v)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			minPos[c] = fminf(minPos[c], mesh->positions.data[v * 3 + c]);
+			maxPos[c] = fmaxf(maxPos[c], mesh->positions.data[v * 3 + c]);
+		}
+	}
+
+	float extentXY = fmaxf(maxPos[0] - minPos[0], maxPos[1] - minPos[1]);
+	float extentZ = maxPos[2] - minPos[2];
+	float scale = extentXY > 0.0f ? 2.0f / extentXY : 1.0f;
+	if (extentZ * scale > 1.0f)
+		scale = 1.0f / extentZ;
+
+	float center[3];
+	for (int c = 0; c < 3; ++c)
+		center[c] = 0.5f * (minPos[c] + maxPos[c]);
+
+	for (size_t v = 0; v < vertexCount; ++v)
+	{
+		float *position = &mesh->positions.data[v * 3];
+		position[0] = (position[0] - center[0]) * scale;
+		position[1] = (position[1] - center[1]) * scale;
+		position[2] = (position[2] - center[2]) * scale + 0.5f;
+	}
+}
+
+//Reorders the triangles for the post-transform cache, optionally their clusters for overdraw, and then the vertices
+//in first use order. Returns the new vertex count, unused vertices are dropped
+static uint32_t optimizeMesh(float *vertices, uint32_t vertexCount, uint32_t stride, IndexArray *indices,
+		bool overdraw)
+{
+	VertexCacheStats before;
+	analyzeVertexCache(indices->data, indices->count, vertexCount, MESHOPT_CACHE_SIZE, &before);
+
+	uint32_t *clusters = malloc((indices->count / 3) * sizeof(uint32_t));
+	uint32_t clusterCount = optimizeVertexCache(indices->data, indices->count, vertexCount, MESHOPT_CACHE_SIZE,
+			clusters);
+	if (overdraw)
+		optimizeOverdraw(indices->data, indices->count, vertices, stride, clusters, clusterCount);
+	free(clusters);
+
+	uint32_t optimizedCount = optimizeVertexFetch(vertices, vertexCount, stride, indices->data, indices->count);
+
+	VertexCacheStats after;
+	analyzeVertexCache(indices->data, indices->count, optimizedCount, MESHOPT_CACHE_SIZE, &after);
+
+	printf("Vertex cache (FIFO %u): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", MESHOPT_CACHE_SIZE, before.acmr,
+			after.acmr, before.atvr, after.atvr);
+	if (overdraw)
+		printf(", %u clusters sorted for overdraw", clusterCount);
+	printf("\n");
+
+	if (optimizedCount < vertexCount)
+		printf("Dropped %u unreferenced vertices\n", vertexCount - optimizedCount);
+
+	return optimizedCount;
+}
+
+static bool writeConvertedMesh(SourceMesh *mesh, const char *path, bool pack, bool optimize, bool overdraw)
+{
+	uint32_t vertexCount = mesh->positions.count / 3;
+	uint32_t stride = 6 * sizeof(float);
+
+	float *vertices = malloc((size_t) vertexCount * stride);
+	for (uint32_t v = 0; v < vertexCount; ++v)
+	{
+		const float *position = &mesh->positions.data[v * 3];
+		memcpy(&vertices[v * 6], position, 3 * sizeof(float));
+
+		//Without colors in the source, position based colors at least make the shape readable
+		for (int c = 0; c < 3; ++c)
+			vertices[v * 6 + 3 + c] = mesh->colors.count > 0 ? mesh->colors.data[v * 3 + c] :
+					0.5f + 0.5f * fminf(fmaxf(position[c], -1.0f), 1.0f);
+	}
+
+	if (optimize)
+		vertexCount = optimizeMesh(vertices, vertexCount, stride, &mesh->indices, overdraw);
+
+	MeshHeader header;
+	initMeshHeader(&header, vertexCount, stride, mesh->indices.count);
+
+	header.attributeCount = 2;
+	header.attributes[0].location = 0;
+	header.attributes[0].format = MESH_FORMAT_FLOAT3;
+	header.attributes[0].offset = 0;
+	header.attributes[1].location = 1;
+	header.attributes[1].format = MESH_FORMAT_FLOAT3;
+	header.attributes[1].offset = 3 * sizeof(float);
+
+	computeBoundingSphere(vertices, stride, vertexCount, header.boundingSphere);
+
+	if (pack)
+	{
+		MeshHeader packedHeader;
+		void *packedVertices = packMeshVertices(&header, vertices, &packedHeader);
+		free(vertices);
+		vertices = packedVertices;
+		header = packedHeader;
+	}
+
+	if (header.indexStride == sizeof(uint16_t))
+		narrowMeshIndices(mesh->indices.data, header.indexCount);
+
+	bool written = writeMesh(path, &header, vertices, mesh->indices.data);
+	if (written)
+		printf("Wrote %s: %u vertices, %u triangles, %u bit indices, %.1f MiB\n", path, vertexCount,
+				header.indexCount / 3, 8 * header.indexStride,
+				(header.indexOffset + header.indexSize) / (1024.0 * 1024.0));
+
+	free(vertices);
+	return written;
+}
+
+int main(int argc, char **argv)
+{
+	const char *inputPath = NULL;
+	const char *outputPath = NULL;
+	bool normalize = true;
+	bool pack = false;
+	bool optimize = true;
+	bool overdraw = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--no-normalize"))
+			normalize = false;
+		else if (!strcmp(argv[i], "--packed"))
+			pack = true;
+		else if (!strcmp(argv[i], "--no-optimize"))
+			optimize = false;
+		else if (!strcmp(argv[i], "--overdraw"))
+			overdraw = true;
+		else if (inputPath == NULL)
+			inputPath = argv[i];
+		else if (outputPath == NULL)
+			outputPath = argv[i];
+		else
+			inputPath = NULL;
+	}
+
+	const char *extension = inputPath != NULL ? strrchr(inputPath, '.') : NULL;
+	if (outputPath == NULL || extension == NULL)
+	{
+		printf("Usage: %s INPUT.obj|INPUT.ply OUTPUT.mesh [--no-normalize] [--packed] [--no-optimize] "
+				"[--overdraw]\n", argv[0]);
+		return 1;
+	}
+
+	SourceMesh mesh;
+	memset(&mesh, 0, sizeof(SourceMesh));
+
+	bool loaded;
+	if (!strcasecmp(extension, ".obj"))
+		loaded = loadObj(&mesh, inputPath);
+	else if (!strcasecmp(extension, ".ply"))
+		loaded = loadPly(&mesh, inputPath);
+	else
+	{
+		printf("Unknown input format %s, expected .obj or .ply.\n", extension);
+		loaded = false;
+	}
+
+	if (loaded && (mesh.positions.count == 0 || mesh.indices.count == 0))
+	{
+		printf("%s has no triangles.\n", inputPath);
+		loaded = false;
+	}
+
+	if (loaded && normalize)
+		normalizePositions(&mesh);
+
+	bool written = loaded && writeConvertedMesh(&mesh, outputPath, pack, optimize, overdraw);
+
+	free(mesh.positions.data);
+	free(mesh.colors.data);
+	free(mesh.indices.data);
+
+	return written ? 0 : 1;
+}
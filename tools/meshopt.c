@@ -0,0 +1,312 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "meshopt.h"
+
+void analyzeVertexCache(const uint32_t *indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize,
+		VertexCacheStats *stats)
+{
+	//A vertex is in the cache while fewer than cacheSize misses happened since it was last loaded
+	uint32_t *loadedAt = malloc(vertexCount * sizeof(uint32_t));
+	memset(loadedAt, 0xff, vertexCount * sizeof(uint32_t));
+
+	uint32_t misses = 0;
+	for (uint32_t i = 0; i < indexCount; ++i)
+	{
+		uint32_t v = indices[i];
+		if (loadedAt[v] == UINT32_MAX || misses - loadedAt[v] >= cacheSize)
+		{
+			loadedAt[v] = misses;
+			misses++;
+		}
+	}
+
+	free(loadedAt);
+
+	stats->misses = misses;
+	stats->acmr = indexCount > 0 ? (float) misses / (indexCount / 3) : 0.0f;
+	stats->atvr = vertexCount > 0 ? (float) misses / vertexCount : 0.0f;
+}
+
+//Per vertex list of the triangles using it, flattened into one array
+typedef struct _Adjacency {
+	uint32_t *offsets;
+	uint32_t *triangles;
+} Adjacency;
+
+static void buildAdjacency(Adjacency *adjacency, const uint32_t *indices, uint32_t indexCount, uint32_t vertexCount,
+		uint32_t *liveCounts)
+{
+	memset(liveCounts, 0, vertexCount * sizeof(uint32_t));
+	for (uint32_t i = 0; i < indexCount; ++i)
+		liveCounts[indices[i]]++;
+
+	adjacency->offsets = malloc((vertexCount + 1) * sizeof(uint32_t));
+	adjacency->triangles = malloc(indexCount * sizeof(uint32_t));
+
+	adjacency->offsets[0] = 0;
+	for (uint32_t v = 0; v < vertexCount; ++v)
+		adjacency->offsets[v + 1] = adjacency->offsets[v] + liveCounts[v];
+
+	uint32_t *fill = malloc(vertexCount * sizeof(uint32_t));
+	memcpy(fill, adjacency->offsets, vertexCount * sizeof(uint32_t));
+	for (uint32_t i = 0; i < indexCount; ++i)
+		adjacency->triangles[fill[indices[i]]++] = i / 3;
+	free(fill);
+}
+
+//Pops the dead end stack for a vertex that still has triangles, falling back to a scan over all vertices
+static int64_t skipDeadEnd(const uint32_t *liveCounts, uint32_t *deadEnds, uint32_t *deadEndCount,
+		uint32_t *cursor, uint32_t vertexCount)
+{
+	while (*deadEndCount > 0)
+	{
+		uint32_t v = deadEnds[--(*deadEndCount)];
+		if (liveCounts[v] > 0)
+			return v;
+	}
+
+	while (*cursor < vertexCount)
+	{
+		uint32_t v = (*cursor)++;
+		if (liveCounts[v] > 0)
+			return v;
+	}
+
+	return -1;
+}
+
+uint32_t optimizeVertexCache(uint32_t *indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize,
+		uint32_t *clusters)
+{
+	uint32_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return 0;
+
+	uint32_t *liveCounts = malloc(vertexCount * sizeof(uint32_t));
+	Adjacency adjacency;
+	buildAdjacency(&adjacency, indices, indexCount, vertexCount, liveCounts);
+
+	//Cache entry time of every vertex, a vertex is cached while time - cacheTimes[v] <= cacheSize
+	uint32_t *cacheTimes = calloc(vertexCount, sizeof(uint32_t));
+	//Every emitted vertex is pushed, so the stack never holds more than indexCount entries
+	uint32_t *deadEnds = malloc(indexCount * sizeof(uint32_t));
+	uint32_t deadEndCount = 0;
+	uint8_t *emitted = calloc(triangleCount, sizeof(uint8_t));
+	uint32_t *output = malloc(indexCount * sizeof(uint32_t));
+	uint32_t outputCount = 0;
+
+	uint32_t time = cacheSize + 1;
+	uint32_t cursor = 0;
+	uint32_t clusterCount = 1;
+	clusters[0] = 0;
+
+	int64_t fanning = skipDeadEnd(liveCounts, deadEnds, &deadEndCount, &cursor, vertexCount);
+
+	while (fanning >= 0)
+	{
+		//Candidates for the next fanning vertex are the vertices of the triangles emitted around this one
+		uint32_t candidateStart = deadEndCount;
+
+		for (uint32_t a = adjacency.offsets[fanning]; a < adjacency.offsets[fanning + 1]; ++a)
+		{
+			uint32_t triangle = adjacency.triangles[a];
+			if (emitted[triangle])
+				continue;
+
+			for (uint32_t c = 0; c < 3; ++c)
+			{
+				uint32_t v = indices[triangle * 3 + c];
+				output[outputCount++] = v;
+				deadEnds[deadEndCount++] = v;
+				liveCounts[v]--;
+
+				if (time - cacheTimes[v] > cacheSize)
+					cacheTimes[v] = time++;
+			}
+
+			emitted[triangle] = 1;
+		}
+
+		//Prefer the candidate that entered the cache earliest but stays in it long enough to fan all its triangles
+		int64_t next = -1;
+		int64_t bestPriority = -1;
+		for (uint32_t i = candidateStart; i < deadEndCount; ++i)
+		{
+			uint32_t v = deadEnds[i];
+			if (liveCounts[v] == 0)
+				continue;
+
+			int64_t priority = 0;
+			if (time - cacheTimes[v] + 2 * liveCounts[v] <= cacheSize)
+				priority = time - cacheTimes[v];
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = v;
+			}
+		}
+
+		if (next < 0)
+		{
+			next = skipDeadEnd(liveCounts, deadEnds, &deadEndCount, &cursor, vertexCount);
+
+			//Jumping elsewhere loses the cache contents anyway, a good place to start a new cluster
+			uint32_t currentTriangle = outputCount / 3;
+			if (next >= 0 && currentTriangle - clusters[clusterCount - 1] >= MESHOPT_MIN_CLUSTER_TRIANGLES)
+				clusters[clusterCount++] = currentTriangle;
+		}
+
+		fanning = next;
+	}
+
+	memcpy(indices, output, indexCount * sizeof(uint32_t));
+
+	free(output);
+	free(emitted);
+	free(deadEnds);
+	free(cacheTimes);
+	free(adjacency.triangles);
+	free(adjacency.offsets);
+	free(liveCounts);
+
+	return clusterCount;
+}
+
+typedef struct _Cluster {
+	uint32_t firstTriangle;
+	uint32_t triangleCount;
+	float sortKey;
+} Cluster;
+
+static int compareClusters(const void *a, const void *b)
+{
+	float keyA = ((const Cluster *) a)->sortKey;
+	float keyB = ((const Cluster *) b)->sortKey;
+	return keyA < keyB ? 1 : (keyA > keyB ? -1 : 0);
+}
+
+static const float * getPosition(const float *positions, uint32_t stride, uint32_t vertex)
+{
+	return (const float *) ((const char *) positions + (size_t) vertex * stride);
+}
+
+void optimizeOverdraw(uint32_t *indices, uint32_t indexCount, const float *positions, uint32_t stride,
+		const uint32_t *clusters, uint32_t clusterCount)
+{
+	uint32_t triangleCount = indexCount / 3;
+	if (clusterCount < 2)
+		return;
+
+	Cluster *sorted = malloc(clusterCount * sizeof(Cluster));
+	float meshCenter[3] = { 0.0f, 0.0f, 0.0f };
+	float meshArea = 0.0f;
+
+	float (*centers)[3] = calloc(clusterCount, sizeof(float[3]));
+	float (*normals)[3] = calloc(clusterCount, sizeof(float[3]));
+
+	//Area weighted centroid and normal of every cluster and of the whole mesh
+	for (uint32_t c = 0; c < clusterCount; ++c)
+	{
+		uint32_t first = clusters[c];
+		uint32_t last = c + 1 < clusterCount ? clusters[c + 1] : triangleCount;
+		float clusterArea = 0.0f;
+
+		for (uint32_t t = first; t < last; ++t)
+		{
+			const float *p0 = getPosition(positions, stride, indices[t * 3]);
+			const float *p1 = getPosition(positions, stride, indices[t * 3 + 1]);
+			const float *p2 = getPosition(positions, stride, indices[t * 3 + 2]);
+
+			float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			float normal[3] = {
+				e1[1] * e2[2] - e1[2] * e2[1],
+				e1[2] * e2[0] - e1[0] * e2[2],
+				e1[0] * e2[1] - e1[1] * e2[0]
+			};
+			float area = 0.5f * sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+			for (uint32_t i = 0; i < 3; ++i)
+			{
+				float center = (p0[i] + p1[i] + p2[i]) / 3.0f;
+				centers[c][i] += center * area;
+				meshCenter[i] += center * area;
+				normals[c][i] += normal[i];
+			}
+
+			clusterArea += area;
+		}
+
+		for (uint32_t i = 0; i < 3 && clusterArea > 0.0f; ++i)
+			centers[c][i] /= clusterArea;
+		meshArea += clusterArea;
+
+		sorted[c].firstTriangle = first;
+		sorted[c].triangleCount = last - first;
+	}
+
+	for (uint32_t i = 0; i < 3 && meshArea > 0.0f; ++i)
+		meshCenter[i] /= meshArea;
+
+	//Occlusion potential, clusters far out along their own normal are likely to hide the others
+	for (uint32_t c = 0; c < clusterCount; ++c)
+	{
+		float length = sqrtf(normals[c][0] * normals[c][0] + normals[c][1] * normals[c][1] +
+				normals[c][2] * normals[c][2]);
+		float key = 0.0f;
+		for (uint32_t i = 0; i < 3 && length > 0.0f; ++i)
+			key += (centers[c][i] - meshCenter[i]) * normals[c][i] / length;
+		sorted[c].sortKey = key;
+	}
+
+	qsort(sorted, clusterCount, sizeof(Cluster), compareClusters);
+
+	uint32_t *output = malloc(indexCount * sizeof(uint32_t));
+	uint32_t outputCount = 0;
+	for (uint32_t c = 0; c < clusterCount; ++c)
+	{
+		memcpy(&output[outputCount], &indices[sorted[c].firstTriangle * 3], sorted[c].triangleCount * 3 *
+				sizeof(uint32_t));
+		outputCount += sorted[c].triangleCount * 3;
+	}
+
+	memcpy(indices, output, indexCount * sizeof(uint32_t));
+
+	free(output);
+	free(normals);
+	free(centers);
+	free(sorted);
+}
+
+uint32_t optimizeVertexFetch(void *vertices, uint32_t vertexCount, uint32_t stride, uint32_t *indices,
+		uint32_t indexCount)
+{
+	uint32_t *remap = malloc(vertexCount * sizeof(uint32_t));
+	memset(remap, 0xff, vertexCount * sizeof(uint32_t));
+
+	char *reordered = malloc((size_t) vertexCount * stride);
+	uint32_t newCount = 0;
+
+	for (uint32_t i = 0; i < indexCount; ++i)
+	{
+		uint32_t v = indices[i];
+		if (remap[v] == UINT32_MAX)
+		{
+			remap[v] = newCount;
+			memcpy(reordered + (size_t) newCount * stride, (const char *) vertices + (size_t) v * stride, stride);
+			newCount++;
+		}
+
+		indices[i] = remap[v];
+	}
+
+	memcpy(vertices, reordered, (size_t) newCount * stride);
+
+	free(reordered);
+	free(remap);
+
+	return newCount;
+}
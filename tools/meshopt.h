@@ -0,0 +1,40 @@
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include <stdint.h>
+
+//FIFO size both the optimizer and the statistics assume, close to what current GPUs reuse in practice
+#define MESHOPT_CACHE_SIZE 16
+//Clusters are only cut at dead ends once they have this many triangles, smaller ones cost cache locality for
+//little overdraw gain
+#define MESHOPT_MIN_CLUSTER_TRIANGLES 64
+
+typedef struct _VertexCacheStats {
+	uint32_t misses;
+	//Average cache miss ratio, misses per triangle, 0.5 is the ideal for large regular meshes and 3 the worst case
+	float acmr;
+	//Average transformed vertex ratio, misses per vertex, 1 is the ideal
+	float atvr;
+} VertexCacheStats;
+
+//Simulates a FIFO post-transform cache of cacheSize entries over the triangle list
+void analyzeVertexCache(const uint32_t *indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize,
+		VertexCacheStats *stats);
+
+//Tipsify (Sander, Nehab and Barczak 2007), reorders the triangles in place for post-transform cache locality. The
+//first triangle of every cluster is written to clusters, which needs room for indexCount / 3 entries, and the
+//number of clusters is returned
+uint32_t optimizeVertexCache(uint32_t *indices, uint32_t indexCount, uint32_t vertexCount, uint32_t cacheSize,
+		uint32_t *clusters);
+
+//Sorts the clusters so the ones facing outwards from the mesh center come first and occlude the rest, keeping the
+//order inside every cluster. positions is the first float3 of every vertex, stride is in bytes
+void optimizeOverdraw(uint32_t *indices, uint32_t indexCount, const float *positions, uint32_t stride,
+		const uint32_t *clusters, uint32_t clusterCount);
+
+//Renumbers the vertices in the order the triangles first use them and moves their data to match, so vertex
+//fetches walk through memory front to back. Vertices no triangle uses are dropped, the new count is returned
+uint32_t optimizeVertexFetch(void *vertices, uint32_t vertexCount, uint32_t stride, uint32_t *indices,
+		uint32_t indexCount);
+
+#endif